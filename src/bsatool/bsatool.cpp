@@ -1,15 +1,34 @@
 
 #include <sys/stat.h>
 #include <sys/types.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include <stdexcept>
 #include <sstream>
 #include <fstream>
 #include <iomanip>
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <cctype>
 #include <array>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <functional>
+#include <iterator>
 
 #include "components/archives/bsaarchive.hpp"
+#include "components/archives/bsawriter.hpp"
+#include "components/archives/batchreader.hpp"
+
+#include "misc/recordlayout.hpp"
+#include "misc/binarywriter.hpp"
+#include "misc/nameindex.hpp"
 
 #ifdef _WIN32
 #include <direct.h>
@@ -18,34 +37,11 @@
 #endif
 
 
-int main(int argc, char *argv[])
+namespace
 {
-    if(argc < 2)
-    {
-        std::cerr<< "Usage: "<<argv[0]<<" [option]" <<std::endl
-                 << "  Available options:" <<std::endl
-                 << "    -e <archive.bsa>  - Extract files from BSA" <<std::endl
-                 <<std::endl;
-        return 1;
-    }
-
-    const char *archname = nullptr;
-    for(int i = 1;i < argc;++i)
-    {
-        if(strcmp(argv[i], "-e") == 0)
-        {
-            if(argc-1 <= i)
-                throw std::runtime_error("Missing archive filename");
-            archname = argv[++i];
-            break;
-        }
-        else
-            throw std::runtime_error(std::string("Invalid option: ")+argv[i]);
-    }
-
-    if(!archname)
-        throw std::runtime_error("No input specified");
 
+int extractArchive(const char *archname)
+{
     Archives::BsaArchive archive;
     archive.load(archname);
 
@@ -151,3 +147,1136 @@ int main(int argc, char *argv[])
 
     return 0;
 }
+
+
+/* Opens and reads every entry of the archive with the given backend, and
+ * returns the elapsed time in microseconds. If seeking is set, the entries are
+ * read in small chunks going backwards, similar to how the block parsers
+ * follow object lists.
+ */
+long long readAllEntries(const char *archname, Archives::BsaArchive::Backend backend, bool seeking, size_t &total)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    Archives::BsaArchive archive;
+    archive.load(archname, backend);
+    if(archive.getBackend() != backend)
+        std::cerr<< "Backend "<<backend<<" unavailable, using "<<archive.getBackend() <<std::endl;
+
+    std::array<char,4096> buf;
+    auto read_stream = [&buf, &total, seeking](Archives::IStreamPtr instream)
+    {
+        if(!instream) return;
+        if(!seeking)
+        {
+            while(instream->read(buf.data(), buf.size()) || instream->gcount() > 0)
+                total += instream->gcount();
+            return;
+        }
+
+        std::streamoff pos = instream->seekg(0, std::ios_base::end).tellg();
+        while(pos > 0)
+        {
+            pos = std::max<std::streamoff>(pos-40, 0);
+            instream->seekg(pos);
+            instream->read(buf.data(), 20);
+            total += instream->gcount();
+            instream->clear();
+        }
+    };
+    for(size_t id : archive.getIds())
+        read_stream(archive.open(id));
+    for(const std::string &name : archive.list())
+        read_stream(archive.open(name.c_str()));
+
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+}
+
+/* Looks up every entry in the archive a number of times, and returns the
+ * average time per lookup in nanoseconds.
+ */
+double lookupAllEntries(const Archives::BsaArchive &archive, int iterations)
+{
+    size_t found = 0, lookups = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0;i < iterations;++i)
+    {
+        for(size_t id : archive.getIds())
+            found += archive.exists(id);
+        for(const std::string &name : archive.list())
+            found += archive.exists(name.c_str());
+        lookups += archive.getIds().size() + archive.list().size();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    if(found != lookups)
+        std::cerr<< "Only found "<<found<<" of "<<lookups<<" entries" <<std::endl;
+    if(lookups == 0) return 0.0;
+    return std::chrono::duration<double,std::nano>(end-start).count() / lookups;
+}
+
+/* Reads every entry of the archive through a BatchReader, in batches of the
+ * given size, and returns the elapsed time in microseconds.
+ */
+long long batchReadEntries(const char *archname, bool useRing, size_t batchsize, size_t &total, bool &usedRing)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    Archives::BsaArchive archive;
+    archive.load(archname, Archives::BsaArchive::Backend_Stream);
+    std::shared_ptr<Archives::SharedFile> file = Archives::SharedFile::open(archname);
+    if(!file) throw std::runtime_error(std::string("Failed to open ")+archname);
+
+    Archives::BatchReader reader(batchsize, useRing);
+    usedRing = reader.isUsingRing();
+
+    std::vector<std::pair<std::streamsize,std::streamsize>> ranges;
+    for(size_t id : archive.getIds())
+    {
+        std::streamsize offset, size;
+        if(archive.getEntryRange(id, offset, size))
+            ranges.push_back(std::make_pair(offset, size));
+    }
+    for(const std::string &name : archive.list())
+    {
+        std::streamsize offset, size;
+        if(archive.getEntryRange(name.c_str(), offset, size))
+            ranges.push_back(std::make_pair(offset, size));
+    }
+
+    std::vector<std::vector<char>> buffers(batchsize);
+    std::vector<Archives::BatchReader::Request> requests;
+    for(size_t i = 0;i < ranges.size();i += batchsize)
+    {
+        requests.clear();
+        for(size_t j = i;j < std::min(i+batchsize, ranges.size());++j)
+        {
+            std::vector<char> &buf = buffers[j-i];
+            buf.resize(ranges[j].second);
+
+            Archives::BatchReader::Request req;
+            req.mFile = file.get();
+            req.mOffset = ranges[j].first;
+            req.mSize = ranges[j].second;
+            req.mBuffer = buf.data();
+            req.mResult = -1;
+            requests.push_back(req);
+        }
+        reader.read(requests.data(), requests.size());
+        for(const Archives::BatchReader::Request &req : requests)
+        {
+            if(req.mResult > 0)
+                total += req.mResult;
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+}
+
+/* A stand-in record for the parse benchmark. */
+struct ParseRecord {
+    uint32_t mA;
+    uint16_t mB;
+    uint8_t mC;
+};
+constexpr auto gParseRecordLayout = Misc::layout(
+    Misc::field(&ParseRecord::mA, "A"),
+    Misc::field(&ParseRecord::mB, "B"),
+    Misc::field(&ParseRecord::mC, "C")
+);
+static_assert(gParseRecordLayout.size() == 7, "ParseRecord must be 7 bytes");
+
+enum ParseMode {
+    Parse_Stream,
+    Parse_Reader,
+    Parse_Layout
+};
+
+/* Decodes every entry of the archive as a run of 7-byte records, either field
+ * by field from the entry stream, field by field through a BinaryReader over
+ * the entry read whole, or a record at a time through a RecordLayout. Returns
+ * the elapsed time in microseconds.
+ */
+long long parseAllEntries(const char *archname, ParseMode mode, uint32_t &checksum)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    Archives::BsaArchive archive;
+    archive.load(archname);
+
+    std::vector<char> data;
+    auto parse = [&data, &checksum, mode](Archives::IStreamPtr instream)
+    {
+        if(!instream) return;
+        std::streamsize size = instream->seekg(0, std::ios_base::end).tellg();
+        instream->seekg(0);
+
+        if(mode == Parse_Stream)
+        {
+            for(std::streamsize pos = 0;pos+7 <= size;pos += 7)
+            {
+                checksum += Misc::read_le32(*instream);
+                checksum += Misc::read_le16(*instream);
+                checksum += uint8_t(instream->get());
+            }
+            return;
+        }
+
+        data.resize(size);
+        instream->read(data.data(), size);
+        Misc::BinaryReader reader(data.data(), instream->gcount());
+        if(mode == Parse_Reader)
+        {
+            while(reader.remaining() >= 7)
+            {
+                checksum += reader.read32();
+                checksum += reader.read16();
+                checksum += reader.read8();
+            }
+            return;
+        }
+
+        ParseRecord record;
+        while(reader.remaining() >= gParseRecordLayout.size())
+        {
+            gParseRecordLayout.read(reader, record);
+            checksum += record.mA + record.mB + record.mC;
+        }
+    };
+    for(size_t id : archive.getIds())
+        parse(archive.open(id));
+    for(const std::string &name : archive.list())
+        parse(archive.open(name.c_str()));
+
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+}
+
+int benchmarkArchive(const char *archname, int iterations)
+{
+    {
+        Archives::BsaArchive archive;
+        archive.load(archname);
+        size_t count = archive.getIds().size() + archive.list().size();
+        std::cout<< std::setw(8)<<"lookup"<<": "<<lookupAllEntries(archive, iterations*20)<<" ns per entry ("<<count<<" entries)" <<std::endl;
+    }
+
+    static const struct {
+        Archives::BsaArchive::Backend backend;
+        const char *name;
+    } backends[] = {
+        { Archives::BsaArchive::Backend_Stream, "stream" },
+        { Archives::BsaArchive::Backend_PRead, "pread" },
+        { Archives::BsaArchive::Backend_MMap, "mmap" },
+    };
+
+    for(bool seeking : { false, true })
+    {
+        for(const auto &backend : backends)
+        {
+            long long best = -1;
+            size_t total = 0;
+            for(int i = 0;i < iterations;++i)
+            {
+                total = 0;
+                long long usecs = readAllEntries(archname, backend.backend, seeking, total);
+                if(best < 0 || usecs < best) best = usecs;
+            }
+            std::cout<< std::setw(8)<<backend.name<<(seeking ? " (seeking)" : "")<<": "<<total<<" bytes in "<<best<<" us (best of "<<iterations<<")" <<std::endl;
+        }
+    }
+
+    for(bool useRing : { false, true })
+    {
+        long long best = -1;
+        size_t total = 0;
+        bool usedRing = false;
+        for(int i = 0;i < iterations;++i)
+        {
+            total = 0;
+            long long usecs = batchReadEntries(archname, useRing, 64, total, usedRing);
+            if(best < 0 || usecs < best) best = usecs;
+        }
+        if(useRing && !usedRing)
+        {
+            std::cout<< "io_uring unavailable" <<std::endl;
+            break;
+        }
+        std::cout<< std::setw(8)<<(usedRing ? "io_uring" : "batch")<<": "<<total<<" bytes in "<<best<<" us (best of "<<iterations<<")" <<std::endl;
+    }
+
+    static const char *const parsenames[] = { "istream", "reader", "layout" };
+    uint32_t checksums[3] = { 0, 0, 0 };
+    for(ParseMode mode : { Parse_Stream, Parse_Reader, Parse_Layout })
+    {
+        long long best = -1;
+        for(int i = 0;i < iterations;++i)
+        {
+            checksums[mode] = 0;
+            long long usecs = parseAllEntries(archname, mode, checksums[mode]);
+            if(best < 0 || usecs < best) best = usecs;
+        }
+        std::cout<< std::setw(8)<<parsenames[mode]<<": parsed in "<<best<<" us (best of "<<iterations<<")" <<std::endl;
+    }
+    if(checksums[0] != checksums[1] || checksums[0] != checksums[2])
+        std::cerr<< "Parse checksum mismatch: "<<checksums[0]<<" / "<<checksums[1]<<" / "<<checksums[2] <<std::endl;
+    return 0;
+}
+
+/* Loads the location names from the archive's MAPNAMES.* entries, and times
+ * finding each of them by a linear search over each region's names (as the
+ * world used to), through a NameIndex, and by a prefix through the index.
+ */
+int benchmarkLocations(const char *archname, int iterations)
+{
+    Archives::BsaArchive archive;
+    archive.load(archname);
+
+    std::vector<std::vector<std::string>> regions;
+    for(const std::string &entry : archive.list())
+    {
+        if(entry.compare(0, 9, "MAPNAMES.") != 0)
+            continue;
+
+        Archives::IStreamPtr stream = archive.open(entry.c_str());
+        std::vector<char> data((std::istreambuf_iterator<char>(*stream)), std::istreambuf_iterator<char>());
+        Misc::BinaryReader reader(data);
+
+        std::vector<std::string> names(reader.read32());
+        for(std::string &name : names)
+        {
+            const char *str = reinterpret_cast<const char*>(reader.take(32));
+            name.assign(str, strnlen(str, 32));
+        }
+        regions.push_back(std::move(names));
+    }
+
+    std::vector<std::string> queries;
+    Misc::NameIndex index;
+    for(size_t regnum = 0;regnum < regions.size();++regnum)
+    {
+        for(size_t mapnum = 0;mapnum < regions[regnum].size();++mapnum)
+        {
+            index.add(regions[regnum][mapnum], (regnum<<16) | mapnum);
+            queries.push_back(regions[regnum][mapnum]);
+        }
+    }
+    if(queries.empty())
+    {
+        std::cerr<< "No MAPNAMES entries in "<<archname <<std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    index.build();
+    auto end = std::chrono::steady_clock::now();
+    std::cout<< std::setw(8)<<"build"<<": "<<queries.size()<<" names in "
+             <<std::chrono::duration_cast<std::chrono::microseconds>(end-start).count()<<" us" <<std::endl;
+
+    // Upper-cased, so every lookup has to ignore case.
+    std::vector<std::string> upper = queries;
+    for(std::string &name : upper)
+        std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+
+    auto timeLookups = [&queries, iterations](const char *label, std::function<size_t(size_t)> lookup)
+    {
+        double best = -1.0;
+        size_t found = 0;
+        for(int i = 0;i < iterations;++i)
+        {
+            found = 0;
+            auto start = std::chrono::steady_clock::now();
+            for(size_t q = 0;q < queries.size();++q)
+                found += lookup(q);
+            auto end = std::chrono::steady_clock::now();
+            double ns = std::chrono::duration<double,std::nano>(end-start).count() / queries.size();
+            if(best < 0.0 || ns < best) best = ns;
+        }
+        std::cout<< std::setw(8)<<label<<": "<<best<<" ns per lookup ("<<found<<" of "<<queries.size()
+                 <<" found, best of "<<iterations<<")" <<std::endl;
+    };
+
+    timeLookups("linear", [&regions, &queries](size_t q) -> size_t
+    {
+        for(const std::vector<std::string> &names : regions)
+        {
+            if(std::find(names.begin(), names.end(), queries[q]) != names.end())
+                return 1;
+        }
+        return 0;
+    });
+    timeLookups("exact", [&index, &upper](size_t q) -> size_t
+    {
+        Misc::NameIndex::range found = index.find(upper[q]);
+        return found.first != found.second;
+    });
+    timeLookups("prefix", [&index, &upper](size_t q) -> size_t
+    {
+        Misc::NameIndex::range found = index.findPrefix(upper[q].substr(0, 4));
+        return found.first != found.second;
+    });
+
+    return 0;
+}
+
+/* Random numbers for the synthetic archive. Fixed seed, so results can be
+ * compared between runs. */
+class SyntheticRand {
+    uint32_t mSeed;
+
+public:
+    SyntheticRand() : mSeed(12345) { }
+
+    uint32_t next()
+    {
+        mSeed = mSeed*1664525u + 1013904223u;
+        return mSeed>>8;
+    }
+    // In [0, max).
+    uint32_t next(uint32_t max) { return max ? next()%max : 0; }
+
+    void fill(Misc::BinaryWriter &writer, size_t count)
+    {
+        unsigned char *dst = writer.append(count);
+        for(size_t i = 0;i < count;++i)
+            dst[i] = next();
+    }
+};
+
+/* Writes an RMB-shaped entry: the fixed header, a number of exterior and
+ * interior blocks, and the block-wide models and flats. Object fields are
+ * random, with counts giving up to maxobjs objects in all.
+ */
+void writeSyntheticRmb(Misc::BinaryWriter &writer, SyntheticRand &rand, size_t maxobjs)
+{
+    size_t blockcount = 1 + rand.next(4);
+    uint8_t modelcount = std::min<size_t>(rand.next(maxobjs/8 + 1), 255);
+    uint8_t flatcount = std::min<size_t>(rand.next(maxobjs/8 + 1), 255);
+    writer.write8(blockcount);
+    writer.write8(modelcount);
+    writer.write8(flatcount);
+
+    // Block positions, buildings, and unknowns.
+    rand.fill(writer, 32*20 + 32*26 + 32*4);
+    size_t sizespos = writer.tell();
+    for(size_t i = 0;i < 32;++i)
+        writer.write32(0);
+    // Unknowns, ground textures, scenery, automap, and the unused names.
+    rand.fill(writer, 8 + 256 + 256 + 4096 + 429);
+
+    // An exterior and interior block for each, sized after.
+    size_t perblock = maxobjs / (blockcount*2) + 1;
+    for(size_t i = 0;i < blockcount;++i)
+    {
+        size_t start = writer.tell();
+        for(int j = 0;j < 2;++j)
+        {
+            uint8_t models = std::min<size_t>(rand.next(perblock), 255);
+            uint8_t flats = std::min<size_t>(rand.next(perblock), 255);
+            uint8_t sec3s = rand.next(4);
+            uint8_t people = rand.next(4);
+            uint8_t doors = rand.next(4);
+            writer.write8(models);
+            writer.write8(flats);
+            writer.write8(sec3s);
+            writer.write8(people);
+            writer.write8(doors);
+            rand.fill(writer, 6*2);
+            rand.fill(writer, models*66 + flats*17 + sec3s*16 + people*16 + doors*19);
+        }
+        writer.patch32(sizespos + i*4, writer.tell() - start);
+    }
+
+    rand.fill(writer, modelcount*66 + flatcount*17);
+}
+
+/* Writes an RDB-shaped entry: the header with its model names, and a grid of
+ * object lists linked by offset, holding up to maxobjs models and flats, some
+ * with actions.
+ */
+void writeSyntheticRdb(Misc::BinaryWriter &writer, SyntheticRand &rand, size_t maxobjs)
+{
+    uint32_t width = 1 + rand.next(4);
+    uint32_t height = 1 + rand.next(4);
+    uint32_t mdlcount = 1 + rand.next(64);
+
+    writer.write32(rand.next());
+    writer.write32(width);
+    writer.write32(height);
+    size_t rootpos = writer.tell();
+    writer.write32(0);
+    writer.write32(rand.next());
+    // Model names are a five digit mesh ID and a three letter type.
+    for(uint32_t i = 0;i < 750;++i)
+    {
+        char name[9] = { 0 };
+        if(i < mdlcount)
+            snprintf(name, sizeof(name), "%05uMDL", unsigned(rand.next(60000)));
+        writer.write(name, 8);
+    }
+    rand.fill(writer, 750*4);
+    // Unknown list offset, and unknowns.
+    writer.write32(0);
+    rand.fill(writer, 3*4);
+
+    writer.patch32(rootpos, writer.tell());
+    size_t rootoffsets = writer.tell();
+    for(uint32_t i = 0;i < width*height;++i)
+        writer.write32(0);
+
+    size_t perlist = maxobjs / (width*height) + 1;
+    for(uint32_t i = 0;i < width*height;++i)
+    {
+        size_t count = rand.next(perlist);
+        size_t link = rootoffsets + i*4;
+        for(size_t j = 0;j < count;++j)
+        {
+            uint32_t offset = writer.tell();
+            writer.patch32(link, offset);
+            link = offset;
+
+            bool ismodel = rand.next(2) == 0;
+            // Next (filled in by the next object, if any), previous, position.
+            writer.write32(0);
+            writer.write32(0);
+            rand.fill(writer, 3*4);
+            writer.write8(ismodel ? 0x01 : 0x03);
+            writer.write32(offset + 25);
+
+            size_t actionpos;
+            if(ismodel)
+            {
+                rand.fill(writer, 3*4);
+                writer.write16(rand.next(mdlcount));
+                writer.write32(rand.next());
+                writer.write8(rand.next());
+                actionpos = writer.tell();
+                writer.write32(0);
+            }
+            else
+            {
+                rand.fill(writer, 3*2);
+                actionpos = writer.tell();
+                writer.write32(0);
+                writer.write8(rand.next());
+            }
+
+            if(rand.next(8) == 0)
+            {
+                writer.patch32(actionpos, writer.tell());
+                // Action data, target, and type.
+                rand.fill(writer, 5);
+                writer.write32(0);
+                writer.write8(rand.next());
+            }
+        }
+    }
+}
+
+/* Writes an archive of RMB and RDB shaped entries for benchmarking, so both
+ * the reading layer here and the real block decoders (opendf_worldbench
+ * -blocks) can be timed on it. Entries have up to about maxsize bytes of
+ * objects.
+ */
+int generateArchive(const char *outname, size_t count, size_t maxsize, bool quiet=false)
+{
+    Archives::BsaWriter writer;
+    writer.open(outname, Archives::BsaWriter::Type_Named);
+
+    SyntheticRand rand;
+    std::vector<char> data;
+    for(size_t i = 0;i < count;++i)
+    {
+        data.clear();
+        Misc::BinaryWriter entry(data);
+        // Objects are a few dozen bytes each.
+        size_t maxobjs = 1 + rand.next(maxsize/32 + 1);
+
+        std::stringstream sstr;
+        sstr<< "B"<<std::setfill('0')<<std::setw(7)<<i;
+        if(i%2 == 0)
+        {
+            writeSyntheticRmb(entry, rand, maxobjs);
+            sstr<< ".RMB";
+        }
+        else
+        {
+            writeSyntheticRdb(entry, rand, maxobjs);
+            sstr<< ".RDB";
+        }
+
+        std::istringstream instream(std::string(data.begin(), data.end()));
+        writer.add(sstr.str(), instream);
+    }
+    writer.close();
+
+    if(!quiet)
+        std::cout<< "Wrote "<<count<<" entries to "<<outname <<std::endl;
+    return 0;
+}
+
+/* Generates synthetic archives of increasing size in a temporary directory,
+ * and prints the average lookup time for each, so it can be seen whether it
+ * stays flat as the archive grows.
+ */
+int sweepLookups(int iterations)
+{
+#ifndef _WIN32
+    const char *tmpdir = getenv("TMPDIR");
+    std::string dirtemplate = std::string((tmpdir && *tmpdir) ? tmpdir : "/tmp") + "/bsatool.XXXXXX";
+    std::vector<char> dirname(dirtemplate.begin(), dirtemplate.end());
+    dirname.push_back('\0');
+    if(!mkdtemp(dirname.data()))
+        throw std::runtime_error("Failed to create a temporary directory in "+dirtemplate);
+    std::string dir(dirname.data());
+#else
+    std::string dir(".");
+#endif
+
+    // The last is as many as a BSA can hold.
+    for(size_t count : { 1024, 4096, 16384, 65535 })
+    {
+        std::stringstream sstr;
+        sstr<< dir<<"/lookup"<<count<<".bsa";
+        std::string fname = sstr.str();
+        // Entry contents don't matter for lookups, so keep them small.
+        generateArchive(fname.c_str(), count, 64, true);
+
+        double nsecs = 0.0;
+        {
+            Archives::BsaArchive archive;
+            archive.load(fname);
+            // Roughly the same number of lookups for each size.
+            int rounds = std::max<int>(1, iterations*4 * 65536 / count);
+            nsecs = lookupAllEntries(archive, rounds);
+        }
+        std::remove(fname.c_str());
+
+        std::cout<< std::setw(8)<<count<<" entries: "<<nsecs<<" ns per lookup" <<std::endl;
+    }
+
+#ifndef _WIN32
+    rmdir(dir.c_str());
+#endif
+    return 0;
+}
+
+bool parseId(const std::string &str, size_t &id)
+{
+    char *end = nullptr;
+    unsigned long val = strtoul(str.c_str(), &end, 10);
+    if(str.empty() || *end != '\0')
+        return false;
+    id = val;
+    return true;
+}
+
+/* Splits a CSV line into fields, unquoting quoted ones. Returns false if a
+ * quoted field isn't closed. */
+bool splitCsvLine(const std::string &line, std::vector<std::string> &fields)
+{
+    fields.clear();
+    size_t pos = 0;
+    while(true)
+    {
+        std::string field;
+        if(pos < line.size() && line[pos] == '"')
+        {
+            ++pos;
+            while(true)
+            {
+                if(pos >= line.size())
+                    return false;
+                if(line[pos] == '"')
+                {
+                    if(pos+1 >= line.size() || line[pos+1] != '"')
+                        break;
+                    ++pos;
+                }
+                field += line[pos++];
+            }
+            ++pos;
+            if(pos < line.size() && line[pos] != ',')
+                return false;
+        }
+        else
+        {
+            size_t end = std::min(line.find(',', pos), line.size());
+            field = line.substr(pos, end-pos);
+            pos = end;
+        }
+        fields.push_back(std::move(field));
+
+        if(pos >= line.size())
+            return true;
+        ++pos;
+    }
+}
+
+struct TraceOp {
+    uint64_t mStream;
+    std::string mOp;
+    std::string mArchive;
+    std::string mName;
+    std::streamoff mOffset;
+    std::streamsize mBytes;
+};
+
+std::vector<TraceOp> loadTrace(const char *tracename)
+{
+    std::ifstream file(tracename);
+    if(!file.is_open())
+        throw std::runtime_error(std::string("Failed to open ")+tracename);
+
+    std::vector<TraceOp> ops;
+    std::vector<std::string> fields;
+    std::string line;
+    size_t linenum = 1;
+    std::getline(file, line); // header
+    while(std::getline(file, line))
+    {
+        ++linenum;
+        TraceOp op;
+        try {
+            if(!splitCsvLine(line, fields) || fields.size() != 8)
+                throw std::runtime_error("wrong number of fields");
+            op.mStream = std::stoull(fields[1]);
+            op.mOp = fields[2];
+            op.mArchive = fields[3];
+            op.mName = fields[4];
+            op.mOffset = std::stoll(fields[5]);
+            op.mBytes = std::stoll(fields[6]);
+        }
+        catch(std::logic_error&) {
+            // From the number conversions.
+            std::cerr<< "Skipping malformed trace line "<<linenum<<" (invalid number): "<<line <<std::endl;
+            continue;
+        }
+        catch(std::exception &e) {
+            std::cerr<< "Skipping malformed trace line "<<linenum<<" ("<<e.what()<<"): "<<line <<std::endl;
+            continue;
+        }
+        ops.push_back(std::move(op));
+    }
+    return ops;
+}
+
+/* Re-issues the opens, reads, and seeks from a VFS trace against the archives
+ * in the given directory, and returns the elapsed time in microseconds.
+ */
+long long replayOps(const std::vector<TraceOp> &ops, const std::string &datadir,
+                    Archives::BsaArchive::Backend backend, size_t &total)
+{
+    std::map<std::string,std::unique_ptr<Archives::BsaArchive>> archives;
+    for(const TraceOp &op : ops)
+    {
+        if(op.mOp != "open" || op.mArchive.empty() || archives.find(op.mArchive) != archives.end())
+            continue;
+        std::unique_ptr<Archives::BsaArchive> archive(new Archives::BsaArchive());
+        archive->load(datadir+op.mArchive, backend);
+        archives[op.mArchive] = std::move(archive);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::map<uint64_t,Archives::IStreamPtr> streams;
+    std::vector<char> buf;
+    for(const TraceOp &op : ops)
+    {
+        if(op.mOp == "open")
+        {
+            Archives::IStreamPtr stream;
+            if(op.mArchive.empty())
+                stream.reset(new std::ifstream(op.mName.c_str(), std::ios_base::binary));
+            else
+            {
+                Archives::BsaArchive *archive = archives[op.mArchive].get();
+                size_t id;
+                if(archive->getIds().empty())
+                    stream = archive->open(op.mName.c_str());
+                else if(parseId(op.mName, id))
+                    stream = archive->open(id);
+                else
+                {
+                    std::cerr<< "Skipping open of "<<op.mArchive<<":"<<op.mName<<", which isn't an entry ID" <<std::endl;
+                    continue;
+                }
+            }
+            if(!stream || !stream->good())
+                std::cerr<< "Failed to open "<<op.mArchive<<":"<<op.mName <<std::endl;
+            else
+                streams[op.mStream] = std::move(stream);
+            continue;
+        }
+
+        auto iter = streams.find(op.mStream);
+        if(iter == streams.end())
+            continue;
+
+        if(op.mOp == "close")
+            streams.erase(iter);
+        else if(op.mOp == "seek")
+        {
+            iter->second->clear();
+            iter->second->seekg(op.mOffset);
+        }
+        else if(op.mOp == "read")
+        {
+            buf.resize(std::max<size_t>(buf.size(), op.mBytes));
+            iter->second->read(buf.data(), op.mBytes);
+            total += iter->second->gcount();
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+}
+
+int replayTrace(const char *tracename, std::string datadir, int iterations)
+{
+    if(!datadir.empty() && datadir.back() != '/' && datadir.back() != '\\')
+        datadir += '/';
+
+    std::vector<TraceOp> ops = loadTrace(tracename);
+    std::cout<< "Replaying "<<ops.size()<<" operations from "<<tracename <<std::endl;
+
+    static const struct {
+        Archives::BsaArchive::Backend backend;
+        const char *name;
+    } backends[] = {
+        { Archives::BsaArchive::Backend_Stream, "stream" },
+        { Archives::BsaArchive::Backend_PRead, "pread" },
+        { Archives::BsaArchive::Backend_MMap, "mmap" },
+    };
+    for(const auto &backend : backends)
+    {
+        long long best = -1;
+        size_t total = 0;
+        for(int i = 0;i < iterations;++i)
+        {
+            total = 0;
+            long long usecs = replayOps(ops, datadir, backend.backend, total);
+            if(best < 0 || usecs < best) best = usecs;
+        }
+        std::cout<< std::setw(8)<<backend.name<<": "<<total<<" bytes in "<<best<<" us (best of "<<iterations<<")" <<std::endl;
+    }
+    return 0;
+}
+
+
+std::string baseName(const std::string &fname)
+{
+    size_t pos = fname.find_last_of("/\\");
+    return (pos == std::string::npos) ? fname : fname.substr(pos+1);
+}
+
+bool equalNoCase(const std::string &lhs, const std::string &rhs)
+{
+    return lhs.size() == rhs.size() &&
+           std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](char a, char b) -> bool
+           { return std::toupper((unsigned char)a) == std::toupper((unsigned char)b); });
+}
+
+/* Loads the entry order for the named archive. The order file is either a VFS
+ * trace, in which case entries are ordered by when they were first opened, or
+ * a plain list with one entry name or ID per line.
+ */
+std::vector<std::string> loadOrder(const char *ordername, const std::string &archname)
+{
+    std::vector<std::string> order;
+    std::set<std::string> seen;
+
+    std::ifstream file(ordername);
+    if(!file.is_open())
+        throw std::runtime_error(std::string("Failed to open ")+ordername);
+
+    std::string line;
+    std::getline(file, line);
+    if(line.compare(0, 8, "time_us,") == 0)
+    {
+        file.close();
+        std::string base = baseName(archname);
+        for(const TraceOp &op : loadTrace(ordername))
+        {
+            if(op.mOp == "open" && equalNoCase(op.mArchive, base) && seen.insert(op.mName).second)
+                order.push_back(op.mName);
+        }
+        return order;
+    }
+
+    do {
+        size_t start = line.find_first_not_of(" \t\r");
+        if(start == std::string::npos || line[start] == '#')
+            continue;
+        size_t end = line.find_last_not_of(" \t\r");
+        std::string name = line.substr(start, end-start+1);
+        if(seen.insert(name).second)
+            order.push_back(std::move(name));
+    } while(std::getline(file, line));
+    return order;
+}
+
+void dropFileCache(const std::string &fname)
+{
+#if defined(POSIX_FADV_DONTNEED)
+    int fd = ::open(fname.c_str(), O_RDONLY);
+    if(fd < 0) return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+#endif
+}
+
+bool compareStreams(std::istream &lhs, std::istream &rhs)
+{
+    std::array<char,4096> buf1, buf2;
+    while(true)
+    {
+        lhs.read(buf1.data(), buf1.size());
+        rhs.read(buf2.data(), buf2.size());
+        if(lhs.gcount() != rhs.gcount())
+            return false;
+        if(lhs.gcount() == 0)
+            return true;
+        if(!std::equal(buf1.begin(), buf1.begin()+lhs.gcount(), buf2.begin()))
+            return false;
+    }
+}
+
+/* Checks that every entry in the original archive exists in the repacked one
+ * with identical contents, and that the repacked archive has no extras.
+ */
+size_t verifyArchive(const char *archname, const std::string &outname)
+{
+    Archives::BsaArchive orig, repacked;
+    orig.load(archname);
+    repacked.load(outname);
+
+    size_t errors = 0;
+    for(size_t id : orig.getIds())
+    {
+        Archives::IStreamPtr lhs = orig.open(id);
+        Archives::IStreamPtr rhs = repacked.open(id);
+        if(!rhs || !compareStreams(*lhs, *rhs))
+        {
+            std::cerr<< "Mismatch for ID "<<id <<std::endl;
+            ++errors;
+        }
+    }
+    for(const std::string &name : orig.list())
+    {
+        Archives::IStreamPtr lhs = orig.open(name.c_str());
+        Archives::IStreamPtr rhs = repacked.open(name.c_str());
+        if(!rhs || !compareStreams(*lhs, *rhs))
+        {
+            std::cerr<< "Mismatch for "<<name <<std::endl;
+            ++errors;
+        }
+    }
+    if(repacked.getIds().size() != orig.getIds().size() || repacked.list().size() != orig.list().size())
+    {
+        std::cerr<< "Entry count mismatch" <<std::endl;
+        ++errors;
+    }
+    return errors;
+}
+
+/* Loads the archive with a cold page cache and reads the given entries in
+ * order, returning the elapsed time in microseconds.
+ */
+long long coldLoadEntries(const std::string &archname, const std::vector<std::string> &entries, bool indexed)
+{
+    dropFileCache(archname);
+
+    auto start = std::chrono::steady_clock::now();
+    Archives::BsaArchive archive;
+    archive.load(archname, Archives::BsaArchive::Backend_PRead);
+
+    std::array<char,4096> buf;
+    for(const std::string &name : entries)
+    {
+        size_t id;
+        Archives::IStreamPtr stream = (indexed && parseId(name, id)) ?
+                                      archive.open(id) : archive.open(name.c_str());
+        if(!stream) continue;
+        while(stream->read(buf.data(), buf.size()) || stream->gcount() > 0)
+        { }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+}
+
+/* Rewrites an archive with its entries in the order given by the order file,
+ * so entries used together are stored together. Entries not mentioned follow
+ * in ID or name order.
+ */
+int packArchive(const char *archname, const std::string &outname, const char *ordername, int iterations)
+{
+    if(outname == archname)
+        throw std::runtime_error("Output would overwrite the input archive");
+
+    Archives::BsaArchive archive;
+    archive.load(archname);
+
+    bool indexed;
+    {
+        std::ifstream header(archname, std::ios::binary);
+        Misc::read_le16(header);
+        indexed = (Misc::read_le16(header) == Archives::BsaWriter::Type_Indexed);
+    }
+
+    std::vector<std::string> order;
+    if(ordername)
+        order = loadOrder(ordername, archname);
+
+    Archives::BsaWriter writer;
+    writer.open(outname, indexed ? Archives::BsaWriter::Type_Indexed : Archives::BsaWriter::Type_Named);
+
+    size_t ordered = 0, unknown = 0;
+    std::set<size_t> doneIds;
+    std::set<std::string> doneNames;
+    for(const std::string &name : order)
+    {
+        size_t id;
+        if(indexed && parseId(name, id) && archive.exists(id))
+        {
+            if(!doneIds.insert(id).second) continue;
+            writer.add(id, *archive.open(id));
+        }
+        else if(!indexed && archive.exists(name.c_str()))
+        {
+            // Keep the archive's own spelling of the name.
+            auto iter = std::find_if(archive.list().begin(), archive.list().end(),
+                [&name](const std::string &entry) -> bool { return equalNoCase(entry, name); });
+            if(!doneNames.insert(*iter).second) continue;
+            writer.add(*iter, *archive.open(iter->c_str()));
+        }
+        else
+        {
+            ++unknown;
+            continue;
+        }
+        ++ordered;
+    }
+    for(size_t id : archive.getIds())
+    {
+        if(doneIds.find(id) == doneIds.end())
+            writer.add(id, *archive.open(id));
+    }
+    for(const std::string &name : archive.list())
+    {
+        if(doneNames.find(name) == doneNames.end())
+            writer.add(name, *archive.open(name.c_str()));
+    }
+    size_t count = writer.getCount();
+    writer.close();
+
+    std::cout<< "Wrote "<<count<<" entries to "<<outname<<" ("<<ordered<<" ordered";
+    if(unknown > 0) std::cout<< ", "<<unknown<<" unknown names in order file ignored";
+    std::cout<< ")" <<std::endl;
+
+    size_t errors = verifyArchive(archname, outname);
+    if(errors > 0)
+    {
+        std::cerr<< "Verification failed with "<<errors<<" errors" <<std::endl;
+        return 1;
+    }
+    std::cout<< "Verified all entries are identical" <<std::endl;
+
+    // Time loading the profiled entries, or everything if there's no profile.
+    std::vector<std::string> entries = order;
+    if(entries.empty())
+    {
+        for(size_t id : archive.getIds())
+            entries.push_back(std::to_string(id));
+        entries.insert(entries.end(), archive.list().begin(), archive.list().end());
+    }
+#if !defined(POSIX_FADV_DONTNEED)
+    std::cout<< "Can't drop the page cache on this system, load times are warm" <<std::endl;
+#endif
+    long long best[2] = { -1, -1 };
+    for(int i = 0;i < iterations;++i)
+    {
+        long long usecs = coldLoadEntries(archname, entries, indexed);
+        if(best[0] < 0 || usecs < best[0]) best[0] = usecs;
+        usecs = coldLoadEntries(outname, entries, indexed);
+        if(best[1] < 0 || usecs < best[1]) best[1] = usecs;
+    }
+    std::cout<< "Cold load of "<<entries.size()<<" entries (best of "<<iterations<<"):" <<std::endl
+             << std::setw(10)<<"original"<<": "<<best[0]<<" us" <<std::endl
+             << std::setw(10)<<"repacked"<<": "<<best[1]<<" us" <<std::endl;
+    return 0;
+}
+
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        std::cerr<< "Usage: "<<argv[0]<<" [option]" <<std::endl
+                 << "  Available options:" <<std::endl
+                 << "    -e <archive.bsa>  - Extract files from BSA" <<std::endl
+                 << "    -b <archive.bsa>  - Benchmark opening every entry with each backend" <<std::endl
+                 << "    -l <MAPS.BSA>  - Benchmark looking up location names" <<std::endl
+                 << "    -k  - Benchmark entry lookups in synthetic archives of 1k to 64k entries" <<std::endl
+                 << "    -r <trace.csv> <data dir>  - Replay a VFS trace against each backend" <<std::endl
+                 << "    -s <output.bsa> <count> [max size]  - Generate a synthetic archive of" <<std::endl
+                 << "        RMB and RDB shaped entries for benchmarking (opendf_worldbench -blocks" <<std::endl
+                 << "        times decoding them)" <<std::endl
+                 << "    -p <archive.bsa> <output.bsa> [order file]  - Repack BSA with entries in" <<std::endl
+                 << "        the given order (a VFS trace, or one name or ID per line), then" <<std::endl
+                 << "        verify it and compare cold-cache load times" <<std::endl
+                 <<std::endl;
+        return 1;
+    }
+
+    const char *archname = nullptr;
+    char mode = 0;
+    for(int i = 1;i < argc;++i)
+    {
+        if(strcmp(argv[i], "-r") == 0)
+        {
+            if(argc-2 <= i)
+                throw std::runtime_error("Missing trace filename or data dir");
+            return replayTrace(argv[i+1], argv[i+2], 5);
+        }
+        if(strcmp(argv[i], "-s") == 0)
+        {
+            if(argc-2 <= i)
+                throw std::runtime_error("Missing output filename or entry count");
+            size_t maxsize = (argc-3 > i) ? std::stoul(argv[i+3]) : 16384;
+            return generateArchive(argv[i+1], std::stoul(argv[i+2]), std::max<size_t>(maxsize, 1));
+        }
+        if(strcmp(argv[i], "-k") == 0)
+            return sweepLookups(5);
+        if(strcmp(argv[i], "-p") == 0)
+        {
+            if(argc-2 <= i)
+                throw std::runtime_error("Missing archive or output filename");
+            return packArchive(argv[i+1], argv[i+2], (argc-3 > i) ? argv[i+3] : nullptr, 3);
+        }
+        if(strcmp(argv[i], "-e") == 0 || strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "-l") == 0)
+        {
+            if(argc-1 <= i)
+                throw std::runtime_error("Missing archive filename");
+            mode = argv[i][1];
+            archname = argv[++i];
+            break;
+        }
+        else
+            throw std::runtime_error(std::string("Invalid option: ")+argv[i]);
+    }
+
+    if(!archname)
+        throw std::runtime_error("No input specified");
+
+    if(mode == 'b')
+        return benchmarkArchive(archname, 5);
+    if(mode == 'l')
+        return benchmarkLocations(archname, 5);
+    return extractArchive(archname);
+}
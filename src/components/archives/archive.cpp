@@ -1,10 +1,54 @@
 
 #include "archive.hpp"
 
+#include <algorithm>
+
+
+namespace
+{
+
+inline unsigned char ascii_toupper(char c)
+{
+    return (c >= 'a' && c <= 'z') ? (c-'a'+'A') : c;
+}
+
+}
 
 namespace Archives
 {
 
+size_t NameHash::operator()(const std::string &name) const
+{
+    // FNV-1a
+    size_t hash = 2166136261u;
+    for(char c : name)
+    {
+        hash ^= ascii_toupper(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool NameEqual::operator()(const std::string &lhs, const std::string &rhs) const
+{
+    if(lhs.size() != rhs.size())
+        return false;
+    for(size_t i = 0;i < lhs.size();++i)
+    {
+        if(ascii_toupper(lhs[i]) != ascii_toupper(rhs[i]))
+            return false;
+    }
+    return true;
+}
+
+bool NameLess::operator()(const std::string &lhs, const std::string &rhs) const
+{
+    return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+        [](char a, char b) -> bool { return ascii_toupper(a) < ascii_toupper(b); }
+    );
+}
+
+
 ConstrainedFileStreamBuf::ConstrainedFileStreamBuf(std::unique_ptr<std::istream> file, std::streamsize start, std::streamsize end)
   : mStart(start), mEnd(end), mFile(std::move(file))
 {
@@ -79,4 +123,118 @@ ConstrainedFileStreamBuf::pos_type ConstrainedFileStreamBuf::seekpos(pos_type po
 }
 
 
+PReadStreamBuf::PReadStreamBuf(std::shared_ptr<SharedFile> file, std::streamsize start, std::streamsize end, size_t bufsize)
+  : mFile(std::move(file)), mStart(start), mEnd(end), mBufferPos(start), mBuffer(std::max<size_t>(bufsize, 1))
+{
+    setg(mBuffer.data(), mBuffer.data(), mBuffer.data());
+}
+PReadStreamBuf::~PReadStreamBuf()
+{
+}
+
+PReadStreamBuf::int_type PReadStreamBuf::underflow()
+{
+    if(gptr() == egptr())
+    {
+        mBufferPos += gptr() - eback();
+        std::streamsize toread = std::min<std::streamsize>(mEnd-mBufferPos, mBuffer.size());
+        std::streamsize got = (toread > 0) ? mFile->read(mBuffer.data(), toread, mBufferPos) : 0;
+        setg(mBuffer.data(), mBuffer.data(), mBuffer.data()+std::max<std::streamsize>(got, 0));
+    }
+    if(gptr() == egptr())
+        return traits_type::eof();
+
+    return traits_type::to_int_type(*gptr());
+}
+
+PReadStreamBuf::pos_type PReadStreamBuf::seekoff(off_type offset, std::ios_base::seekdir whence, std::ios_base::openmode mode)
+{
+    if((mode&std::ios_base::out) || !(mode&std::ios_base::in))
+        return traits_type::eof();
+
+    // new file position, relative to the start of the file
+    std::streamsize newPos;
+    switch(whence)
+    {
+        case std::ios_base::beg:
+            newPos = offset + mStart;
+            break;
+        case std::ios_base::cur:
+            newPos = offset + mBufferPos + (gptr()-eback());
+            break;
+        case std::ios_base::end:
+            newPos = offset + mEnd;
+            break;
+        default:
+            return traits_type::eof();
+    }
+
+    if(newPos < mStart || newPos > mEnd)
+        return traits_type::eof();
+
+    if(newPos >= mBufferPos && newPos <= mBufferPos+(egptr()-eback()))
+    {
+        // Target is already buffered, just move the read pointer.
+        setg(eback(), eback()+(newPos-mBufferPos), egptr());
+    }
+    else
+    {
+        // Clear read pointers so underflow() gets called on the next read attempt.
+        mBufferPos = newPos;
+        setg(mBuffer.data(), mBuffer.data(), mBuffer.data());
+    }
+
+    return newPos - mStart;
+}
+
+PReadStreamBuf::pos_type PReadStreamBuf::seekpos(pos_type pos, std::ios_base::openmode mode)
+{
+    return seekoff(pos, std::ios_base::beg, mode);
+}
+
+
+MemoryStreamBuf::MemoryStreamBuf(std::shared_ptr<const void> owner, const char *data, std::streamsize size)
+  : mOwner(std::move(owner))
+{
+    // The get area is never written to, but streambuf wants non-const pointers.
+    char *base = const_cast<char*>(data);
+    setg(base, base, base+size);
+}
+MemoryStreamBuf::~MemoryStreamBuf()
+{
+}
+
+MemoryStreamBuf::pos_type MemoryStreamBuf::seekoff(off_type offset, std::ios_base::seekdir whence, std::ios_base::openmode mode)
+{
+    if((mode&std::ios_base::out) || !(mode&std::ios_base::in))
+        return traits_type::eof();
+
+    off_type newPos;
+    switch(whence)
+    {
+        case std::ios_base::beg:
+            newPos = offset;
+            break;
+        case std::ios_base::cur:
+            newPos = offset + (gptr()-eback());
+            break;
+        case std::ios_base::end:
+            newPos = offset + (egptr()-eback());
+            break;
+        default:
+            return traits_type::eof();
+    }
+
+    if(newPos < 0 || newPos > (egptr()-eback()))
+        return traits_type::eof();
+
+    setg(eback(), eback()+newPos, egptr());
+    return newPos;
+}
+
+MemoryStreamBuf::pos_type MemoryStreamBuf::seekpos(pos_type pos, std::ios_base::openmode mode)
+{
+    return seekoff(pos, std::ios_base::beg, mode);
+}
+
 } // namespace Archives
@@ -5,32 +5,17 @@
 #include <string>
 #include <memory>
 #include <array>
+#include <vector>
 #include <set>
 
+#include "sharedfile.hpp"
+
 
 namespace Archives
 {
 
 typedef std::shared_ptr<std::istream> IStreamPtr;
 
-inline uint32_t read_le32(std::istream &stream)
-{
-    char buf[4];
-    if(!stream.read(buf, sizeof(buf)) || stream.gcount() != sizeof(buf))
-        return 0;
-    return ((uint32_t(buf[0]    )&0x000000ff) | (uint32_t(buf[1]<< 8)&0x0000ff00) |
-            (uint32_t(buf[2]<<16)&0x00ff0000) | (uint32_t(buf[3]<<24)&0xff000000));
-}
-
-inline uint16_t read_le16(std::istream &stream)
-{
-    char buf[2];
-    if(!stream.read(buf, sizeof(buf)) || stream.gcount() != sizeof(buf))
-        return 0;
-    return ((uint16_t(buf[0]   )&0x00ff) | (uint16_t(buf[1]<<8)&0xff00));
-}
-
-
 class ConstrainedFileStreamBuf : public std::streambuf {
     std::streamsize mStart, mEnd;
 
@@ -62,12 +47,90 @@ public:
 };
 
 
+/* A stream buffer for a section of a shared file, reading at absolute offsets
+ * so any number of these can use the same file handle. Seeking within the
+ * currently buffered data doesn't touch the file.
+ */
+class PReadStreamBuf : public std::streambuf {
+    std::shared_ptr<SharedFile> mFile;
+    std::streamsize mStart, mEnd;
+
+    // Absolute file offset of the start of the buffer.
+    std::streamsize mBufferPos;
+    std::vector<char> mBuffer;
+
+public:
+    PReadStreamBuf(std::shared_ptr<SharedFile> file, std::streamsize start, std::streamsize end, size_t bufsize);
+    ~PReadStreamBuf();
+
+    virtual int_type underflow();
+
+    virtual pos_type seekoff(off_type offset, std::ios_base::seekdir whence, std::ios_base::openmode mode);
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode mode);
+};
+
+class PReadStream : public std::istream {
+public:
+    PReadStream(std::shared_ptr<SharedFile> file, std::streamsize start, std::streamsize end, size_t bufsize)
+        : std::istream(new PReadStreamBuf(std::move(file), start, end, bufsize))
+    {
+    }
+
+    ~PReadStream()
+    {
+        delete rdbuf();
+    }
+};
+
+
+/* A read-only stream buffer over a contiguous block of memory. The owner
+ * reference keeps the backing storage (e.g. a file mapping) alive for as long
+ * as the stream exists, so no data is copied.
+ */
+class MemoryStreamBuf : public std::streambuf {
+    std::shared_ptr<const void> mOwner;
+
+public:
+    MemoryStreamBuf(std::shared_ptr<const void> owner, const char *data, std::streamsize size);
+    ~MemoryStreamBuf();
+
+    virtual pos_type seekoff(off_type offset, std::ios_base::seekdir whence, std::ios_base::openmode mode);
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode mode);
+};
+
+class MemoryStream : public std::istream {
+public:
+    MemoryStream(std::shared_ptr<const void> owner, const char *data, std::streamsize size)
+        : std::istream(new MemoryStreamBuf(std::move(owner), data, size))
+    {
+    }
+
+    ~MemoryStream()
+    {
+        delete rdbuf();
+    }
+};
+
+
+// Entry names are 8.3 DOS filenames, so lookups ignore case.
+struct NameHash {
+    size_t operator()(const std::string &name) const;
+};
+struct NameEqual {
+    bool operator()(const std::string &lhs, const std::string &rhs) const;
+};
+struct NameLess {
+    bool operator()(const std::string &lhs, const std::string &rhs) const;
+};
+
+
 class Archive {
 public:
     virtual ~Archive() { }
     virtual IStreamPtr open(const char *name) = 0;
     virtual bool exists(const char *name) const = 0;
     virtual const std::set<std::string> &list() const = 0;
+    virtual const std::string &getFilename() const = 0;
 };
 
 } // namespace Archives
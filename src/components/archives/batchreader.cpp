@@ -0,0 +1,175 @@
+#include "batchreader.hpp"
+
+#include <vector>
+#include <deque>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#include <errno.h>
+#endif
+
+
+namespace Archives
+{
+
+#ifdef HAVE_LIBURING
+
+BatchReader::BatchReader(unsigned depth, bool useRing) : mRing(nullptr), mDepth(depth)
+{
+    if(!useRing) return;
+
+    io_uring *ring = new io_uring;
+    // Fails on kernels without io_uring, or where it's been disabled.
+    if(io_uring_queue_init(mDepth, ring, 0) < 0)
+        delete ring;
+    else
+        mRing = ring;
+}
+
+BatchReader::~BatchReader()
+{
+    if(mRing)
+    {
+        io_uring *ring = static_cast<io_uring*>(mRing);
+        io_uring_queue_exit(ring);
+        delete ring;
+    }
+}
+
+void BatchReader::readRing(Request *requests, size_t count)
+{
+    io_uring *ring = static_cast<io_uring*>(mRing);
+
+    // Short reads get resubmitted for the remainder, until EOF.
+    std::vector<std::streamsize> done(count, 0);
+    std::deque<size_t> pending;
+    for(size_t i = 0;i < count;++i)
+        pending.push_back(i);
+
+    // Finishes a request with pread, from wherever the ring left off.
+    auto finish = [requests, &done](size_t i)
+    {
+        Request &req = requests[i];
+        std::streamsize got = req.mFile->read(req.mBuffer+done[i], req.mSize-done[i],
+                                              req.mOffset+done[i]);
+        req.mResult = (got < 0) ? -1 : (done[i]+got);
+    };
+
+    // Requests the ring failed, to retry with pread.
+    std::vector<size_t> failed;
+    // Set if the ring can't be used for reads, so no more are submitted to
+    // it. What's in flight is collected, and pread handles the rest.
+    bool broken = false;
+    unsigned inflight = 0;
+    while((!broken && !pending.empty()) || inflight > 0)
+    {
+        while(!broken && !pending.empty() && inflight < mDepth)
+        {
+            io_uring_sqe *sqe = io_uring_get_sqe(ring);
+            if(!sqe) break;
+
+            size_t i = pending.front();
+            pending.pop_front();
+
+            Request &req = requests[i];
+            io_uring_prep_read(sqe, req.mFile->mFd, req.mBuffer+done[i], req.mSize-done[i],
+                               req.mOffset+done[i]);
+            io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(i));
+            ++inflight;
+        }
+
+        int ret = io_uring_submit_and_wait(ring, 1);
+        if(ret < 0 && ret != -EINTR)
+        {
+            // Ring's gone bad.
+            while(inflight > 0)
+            {
+                io_uring_cqe *cqe = nullptr;
+                if(io_uring_wait_cqe(ring, &cqe) < 0)
+                    break;
+                size_t i = reinterpret_cast<size_t>(io_uring_cqe_get_data(cqe));
+                if(cqe->res > 0) done[i] += cqe->res;
+                pending.push_back(i);
+                io_uring_cqe_seen(ring, cqe);
+                --inflight;
+            }
+            broken = true;
+            break;
+        }
+
+        unsigned head, seen = 0;
+        io_uring_cqe *cqe;
+        io_uring_for_each_cqe(ring, head, cqe)
+        {
+            size_t i = reinterpret_cast<size_t>(io_uring_cqe_get_data(cqe));
+            int res = cqe->res;
+            ++seen;
+            --inflight;
+
+            Request &req = requests[i];
+            if(res == -EINTR || res == -EAGAIN)
+                pending.push_back(i);
+            else if(res < 0)
+            {
+                // Kernels before 5.6 don't have IORING_OP_READ, and fail it
+                // with EINVAL. Other errors may be specific to the request, so
+                // retry it with pread to get the same result as without the
+                // ring.
+                if(res == -EINVAL)
+                    broken = true;
+                failed.push_back(i);
+            }
+            else
+            {
+                done[i] += res;
+                if(res > 0 && done[i] < req.mSize)
+                    pending.push_back(i);
+                else
+                    req.mResult = done[i];
+            }
+        }
+        io_uring_cq_advance(ring, seen);
+    }
+
+    for(size_t i : failed)
+        finish(i);
+    for(size_t i : pending)
+        finish(i);
+
+    if(broken)
+    {
+        io_uring_queue_exit(ring);
+        delete ring;
+        mRing = nullptr;
+    }
+}
+
+#else
+
+BatchReader::BatchReader(unsigned depth, bool useRing) : mRing(nullptr), mDepth(depth)
+{
+}
+
+BatchReader::~BatchReader()
+{
+}
+
+void BatchReader::readRing(Request *requests, size_t count)
+{
+}
+
+#endif
+
+void BatchReader::read(Request *requests, size_t count)
+{
+    if(mRing)
+        return readRing(requests, count);
+
+    for(size_t i = 0;i < count;++i)
+    {
+        Request &req = requests[i];
+        req.mResult = req.mFile->read(req.mBuffer, req.mSize, req.mOffset);
+    }
+}
+
+} // namespace Archives
@@ -0,0 +1,56 @@
+#ifndef COMPONENTS_ARCHIVES_BATCHREADER_HPP
+#define COMPONENTS_ARCHIVES_BATCHREADER_HPP
+
+#include <iostream>
+#include <cstddef>
+
+#include "sharedfile.hpp"
+
+
+namespace Archives
+{
+
+/* Reads a batch of file ranges into caller-provided buffers in one go. On
+ * Linux with liburing, the reads are submitted together through io_uring and
+ * complete in whatever order the kernel gets to them. Otherwise, or if
+ * io_uring can't be set up or doesn't support reads, they're done one at a
+ * time with pread. Reads the ring fails are retried with pread.
+ *
+ * Not thread-safe; each thread should use its own reader.
+ */
+class BatchReader {
+public:
+    struct Request {
+        const SharedFile *mFile;
+        std::streamsize mOffset;
+        std::streamsize mSize;
+        char *mBuffer;
+        // Set to the number of bytes read (less than mSize at the end of the
+        // file), or -1 on error.
+        std::streamsize mResult;
+    };
+
+private:
+    // struct io_uring, if in use.
+    void *mRing;
+    unsigned mDepth;
+
+    BatchReader(const BatchReader&) = delete;
+    BatchReader& operator=(const BatchReader&) = delete;
+
+    void readRing(Request *requests, size_t count);
+
+public:
+    /* Sets up a reader keeping up to depth reads in flight. If useRing is
+     * false, pread is always used. */
+    explicit BatchReader(unsigned depth=64, bool useRing=true);
+    ~BatchReader();
+
+    bool isUsingRing() const { return mRing != nullptr; }
+
+    void read(Request *requests, size_t count);
+};
+
+} // namespace Archives
+
+#endif /* COMPONENTS_ARCHIVES_BATCHREADER_HPP */
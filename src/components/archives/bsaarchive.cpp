@@ -4,6 +4,8 @@
 #include <sstream>
 #include <fstream>
 
+#include "misc/binaryreader.hpp"
+
 
 namespace Archives
 {
@@ -18,27 +20,28 @@ void BsaArchive::loadIndexed(size_t count, std::istream &stream)
         throw std::runtime_error("Failed to seek to archive footer ("+std::to_string(count)+" entries)");
     for(size_t i = 0;i < count;++i)
     {
-        idxs.push_back(read_le32(stream));
+        idxs.push_back(Misc::read_le32(stream));
         Entry entry;
         entry.mStart = ((i == 0) ? base : entries[i-1].mEnd);
-        entry.mEnd = entry.mStart + read_le32(stream);
+        entry.mEnd = entry.mStart + Misc::read_le32(stream);
         entries.push_back(entry);
     }
     if(!stream.good())
         throw std::runtime_error("Failed reading archive footer");
+    mDataEnd = (count > 0) ? entries.back().mEnd : base;
 
-    for(size_t id : idxs)
+    mIdIndex.reserve(count);
+    for(size_t i = 0;i < count;++i)
     {
-        if(!mLookupId.insert(id).second)
+        if(!mLookupId.insert(idxs[i]).second)
         {
 #if 0
-            std::cerr<< "Duplicate entry ID "<<std::to_string(id)<<" in "+mFilename <<std::endl;
+            std::cerr<< "Duplicate entry ID "<<std::to_string(idxs[i])<<" in "+mFilename <<std::endl;
 #endif
         }
+        // Later duplicates override earlier ones.
+        mIdIndex[idxs[i]] = entries[i];
     }
-    mEntries.resize(mLookupId.size());
-    for(size_t i = 0;i < count;++i)
-        mEntries[std::distance(mLookupId.begin(), mLookupId.find(idxs[i]))] = entries[i];
 }
 
 void BsaArchive::loadNamed(size_t count, std::istream& stream)
@@ -56,40 +59,44 @@ void BsaArchive::loadNamed(size_t count, std::istream& stream)
         name.back() = '\0'; // Ensure null termination
         names.push_back(std::string(name.data()));
 
-        int iscompressed = read_le16(stream);
+        int iscompressed = Misc::read_le16(stream);
         if(iscompressed != 0)
             throw std::runtime_error("Compressed entries not supported");
 
         Entry entry;
         entry.mStart = ((i == 0) ? base : entries[i-1].mEnd);
-        entry.mEnd = entry.mStart + read_le32(stream);
+        entry.mEnd = entry.mStart + Misc::read_le32(stream);
         entries.push_back(entry);
     }
     if(!stream.good())
         throw std::runtime_error("Failed reading archive footer");
+    mDataEnd = (count > 0) ? entries.back().mEnd : base;
 
-    for(const std::string &name : names)
+    mNameIndex.reserve(count);
+    for(size_t i = 0;i < count;++i)
     {
-        if(!mLookupName.insert(name).second)
-            throw std::runtime_error("Duplicate entry name \""+name+"\" in "+mFilename);
+        if(!mNameIndex.insert(std::make_pair(names[i], entries[i])).second)
+            throw std::runtime_error("Duplicate entry name \""+names[i]+"\" in "+mFilename);
+        mLookupName.insert(std::move(names[i]));
     }
-    mEntries.resize(mLookupName.size());
-    for(size_t i = 0;i < count;++i)
-        mEntries[std::distance(mLookupName.begin(), mLookupName.find(names[i]))] = entries[i];
 }
 
-void BsaArchive::load(const std::string &fname)
+void BsaArchive::load(const std::string &fname, Backend backend)
 {
     mFilename = fname;
+    mDataEnd = 0;
+    mBackend = Backend_Stream;
+    mMapping = nullptr;
+    mFile = nullptr;
+    dropResident();
 
     std::ifstream stream(mFilename.c_str(), std::ios::binary);
     if(!stream.is_open())
         throw std::runtime_error("Failed to open "+mFilename);
 
-    size_t count = read_le16(stream);
-    int type = read_le16(stream);
+    size_t count = Misc::read_le16(stream);
+    int type = Misc::read_le16(stream);
 
-    mEntries.reserve(count);
     if(type == 0x0100)
         loadNamed(count, stream);
     else if(type == 0x0200)
@@ -100,10 +107,67 @@ void BsaArchive::load(const std::string &fname)
         sstr<< "Unhandled BSA type: 0x"<<std::hex<<type;
         throw std::runtime_error(sstr.str());
     }
+
+    if(backend == Backend_MMap)
+    {
+        mMapping = MappedFile::open(mFilename);
+        // Truncated archive? Let the stream backend deal with it.
+        if(mMapping && mDataEnd > (std::streamsize)mMapping->size())
+            mMapping = nullptr;
+        if(mMapping)
+            mBackend = Backend_MMap;
+        else
+            backend = Backend_PRead;
+    }
+    if(backend == Backend_PRead)
+    {
+        mFile = SharedFile::open(mFilename);
+        if(mFile)
+            mBackend = Backend_PRead;
+    }
+}
+
+size_t BsaArchive::loadResident()
+{
+    std::shared_ptr<const std::vector<char>> resident = std::atomic_load(&mResident);
+    if(resident) return resident->size();
+
+    std::ifstream stream(mFilename.c_str(), std::ios::binary);
+    if(!stream.is_open())
+        throw std::runtime_error("Failed to open "+mFilename);
+
+    std::shared_ptr<std::vector<char>> data = std::make_shared<std::vector<char>>(mDataEnd);
+    if(!stream.read(data->data(), data->size()))
+        throw std::runtime_error("Failed to read "+mFilename);
+
+    std::atomic_store(&mResident, std::shared_ptr<const std::vector<char>>(std::move(data)));
+    return mDataEnd;
+}
+
+void BsaArchive::dropResident()
+{
+    std::atomic_store(&mResident, std::shared_ptr<const std::vector<char>>());
+}
+
+size_t BsaArchive::getResidentSize() const
+{
+    std::shared_ptr<const std::vector<char>> resident = std::atomic_load(&mResident);
+    return resident ? resident->size() : 0;
 }
 
 IStreamPtr BsaArchive::open(const Entry &entry)
 {
+    std::shared_ptr<const std::vector<char>> resident = std::atomic_load(&mResident);
+    if(resident)
+        return IStreamPtr(new MemoryStream(resident, resident->data()+entry.mStart,
+                                           entry.mEnd-entry.mStart));
+
+    if(mBackend == Backend_MMap)
+        return IStreamPtr(new MemoryStream(mMapping, mMapping->data()+entry.mStart,
+                                           entry.mEnd-entry.mStart));
+    if(mBackend == Backend_PRead)
+        return IStreamPtr(new PReadStream(mFile, entry.mStart, entry.mEnd, mBufferSize));
+
     std::unique_ptr<std::istream> stream(new std::ifstream(mFilename.c_str(), std::ios::binary));
     if(!stream->seekg(entry.mStart))
         return IStreamPtr(nullptr);
@@ -112,23 +176,71 @@ IStreamPtr BsaArchive::open(const Entry &entry)
 
 IStreamPtr BsaArchive::open(const char *name)
 {
-    auto iter = mLookupName.find(name);
-    if(iter == mLookupName.end())
+    auto iter = mNameIndex.find(name);
+    if(iter == mNameIndex.end())
         return IStreamPtr(nullptr);
-    return open(mEntries[std::distance(mLookupName.begin(), iter)]);
+    return open(iter->second);
 }
 
 IStreamPtr BsaArchive::open(size_t id)
 {
-    auto iter = mLookupId.find(id);
-    if(iter == mLookupId.end())
+    auto iter = mIdIndex.find(id);
+    if(iter == mIdIndex.end())
         return IStreamPtr(nullptr);
-    return open(mEntries[std::distance(mLookupId.begin(), iter)]);
+    return open(iter->second);
+}
+
+bool BsaArchive::getEntryRange(const char *name, std::streamsize &offset, std::streamsize &size) const
+{
+    auto iter = mNameIndex.find(name);
+    if(iter == mNameIndex.end())
+        return false;
+    offset = iter->second.mStart;
+    size = iter->second.mEnd - iter->second.mStart;
+    return true;
+}
+
+bool BsaArchive::getEntryRange(size_t id, std::streamsize &offset, std::streamsize &size) const
+{
+    auto iter = mIdIndex.find(id);
+    if(iter == mIdIndex.end())
+        return false;
+    offset = iter->second.mStart;
+    size = iter->second.mEnd - iter->second.mStart;
+    return true;
+}
+
+bool BsaArchive::getEntryData(const char *name, std::shared_ptr<const void> &owner, const char *&data, size_t &size) const
+{
+    auto iter = mNameIndex.find(name);
+    if(iter == mNameIndex.end())
+        return false;
+
+    std::shared_ptr<const std::vector<char>> resident = std::atomic_load(&mResident);
+    if(resident)
+    {
+        owner = resident;
+        data = resident->data() + iter->second.mStart;
+    }
+    else if(mMapping)
+    {
+        owner = mMapping;
+        data = mMapping->data() + iter->second.mStart;
+    }
+    else
+        return false;
+    size = iter->second.mEnd - iter->second.mStart;
+    return true;
 }
 
 bool BsaArchive::exists(const char *name) const
 {
-    return (mLookupName.find(name) != mLookupName.end());
+    return (mNameIndex.find(name) != mNameIndex.end());
+}
+
+bool BsaArchive::exists(size_t id) const
+{
+    return (mIdIndex.find(id) != mIdIndex.end());
 }
 
 } // namespace Archives
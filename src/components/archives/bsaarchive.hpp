@@ -5,24 +5,51 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <unordered_map>
 
 #include "archive.hpp"
+#include "mappedfile.hpp"
 
 
 namespace Archives
 {
 
 class BsaArchive : public Archive {
-    std::set<std::string> mLookupName;
-    std::set<size_t> mLookupId;
+public:
+    enum Backend {
+        // Each opened entry gets its own file handle and buffer.
+        Backend_Stream,
+        // Opened entries share one file handle, each reading into its own
+        // buffer at absolute offsets.
+        Backend_PRead,
+        // The archive is mapped into memory once, and opened entries read
+        // directly from the mapping.
+        Backend_MMap
+    };
 
+private:
     struct Entry {
         std::streamsize mStart;
         std::streamsize mEnd;
     };
-    std::vector<Entry> mEntries;
+
+    // The sets are only kept for listing, lookups go through the indices.
+    std::set<std::string> mLookupName;
+    std::set<size_t> mLookupId;
+    std::unordered_map<std::string,Entry,NameHash,NameEqual> mNameIndex;
+    std::unordered_map<size_t,Entry> mIdIndex;
 
     std::string mFilename;
+    std::streamsize mDataEnd;
+
+    Backend mBackend;
+    std::shared_ptr<MappedFile> mMapping;
+    std::shared_ptr<SharedFile> mFile;
+    size_t mBufferSize;
+
+    // Set when the whole archive is held in memory. Swapped atomically since
+    // it can be loaded while entries are being opened.
+    std::shared_ptr<const std::vector<char>> mResident;
 
     void loadIndexed(size_t count, std::istream &stream);
     void loadNamed(size_t count, std::istream &stream);
@@ -30,16 +57,55 @@ class BsaArchive : public Archive {
     IStreamPtr open(const Entry &entry);
 
 public:
-    void load(const std::string &fname);
+    BsaArchive() : mDataEnd(0), mBackend(Backend_Stream), mBufferSize(4096) { }
+
+    /* Loads the archive's entry list. If the requested backend is unavailable
+     * (e.g. the file can't be mapped), it falls back to Backend_PRead, then
+     * Backend_Stream.
+     */
+    void load(const std::string &fname, Backend backend=Backend_MMap);
+
+    Backend getBackend() const { return mBackend; }
+
+    /* Sets the buffer size for subsequently opened Backend_PRead streams.
+     * Smaller buffers waste less on seek-heavy parsing, larger ones need
+     * fewer reads for sequential access. */
+    void setBufferSize(size_t size) { mBufferSize = size; }
+    size_t getBufferSize() const { return mBufferSize; }
+
+    /* Reads the whole archive into memory. Entries opened afterward read from
+     * memory regardless of the backend. Returns the number of bytes held.
+     */
+    size_t loadResident();
+    void dropResident();
+    size_t getResidentSize() const;
+
+    /* Gets where the entry's data is in the archive file, for reading it
+     * directly (e.g. with a BatchReader). Returns false if it doesn't exist.
+     */
+    bool getEntryRange(const char *name, std::streamsize &offset, std::streamsize &size) const;
+    bool getEntryRange(size_t id, std::streamsize &offset, std::streamsize &size) const;
+
+    /* Gets the entry's data where it's already in memory (the archive is
+     * resident or mapped), without copying it. The owner keeps the data
+     * valid. Returns false if it doesn't exist or isn't in memory.
+     */
+    bool getEntryData(const char *name, std::shared_ptr<const void> &owner, const char *&data, size_t &size) const;
+
+    // Size of the archive up to the end of the entry data.
+    std::streamsize getDataSize() const { return mDataEnd; }
 
     virtual IStreamPtr open(const char *name);
     IStreamPtr open(size_t id);
 
     virtual bool exists(const char *name) const;
+    bool exists(size_t id) const;
 
     virtual const std::set<std::string> &list() const final { return mLookupName; };
 
     const std::set<size_t> &getIds() const { return mLookupId; };
+
+    virtual const std::string &getFilename() const final { return mFilename; }
 };
 
 } // namespace Archives
@@ -0,0 +1,125 @@
+#include "bsawriter.hpp"
+
+#include <stdexcept>
+#include <cstdio>
+#include <array>
+
+
+namespace
+{
+
+void write_le32(std::ostream &stream, uint32_t val)
+{
+    char buf[4] = { char(val), char(val>>8), char(val>>16), char(val>>24) };
+    stream.write(buf, sizeof(buf));
+}
+
+void write_le16(std::ostream &stream, uint16_t val)
+{
+    char buf[2] = { char(val), char(val>>8) };
+    stream.write(buf, sizeof(buf));
+}
+
+}
+
+namespace Archives
+{
+
+BsaWriter::~BsaWriter()
+{
+    if(mStream.is_open())
+    {
+        // Don't leave a valid-looking archive with a bad footer behind.
+        mStream.close();
+        std::remove(mFilename.c_str());
+    }
+}
+
+void BsaWriter::open(const std::string &fname, Type type)
+{
+    mFilename = fname;
+    mType = type;
+    mEntries.clear();
+
+    mStream.open(mFilename.c_str(), std::ios::binary | std::ios::trunc);
+    if(!mStream.is_open())
+        throw std::runtime_error("Failed to create "+mFilename);
+
+    // Entry count is filled in on close.
+    write_le16(mStream, 0);
+    write_le16(mStream, mType);
+}
+
+void BsaWriter::close()
+{
+    if(mEntries.size() > 0xffff)
+        throw std::runtime_error("Too many entries for "+mFilename+" ("+std::to_string(mEntries.size())+")");
+
+    for(const Entry &entry : mEntries)
+    {
+        if(mType == Type_Named)
+        {
+            std::array<char,12> name{};
+            std::copy(entry.mName.begin(), entry.mName.end(), name.begin());
+            mStream.write(name.data(), name.size());
+            write_le16(mStream, 0); // Not compressed
+            write_le32(mStream, entry.mSize);
+        }
+        else
+        {
+            write_le32(mStream, entry.mId);
+            write_le32(mStream, entry.mSize);
+        }
+    }
+
+    mStream.seekp(0);
+    write_le16(mStream, mEntries.size());
+    mStream.close();
+    if(mStream.fail())
+        throw std::runtime_error("Failed writing "+mFilename);
+}
+
+uint32_t BsaWriter::copyData(std::istream &data)
+{
+    uint64_t total = 0;
+    std::array<char,4096> buf;
+    while(data.read(buf.data(), buf.size()) || data.gcount() > 0)
+    {
+        mStream.write(buf.data(), data.gcount());
+        total += data.gcount();
+    }
+    if(!mStream.good())
+        throw std::runtime_error("Failed writing "+mFilename);
+    if(total > 0xffffffff)
+        throw std::runtime_error("Entry too large for "+mFilename);
+    return total;
+}
+
+void BsaWriter::add(const std::string &name, std::istream &data)
+{
+    if(mType != Type_Named)
+        throw std::runtime_error("Adding named entry \""+name+"\" to indexed archive "+mFilename);
+    if(name.empty() || name.size() > 12)
+        throw std::runtime_error("Invalid entry name \""+name+"\" for "+mFilename);
+
+    Entry entry;
+    entry.mName = name;
+    entry.mId = 0;
+    entry.mSize = copyData(data);
+    mEntries.push_back(std::move(entry));
+}
+
+void BsaWriter::add(size_t id, std::istream &data)
+{
+    if(mType != Type_Indexed)
+        throw std::runtime_error("Adding entry ID "+std::to_string(id)+" to named archive "+mFilename);
+    if(id > 0xffffffff)
+        throw std::runtime_error("Invalid entry ID "+std::to_string(id)+" for "+mFilename);
+
+    Entry entry;
+    entry.mId = id;
+    entry.mSize = copyData(data);
+    mEntries.push_back(std::move(entry));
+}
+
+} // namespace Archives
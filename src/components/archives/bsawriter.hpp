@@ -0,0 +1,57 @@
+#ifndef COMPONENTS_ARCHIVES_BSAWRITER_HPP
+#define COMPONENTS_ARCHIVES_BSAWRITER_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+namespace Archives
+{
+
+/* Writes a Daggerfall BSA archive. Entry data is copied to the output as it's
+ * added, and appears in the archive in the order it was added. The footer and
+ * entry count are written on close.
+ */
+class BsaWriter {
+public:
+    enum Type {
+        Type_Named = 0x0100,
+        Type_Indexed = 0x0200
+    };
+
+private:
+    struct Entry {
+        std::string mName;
+        size_t mId;
+        uint32_t mSize;
+    };
+
+    std::ofstream mStream;
+    std::string mFilename;
+    Type mType;
+
+    std::vector<Entry> mEntries;
+
+    uint32_t copyData(std::istream &data);
+
+public:
+    BsaWriter() : mType(Type_Named) { }
+    ~BsaWriter();
+
+    void open(const std::string &fname, Type type);
+    void close();
+
+    // Named archives only. Names are limited to 12 characters.
+    void add(const std::string &name, std::istream &data);
+    // Indexed archives only.
+    void add(size_t id, std::istream &data);
+
+    size_t getCount() const { return mEntries.size(); }
+};
+
+} // namespace Archives
+
+#endif /* COMPONENTS_ARCHIVES_BSAWRITER_HPP */
@@ -0,0 +1,93 @@
+
+#include "mappedfile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+namespace Archives
+{
+
+MappedFile::MappedFile()
+  : mData(nullptr), mSize(0)
+#ifdef _WIN32
+  , mFile(INVALID_HANDLE_VALUE), mMapping(nullptr)
+#endif
+{
+}
+
+#ifdef _WIN32
+
+MappedFile::~MappedFile()
+{
+    if(mData) UnmapViewOfFile(mData);
+    if(mMapping) CloseHandle(mMapping);
+    if(mFile != INVALID_HANDLE_VALUE) CloseHandle(mFile);
+}
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string &fname)
+{
+    std::shared_ptr<MappedFile> file(new MappedFile());
+
+    file->mFile = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file->mFile == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file->mFile, &size) || size.QuadPart <= 0)
+        return nullptr;
+
+    file->mMapping = CreateFileMappingA(file->mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(!file->mMapping)
+        return nullptr;
+
+    file->mData = static_cast<const char*>(MapViewOfFile(file->mMapping, FILE_MAP_READ, 0, 0, 0));
+    if(!file->mData)
+        return nullptr;
+    file->mSize = size.QuadPart;
+
+    return file;
+}
+
+#else
+
+MappedFile::~MappedFile()
+{
+    if(mData) munmap(const_cast<char*>(mData), mSize);
+}
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string &fname)
+{
+    int fd = ::open(fname.c_str(), O_RDONLY);
+    if(fd < 0) return nullptr;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping holds its own reference to the file.
+    close(fd);
+    if(ptr == MAP_FAILED)
+        return nullptr;
+
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    file->mData = static_cast<const char*>(ptr);
+    file->mSize = st.st_size;
+    return file;
+}
+
+#endif
+
+} // namespace Archives
@@ -0,0 +1,40 @@
+#ifndef COMPONENTS_ARCHIVES_MAPPEDFILE_HPP
+#define COMPONENTS_ARCHIVES_MAPPEDFILE_HPP
+
+#include <string>
+#include <memory>
+
+
+namespace Archives
+{
+
+/* A read-only memory mapping of a whole file. Instances are handed out as
+ * shared pointers so streams created over the mapped region can keep it alive
+ * independently of the archive that created them.
+ */
+class MappedFile {
+    const char *mData;
+    size_t mSize;
+#ifdef _WIN32
+    void *mFile;
+    void *mMapping;
+#endif
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile();
+
+public:
+    ~MappedFile();
+
+    // Returns null if the file could not be opened or mapped.
+    static std::shared_ptr<MappedFile> open(const std::string &fname);
+
+    const char *data() const { return mData; }
+    size_t size() const { return mSize; }
+};
+
+} // namespace Archives
+
+#endif /* COMPONENTS_ARCHIVES_MAPPEDFILE_HPP */
@@ -0,0 +1,110 @@
+
+#include "sharedfile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+
+namespace Archives
+{
+
+#ifdef _WIN32
+
+SharedFile::SharedFile() : mHandle(INVALID_HANDLE_VALUE)
+{
+}
+
+SharedFile::~SharedFile()
+{
+    if(mHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(mHandle);
+}
+
+std::shared_ptr<SharedFile> SharedFile::open(const std::string &fname)
+{
+    std::shared_ptr<SharedFile> file(new SharedFile());
+    file->mHandle = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file->mHandle == INVALID_HANDLE_VALUE)
+        return nullptr;
+    return file;
+}
+
+std::streamsize SharedFile::read(char *buf, std::streamsize size, std::streamsize offset) const
+{
+    // With a synchronous handle, an OVERLAPPED offset still reads in place
+    // but doesn't rely on the handle's file pointer.
+    OVERLAPPED ov{};
+    ov.Offset = static_cast<DWORD>(offset&0xffffffff);
+    ov.OffsetHigh = static_cast<DWORD>(uint64_t(offset)>>32);
+    DWORD got = 0;
+    if(!ReadFile(mHandle, buf, static_cast<DWORD>(size), &got, &ov))
+        return (GetLastError() == ERROR_HANDLE_EOF) ? 0 : -1;
+    return got;
+}
+
+std::streamsize SharedFile::size() const
+{
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(mHandle, &size))
+        return -1;
+    return size.QuadPart;
+}
+
+#else
+
+SharedFile::SharedFile() : mFd(-1)
+{
+}
+
+SharedFile::~SharedFile()
+{
+    if(mFd >= 0)
+        close(mFd);
+}
+
+std::shared_ptr<SharedFile> SharedFile::open(const std::string &fname)
+{
+    std::shared_ptr<SharedFile> file(new SharedFile());
+    file->mFd = ::open(fname.c_str(), O_RDONLY);
+    if(file->mFd < 0)
+        return nullptr;
+    return file;
+}
+
+std::streamsize SharedFile::read(char *buf, std::streamsize size, std::streamsize offset) const
+{
+    std::streamsize total = 0;
+    while(total < size)
+    {
+        ssize_t got = pread(mFd, buf+total, size-total, offset+total);
+        if(got < 0)
+        {
+            if(errno == EINTR) continue;
+            return (total > 0) ? total : -1;
+        }
+        if(got == 0) break;
+        total += got;
+    }
+    return total;
+}
+
+std::streamsize SharedFile::size() const
+{
+    struct stat st;
+    if(fstat(mFd, &st) != 0)
+        return -1;
+    return st.st_size;
+}
+
+#endif
+
+} // namespace Archives
@@ -0,0 +1,46 @@
+#ifndef COMPONENTS_ARCHIVES_SHAREDFILE_HPP
+#define COMPONENTS_ARCHIVES_SHAREDFILE_HPP
+
+#include <string>
+#include <memory>
+#include <cstdint>
+
+
+namespace Archives
+{
+
+/* A read-only file handle that can be shared between multiple streams. Reads
+ * are done at absolute offsets, so there is no file position shared between
+ * the users.
+ */
+class SharedFile {
+#ifdef _WIN32
+    void *mHandle;
+#else
+    int mFd;
+#endif
+
+    SharedFile(const SharedFile&) = delete;
+    SharedFile& operator=(const SharedFile&) = delete;
+
+    SharedFile();
+
+    friend class BatchReader;
+
+public:
+    ~SharedFile();
+
+    // Returns null if the file could not be opened.
+    static std::shared_ptr<SharedFile> open(const std::string &fname);
+
+    /* Reads up to size bytes at the given offset, returning the number of
+     * bytes read, or -1 on error. */
+    std::streamsize read(char *buf, std::streamsize size, std::streamsize offset) const;
+
+    // Returns the file size, or -1 on error.
+    std::streamsize size() const;
+};
+
+} // namespace Archives
+
+#endif /* COMPONENTS_ARCHIVES_SHAREDFILE_HPP */
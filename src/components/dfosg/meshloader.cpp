@@ -9,6 +9,8 @@
 #include <osg/Texture>
 #include <osg/AlphaFunc>
 
+#include "misc/binaryreader.hpp"
+
 #include "components/vfs/manager.hpp"
 #include "components/resource/texturemanager.hpp"
 
@@ -26,48 +28,46 @@ const uint32_t VER_2_5 = ('v' | ('2'<<8) | ('.'<<16) | ('5'<<24));
 namespace DFOSG
 {
 
-void MdlHeader::load(std::istream& stream)
+void MdlHeader::load(Misc::BinaryReader &reader)
 {
-    mVersion = VFS::read_le32(stream);
+    mVersion = reader.read32();
 
-    mPointCount = VFS::read_le32(stream);
-    mPlaneCount = VFS::read_le32(stream);
-    mRadius = VFS::read_le32(stream);
+    mPointCount = reader.read32();
+    mPlaneCount = reader.read32();
+    mRadius = reader.read32();
 
-    mNullValue1[0] = VFS::read_le32(stream);
-    mNullValue1[1] = VFS::read_le32(stream);
+    reader.read32(mNullValue1, 2);
 
-    mPlaneDataOffset = VFS::read_le32(stream);
-    mObjectDataOffset = VFS::read_le32(stream);
-    mObjectDataCount = VFS::read_le32(stream);
+    mPlaneDataOffset = reader.read32();
+    mObjectDataOffset = reader.read32();
+    mObjectDataCount = reader.read32();
 
-    mUnknown1 = VFS::read_le32(stream);
+    mUnknown1 = reader.read32();
 
-    mNullValue2[0] = VFS::read_le32(stream);
-    mNullValue2[1] = VFS::read_le32(stream);
+    reader.read32(mNullValue2, 2);
 
-    mPointListOffset = VFS::read_le32(stream);
-    mNormalListOffset = VFS::read_le32(stream);
+    mPointListOffset = reader.read32();
+    mNormalListOffset = reader.read32();
 
-    mUnknown2 = VFS::read_le32(stream);
+    mUnknown2 = reader.read32();
 
-    mPlaneListOffset = VFS::read_le32(stream);
+    mPlaneListOffset = reader.read32();
 }
 
 
-void MdlPoint::load(std::istream& stream)
+void MdlPoint::load(Misc::BinaryReader &reader)
 {
-    mX = VFS::read_le32(stream);
-    mY = VFS::read_le32(stream);
-    mZ = VFS::read_le32(stream);
+    mX = reader.read32();
+    mY = reader.read32();
+    mZ = reader.read32();
 }
 
 
-void MdlPlanePoint::load(std::istream& stream, uint32_t offset_scale)
+void MdlPlanePoint::load(Misc::BinaryReader &reader, uint32_t offset_scale)
 {
-    uint32_t offset = VFS::read_le32(stream);
-    int u = (int16_t)VFS::read_le16(stream);
-    int v = (int16_t)VFS::read_le16(stream);
+    uint32_t offset = reader.read32();
+    int u = (int16_t)reader.read16();
+    int v = (int16_t)reader.read16();
 
     /* WTF is this. Using the read values as they are works for most meshes,
      * but a few go wrong. UESP's note about only using the lower 12 bits (and
@@ -96,21 +96,21 @@ void MdlPlanePoint::load(std::istream& stream, uint32_t offset_scale)
 }
 
 
-void MdlPlane::load(std::istream& stream, uint32_t offset_scale)
+void MdlPlane::load(Misc::BinaryReader &reader, uint32_t offset_scale)
 {
-    mPointCount = stream.get();
-    mUnknown1 = stream.get();
-    mTextureId = VFS::read_le16(stream);
-    mUnknown2 = VFS::read_le32(stream);
+    mPointCount = reader.read8();
+    mUnknown1 = reader.read8();
+    mTextureId = reader.read16();
+    mUnknown2 = reader.read32();
 
     mPoints.resize(mPointCount);
     for(MdlPlanePoint &pt : mPoints)
-        pt.load(stream, offset_scale);
+        pt.load(reader, offset_scale);
 }
 
-void MdlPlane::loadNormal(std::istream& stream)
+void MdlPlane::loadNormal(Misc::BinaryReader &reader)
 {
-    mNormal.load(stream);
+    mNormal.load(reader);
 }
 
 void MdlPlane::fixUVs(const std::vector<MdlPoint> &points)
@@ -210,34 +210,28 @@ void MdlPlane::fixUVs(const std::vector<MdlPoint> &points)
 }
 
 
-void Mesh::load(std::istream &stream)
+void Mesh::load(Misc::BinaryReader &reader)
 {
-    mHeader.load(stream);
+    mHeader.load(reader);
 
     mPoints.resize(mHeader.getPointCount());
     mPlanes.resize(mHeader.getPlaneCount());
 
     // points
-    if(!stream.seekg(mHeader.getPointListOffset()))
-        throw std::runtime_error("Failed to seek to point list");
-
+    reader.seek(mHeader.getPointListOffset());
     for(MdlPoint &pt : mPoints)
-        pt.load(stream);
+        pt.load(reader);
 
     // planes
-    if(!stream.seekg(mHeader.getPlaneListOffset()))
-        throw std::runtime_error("Failed to seek to plane list");
-
+    reader.seek(mHeader.getPlaneListOffset());
     uint32_t offset_scale = (mHeader.getVersion() != VER_2_5) ? (4*3) : 4;
     for(MdlPlane &plane : mPlanes)
-        plane.load(stream, offset_scale);
+        plane.load(reader, offset_scale);
 
     // normals
-    if(!stream.seekg(mHeader.getNormalListOffset()))
-        throw std::runtime_error("Failed to seek to normal list");
-
+    reader.seek(mHeader.getNormalListOffset());
     for(MdlPlane &plane : mPlanes)
-        plane.loadNormal(stream);
+        plane.loadNormal(reader);
 
     // Fix UV coords, converting from delta to absolute values and generate the
     // missing coords. Also calculates the binormals.
@@ -263,11 +257,12 @@ MeshLoader::MeshLoader()
 
 Mesh *MeshLoader::load(size_t id)
 {
-    VFS::IStreamPtr stream = VFS::Manager::get().openArchId(id);
-    if(!stream) throw std::runtime_error("Failed to open ARCH3D ID "+std::to_string(id));
+    VFS::DataPtr data = VFS::Manager::get().readArchId(id);
+    if(!data) throw std::runtime_error("Failed to open ARCH3D ID "+std::to_string(id));
 
+    Misc::BinaryReader reader(*data);
     std::unique_ptr<Mesh> mesh(new Mesh());
-    mesh->load(*stream);
+    mesh->load(reader);
 
     return mesh.release();
 }
@@ -12,6 +12,11 @@ namespace osg
     class Node;
 }
 
+namespace Misc
+{
+    class BinaryReader;
+}
+
 namespace DFOSG
 {
 
@@ -40,7 +45,7 @@ class MdlHeader {
     uint32_t mPlaneListOffset;
 
 public:
-    void load(std::istream &stream);
+    void load(Misc::BinaryReader &reader);
 
     uint32_t getVersion() const { return mVersion; }
 
@@ -56,7 +61,7 @@ class MdlPoint {
     int32_t mX, mY, mZ;
 
 public:
-    void load(std::istream &stream);
+    void load(Misc::BinaryReader &reader);
     void set(int32_t x, int32_t y, int32_t z)
     {
         mX = x;
@@ -75,7 +80,7 @@ class MdlPlanePoint {
     float mV;
 
 public:
-    void load(std::istream &stream, uint32_t offset_scale);
+    void load(Misc::BinaryReader &reader, uint32_t offset_scale);
 
     int32_t getIndex() const { return mIndex; }
     float& u() { return mU; }
@@ -97,9 +102,9 @@ class MdlPlane {
     MdlPoint mBinormal;
 
 public:
-    void load(std::istream &stream, uint32_t offset_scale);
+    void load(Misc::BinaryReader &reader, uint32_t offset_scale);
 
-    void loadNormal(std::istream &stream);
+    void loadNormal(Misc::BinaryReader &reader);
 
     void fixUVs(const std::vector<MdlPoint> &points);
 
@@ -115,7 +120,7 @@ class Mesh {
     std::vector<MdlPlane> mPlanes;
 
 public:
-    void load(std::istream &stream);
+    void load(Misc::BinaryReader &reader);
 
     const MdlHeader &getHeader() const { return mHeader; }
     const std::vector<MdlPoint> &getPoints() const { return mPoints; }
@@ -4,9 +4,12 @@
 #include <vector>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
 
 #include <osg/Image>
 
+#include "misc/binaryreader.hpp"
+
 #include "components/vfs/manager.hpp"
 
 
@@ -22,15 +25,15 @@ class TexEntryHeader {
     uint16_t mNullValue[2];
 
 public:
-    void load(std::istream &stream)
+    void load(Misc::BinaryReader &reader)
     {
-        mUnknown1 = stream.get();
-        mColor = stream.get();
-        mOffset = VFS::read_le32(stream);
-        mUnknown2 = VFS::read_le16(stream);
-        mUnknown3 = VFS::read_le32(stream);
-        mNullValue[0] = VFS::read_le32(stream);
-        mNullValue[1] = VFS::read_le32(stream);
+        mUnknown1 = reader.read8();
+        mColor = reader.read8();
+        mOffset = reader.read32();
+        mUnknown2 = reader.read16();
+        mUnknown3 = reader.read32();
+        mNullValue[0] = reader.read32();
+        mNullValue[1] = reader.read32();
     }
 
     uint8_t getColor() const { return mColor; }
@@ -44,14 +47,14 @@ class TexFileHeader {
     std::vector<TexEntryHeader> mHeaders;
 
 public:
-    void load(std::istream &stream)
+    void load(Misc::BinaryReader &reader)
     {
-        mImageCount = VFS::read_le16(stream);
-        stream.read(mName.data(), mName.size());
+        mImageCount = reader.read16();
+        reader.read(mName.data(), mName.size());
 
         mHeaders.resize(mImageCount);
         for(TexEntryHeader &hdr : mHeaders)
-            hdr.load(stream);
+            hdr.load(reader);
     }
 
     uint16_t getImageCount() const { return mImageCount; }
@@ -77,20 +80,20 @@ public:
     static const uint16_t sRleCompressed = 0x0002;
     static const uint16_t sImageRle  = 0x0108;
     static const uint16_t sRecordRle = 0x1108;
-    void load(std::istream &stream)
+    void load(Misc::BinaryReader &reader)
     {
-        mOffsetX = VFS::read_le16(stream);
-        mOffsetY = VFS::read_le16(stream);
-        mWidth = VFS::read_le16(stream);
-        mHeight = VFS::read_le16(stream);
-        mCompression = VFS::read_le16(stream);
-        mRecordSize = VFS::read_le32(stream);
-        mDataOffset = VFS::read_le32(stream);
-        mIsNormal = VFS::read_le16(stream);
-        mFrameCount = VFS::read_le16(stream);
-        mUnknown = VFS::read_le16(stream);
-        mXScale = VFS::read_le16(stream);
-        mYScale = VFS::read_le16(stream);
+        mOffsetX = reader.read16();
+        mOffsetY = reader.read16();
+        mWidth = reader.read16();
+        mHeight = reader.read16();
+        mCompression = reader.read16();
+        mRecordSize = reader.read32();
+        mDataOffset = reader.read32();
+        mIsNormal = reader.read16();
+        mFrameCount = reader.read16();
+        mUnknown = reader.read16();
+        mXScale = reader.read16();
+        mYScale = reader.read16();
     }
 
     int16_t getXOffset() const { return mOffsetX; }
@@ -152,15 +155,16 @@ osg::Image *TexLoader::createDummyImage()
 }
 
 
-osg::Image *TexLoader::loadUncompressedSingle(size_t width, size_t height, const Resource::Palette &palette, std::istream &stream)
+osg::Image *TexLoader::loadUncompressedSingle(size_t width, size_t height, const Resource::Palette &palette, Misc::BinaryReader &reader)
 {
     osg::Image *image = new osg::Image();
     image->allocateImage(width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE);
 
     for(size_t y = 0;y < height;++y)
     {
-        std::array<uint8_t,256> line;
-        stream.read(reinterpret_cast<char*>(line.data()), line.size());
+        // The last line may be cut short at the end of the file.
+        std::array<uint8_t,256> line{};
+        reader.read(line.data(), std::min(line.size(), reader.remaining()));
 
         unsigned char *dst = image->data(0, y);
         for(size_t x = 0;x < width;++x)
@@ -176,15 +180,16 @@ osg::Image *TexLoader::loadUncompressedSingle(size_t width, size_t height, const
     return image;
 }
 
-void TexLoader::loadUncompressedMulti(osg::Image *image, const Resource::Palette &palette, std::istream &stream)
+void TexLoader::loadUncompressedMulti(osg::Image *image, const Resource::Palette &palette, Misc::BinaryReader &reader)
 {
-    size_t width = VFS::read_le16(stream);
-    size_t height = VFS::read_le16(stream);
+    size_t width = reader.read16();
+    size_t height = reader.read16();
 
-    for(uint32_t y = 0;y < height && stream;++y)
+    // Truncated frames are left partially filled.
+    for(uint32_t y = 0;y < height && !reader.eof();++y)
     {
         bool isZero = true;
-        uint8_t c = stream.get();
+        uint8_t c = reader.read8();
 
         uint32_t x = 0;
         do {
@@ -199,24 +204,26 @@ void TexLoader::loadUncompressedMulti(osg::Image *image, const Resource::Palette
                     *(dst++) = 0;
                 }
             }
-            else for(uint32_t i = 0;i < c;++i)
+            else for(uint32_t i = 0;i < c && !reader.eof();++i)
             {
                 unsigned char *dst = image->data(x++, y);
-                uint8_t idx = stream.get();
+                uint8_t idx = reader.read8();
                 *(dst++) = palette[idx].r;
                 *(dst++) = palette[idx].g;
                 *(dst++) = palette[idx].b;
                 *(dst++) = (idx==0) ? 0 : 255;
             }
+            if(reader.eof())
+                break;
             if(x < width || (x >= width && isZero))
-                c = stream.get();
+                c = reader.read8();
             isZero = !isZero;
-        } while(x < width && stream);
+        } while(x < width);
     }
 }
 
 
-ImagePtrArray TexLoader::load(std::istream &stream, const TexEntryHeader &texentry, int16_t *xoffset, int16_t *yoffset, int16_t *xscale, int16_t *yscale, const Resource::Palette &palette)
+ImagePtrArray TexLoader::load(Misc::BinaryReader &reader, const TexEntryHeader &texentry, int16_t *xoffset, int16_t *yoffset, int16_t *xscale, int16_t *yscale, const Resource::Palette &palette)
 {
     ImagePtrArray images;
 
@@ -237,11 +244,10 @@ ImagePtrArray TexLoader::load(std::istream &stream, const TexEntryHeader &texent
         return images;
     }
 
-    if(!stream.seekg(texentry.getOffset()))
-        throw std::runtime_error("Failed to seek to texture offset");
+    reader.seek(texentry.getOffset());
 
     TexHeader texhdr;
-    texhdr.load(stream);
+    texhdr.load(reader);
 
     if(xoffset) *xoffset = texhdr.getXOffset();
     if(yoffset) *yoffset = texhdr.getYOffset();
@@ -268,10 +274,8 @@ ImagePtrArray TexLoader::load(std::istream &stream, const TexEntryHeader &texent
             std::cerr<< "Unhandled RecordRle compression type"<< std::endl;
         else //if(texhdr.getCompression() == texhdr.sUncompressed)
         {
-            if(!stream.seekg(texentry.getOffset() + texhdr.getDataOffset()))
-                throw std::runtime_error("Failed to seek to image offset");
-
-            image = loadUncompressedSingle(texhdr.getWidth(), texhdr.getHeight(), palette, stream);
+            reader.seek(texentry.getOffset() + texhdr.getDataOffset());
+            image = loadUncompressedSingle(texhdr.getWidth(), texhdr.getHeight(), palette, reader);
         }
 
         if(!image)
@@ -289,23 +293,20 @@ ImagePtrArray TexLoader::load(std::istream &stream, const TexEntryHeader &texent
             std::cerr<< "Unhandled RecordRle compression type"<< std::endl;
         else //if(texhdr.getCompression() == texhdr.sUncompressed)
         {
-            if(!stream.seekg(texentry.getOffset() + texhdr.getDataOffset()))
-                throw std::runtime_error("Failed to seek to image offset");
+            reader.seek(texentry.getOffset() + texhdr.getDataOffset());
             std::vector<uint32_t> offsets(texhdr.getFrameCount());
-            for(uint32_t &offset : offsets)
-                offset = VFS::read_le32(stream);
+            reader.read32(offsets.data(), offsets.size());
 
             for(uint32_t offset : offsets)
             {
-                if(!stream.seekg(texentry.getOffset() + texhdr.getDataOffset() + offset))
-                    throw std::runtime_error("Failed to seek to frame offset");
+                reader.seek(texentry.getOffset() + texhdr.getDataOffset() + offset);
                 images.push_back(new osg::Image());
 
                 osg::Image *image = images.back();
                 image->allocateImage(texhdr.getWidth(), texhdr.getHeight(), 1,
                                     GL_RGBA, GL_UNSIGNED_BYTE);
 
-                loadUncompressedMulti(image, palette, stream);
+                loadUncompressedMulti(image, palette, reader);
             }
         }
 
@@ -323,13 +324,17 @@ ImagePtrArray TexLoader::load(size_t idx, int16_t *xoffset, int16_t *yoffset, in
     std::stringstream sstr; sstr.fill('0');
     sstr<<"TEXTURE."<<std::setw(3)<<(idx>>7);
 
-    VFS::IStreamPtr stream = VFS::Manager::get().open(sstr.str());
+    // Only the one entry is needed, so the file isn't copied where it can be
+    // used in place.
+    VFS::DataView data = VFS::Manager::get().view(sstr.str());
+    if(!data.mOwner) throw std::runtime_error("Failed to open "+sstr.str());
+    Misc::BinaryReader reader(data.mData, data.mSize);
 
     TexFileHeader hdr;
-    hdr.load(*stream);
+    hdr.load(reader);
 
     const TexEntryHeader &entryhdr = hdr.getHeaders().at(idx&0x7f);
-    return load(*stream, entryhdr, xoffset, yoffset, xscale, yscale, palette);
+    return load(reader, entryhdr, xoffset, yoffset, xscale, yscale, palette);
 }
 
 std::vector<ImagePtrArray> TexLoader::loadAll(size_t idx, const Resource::Palette &palette)
@@ -337,17 +342,19 @@ std::vector<ImagePtrArray> TexLoader::loadAll(size_t idx, const Resource::Palett
     std::stringstream sstr; sstr.fill('0');
     sstr<<"TEXTURE."<<std::setw(3)<<(idx>>7);
 
-    VFS::IStreamPtr stream = VFS::Manager::get().open(sstr.str());
+    VFS::DataView data = VFS::Manager::get().view(sstr.str());
+    if(!data.mOwner) throw std::runtime_error("Failed to open "+sstr.str());
+    Misc::BinaryReader reader(data.mData, data.mSize);
 
     TexFileHeader hdr;
-    hdr.load(*stream);
+    hdr.load(reader);
 
     std::vector<ImagePtrArray> allimages;
     allimages.reserve(hdr.getImageCount());
 
     int16_t xoffset, yoffset, xscale, yscale;
     for(const TexEntryHeader &entryhdr : hdr.getHeaders())
-        allimages.push_back(load(*stream, entryhdr, &xoffset, &yoffset, &xscale, &yscale, palette));
+        allimages.push_back(load(reader, entryhdr, &xoffset, &yoffset, &xscale, &yscale, palette));
 
     return allimages;
 }
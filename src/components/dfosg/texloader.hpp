@@ -18,6 +18,11 @@ namespace osg
     class Image;
 }
 
+namespace Misc
+{
+    class BinaryReader;
+}
+
 namespace DFOSG
 {
 
@@ -37,11 +42,11 @@ class TexLoader {
 
     osg::Image *loadUncompressedSingle(size_t width, size_t height,
                                        const Resource::Palette &palette,
-                                       std::istream &stream);
+                                       Misc::BinaryReader &reader);
     void loadUncompressedMulti(osg::Image *image, const Resource::Palette &palette,
-                               std::istream &stream);
+                               Misc::BinaryReader &reader);
 
-    ImagePtrArray load(std::istream &stream, const TexEntryHeader &texentry,
+    ImagePtrArray load(Misc::BinaryReader &reader, const TexEntryHeader &texentry,
                        int16_t *xoffset, int16_t *yoffset, int16_t *xscale, int16_t *yscale,
                        const Resource::Palette &palette);
 
@@ -1,6 +1,8 @@
 
 #include "meshmanager.hpp"
 
+#include <memory>
+
 #include <osg/Node>
 #include <osg/MatrixTransform>
 #include <osg/Billboard>
@@ -34,6 +36,7 @@ void MeshManager::initialize()
 
 void MeshManager::deinitialize()
 {
+    std::lock_guard<std::mutex> lock(mMutex);
     mStateSetCache.clear();
     mTerrainCache.clear();
     mFlatCache.clear();
@@ -50,22 +53,29 @@ osg::ref_ptr<osg::Node> MeshManager::get(size_t idx)
      * tree. OSG can parent the same sub-tree to multiple points, which should
      * be okay as long as the individual sub-trees don't need changing.
      */
-    auto iter = mModelCache.find(idx);
-    if(iter != mModelCache.end())
+    osg::ref_ptr<osg::Program> program;
     {
-        osg::ref_ptr<osg::Node> node;
-        if(iter->second.lock(node))
-            return node;
-    }
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto iter = mModelCache.find(idx);
+        if(iter != mModelCache.end())
+        {
+            osg::ref_ptr<osg::Node> node;
+            if(iter->second.lock(node))
+                return node;
+        }
 
-    if(!mModelProgram)
-    {
-        mModelProgram = new osg::Program();
-        mModelProgram->addShader(osgDB::readShaderFile(osg::Shader::VERTEX, "shaders/object.vert"));
-        mModelProgram->addShader(osgDB::readShaderFile(osg::Shader::FRAGMENT, "shaders/object.frag"));
+        if(!mModelProgram)
+        {
+            mModelProgram = new osg::Program();
+            mModelProgram->addShader(osgDB::readShaderFile(osg::Shader::VERTEX, "shaders/object.vert"));
+            mModelProgram->addShader(osgDB::readShaderFile(osg::Shader::FRAGMENT, "shaders/object.frag"));
+        }
+        program = mModelProgram;
     }
 
-    DFOSG::Mesh *mesh = DFOSG::MeshLoader::get().load(idx);
+    // Built without the lock, so other threads can get cached meshes or build
+    // others in the mean time.
+    std::unique_ptr<DFOSG::Mesh> mesh(DFOSG::MeshLoader::get().load(idx));
 
     osg::ref_ptr<osg::Geode> geode(new osg::Geode());
     for(auto iter = mesh->getPlanes().begin();iter != mesh->getPlanes().end();)
@@ -151,6 +161,7 @@ osg::ref_ptr<osg::Node> MeshManager::get(size_t idx)
          * multiple models (should help OSG batch together objects with similar
          * state).
          */
+        std::lock_guard<std::mutex> lock(mMutex);
         auto &stateiter = mStateSetCache[texid];
         osg::ref_ptr<osg::StateSet> ss;
         if(stateiter.lock(ss) && ss)
@@ -158,7 +169,7 @@ osg::ref_ptr<osg::Node> MeshManager::get(size_t idx)
         else
         {
             ss = geometry->getOrCreateStateSet();
-            ss->setAttributeAndModes(mModelProgram);
+            ss->setAttributeAndModes(program);
             ss->addUniform(new osg::Uniform("diffuseTex", 0));
             ss->setTextureAttribute(0, tex);
             stateiter = ss;
@@ -167,18 +178,26 @@ osg::ref_ptr<osg::Node> MeshManager::get(size_t idx)
         geode->addDrawable(geometry);
     }
 
+    // Another thread may have built it too, in which case use theirs so
+    // there's only one copy.
+    std::lock_guard<std::mutex> lock(mMutex);
+    osg::ref_ptr<osg::Node> node;
+    if(mModelCache[idx].lock(node) && node)
+        return node;
     mModelCache[idx] = osg::ref_ptr<osg::Node>(geode);
     return geode;
 }
 
 osg::ref_ptr<osg::Node> MeshManager::loadFlat(size_t texid, bool centered, size_t *num_frames)
 {
-    auto iter = mFlatCache.find(std::make_pair(texid, centered));
-    if(iter != mFlatCache.end())
+    osg::ref_ptr<osg::Program> program;
     {
         osg::ref_ptr<osg::Node> node;
-        if(iter->second.lock(node))
+        std::unique_lock<std::mutex> lock(mMutex);
+        auto iter = mFlatCache.find(std::make_pair(texid, centered));
+        if(iter != mFlatCache.end() && iter->second.lock(node))
         {
+            lock.unlock();
             if(num_frames)
             {
                 osg::ref_ptr<osg::Texture> tex = TextureManager::get().getTexture(texid);
@@ -186,13 +205,14 @@ osg::ref_ptr<osg::Node> MeshManager::loadFlat(size_t texid, bool centered, size_
             }
             return node;
         }
-    }
 
-    if(!mFlatProgram)
-    {
-        mFlatProgram = new osg::Program();
-        mFlatProgram->addShader(osgDB::readShaderFile(osg::Shader::VERTEX, "shaders/sprite.vert"));
-        mFlatProgram->addShader(osgDB::readShaderFile(osg::Shader::FRAGMENT, "shaders/sprite.frag"));
+        if(!mFlatProgram)
+        {
+            mFlatProgram = new osg::Program();
+            mFlatProgram->addShader(osgDB::readShaderFile(osg::Shader::VERTEX, "shaders/sprite.vert"));
+            mFlatProgram->addShader(osgDB::readShaderFile(osg::Shader::FRAGMENT, "shaders/sprite.frag"));
+        }
+        program = mFlatProgram;
     }
 
     int16_t xoffset, yoffset;
@@ -253,7 +273,7 @@ osg::ref_ptr<osg::Node> MeshManager::loadFlat(size_t texid, bool centered, size_
     geometry->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::QUADS, 0, 4));
 
     osg::StateSet *ss = geometry->getOrCreateStateSet();
-    ss->setAttributeAndModes(mFlatProgram);
+    ss->setAttributeAndModes(program);
     // Alpha test is reversed, because the shader will set alpha=0 for texels
     // that should be kept, and consequently have no specular, and alpha=1 for
     // texels that should be dropped.
@@ -267,25 +287,35 @@ osg::ref_ptr<osg::Node> MeshManager::loadFlat(size_t texid, bool centered, size_
         bb->addDrawable(geometry, osg::Vec3(0.0f, height*-0.5f, 0.0f));
     base->addChild(bb);
 
-    mFlatCache[std::make_pair(texid, centered)] = osg::ref_ptr<osg::Node>(base);
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto &cached = mFlatCache[std::make_pair(texid, centered)];
+    osg::ref_ptr<osg::Node> node;
+    if(cached.lock(node) && node)
+        return node;
+    cached = osg::ref_ptr<osg::Node>(base);
     return base;
 }
 
 osg::ref_ptr<osg::Node> MeshManager::getTerrain(int size)
 {
-    auto iter = mTerrainCache.find(size);
-    if(iter != mTerrainCache.end())
+    osg::ref_ptr<osg::Program> program;
     {
-        osg::ref_ptr<osg::Node> node;
-        if(iter->second.lock(node))
-            return node;
-    }
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto iter = mTerrainCache.find(size);
+        if(iter != mTerrainCache.end())
+        {
+            osg::ref_ptr<osg::Node> node;
+            if(iter->second.lock(node))
+                return node;
+        }
 
-    if(!mTerrainProgram)
-    {
-        mTerrainProgram = new osg::Program();
-        mTerrainProgram->addShader(osgDB::readShaderFile(osg::Shader::VERTEX, "shaders/terrain.vert"));
-        mTerrainProgram->addShader(osgDB::readShaderFile(osg::Shader::FRAGMENT, "shaders/terrain.frag"));
+        if(!mTerrainProgram)
+        {
+            mTerrainProgram = new osg::Program();
+            mTerrainProgram->addShader(osgDB::readShaderFile(osg::Shader::VERTEX, "shaders/terrain.vert"));
+            mTerrainProgram->addShader(osgDB::readShaderFile(osg::Shader::FRAGMENT, "shaders/terrain.frag"));
+        }
+        program = mTerrainProgram;
     }
 
     osg::ref_ptr<osg::Vec3Array> vtxs(new osg::Vec3Array(4));
@@ -312,14 +342,19 @@ osg::ref_ptr<osg::Node> MeshManager::getTerrain(int size)
     geometry->setInitialBound(osg::BoundingBox(osg::Vec3(0.0f, -0.5f, -256.0f*size), osg::Vec3(256.0f*size, 0.5f, 0.0f)));
 
     osg::StateSet *ss = geometry->getOrCreateStateSet();
-    ss->setAttributeAndModes(mTerrainProgram);
+    ss->setAttributeAndModes(program);
     ss->addUniform(new osg::Uniform("diffuseTex", 0));
     ss->addUniform(new osg::Uniform("tilemapTex", 1));
 
     osg::ref_ptr<osg::Geode> base(new osg::Geode());
     base->addDrawable(geometry);
 
-    mTerrainCache[size] = osg::ref_ptr<osg::Node>(base);
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto &cached = mTerrainCache[size];
+    osg::ref_ptr<osg::Node> node;
+    if(cached.lock(node) && node)
+        return node;
+    cached = osg::ref_ptr<osg::Node>(base);
     return base;
 }
 
@@ -2,6 +2,7 @@
 #define COMPONENTS_RESOURCE_MESHMANAGER_HPP
 
 #include <map>
+#include <mutex>
 
 #include <osg/ref_ptr>
 
@@ -29,6 +30,9 @@ class MeshManager {
     osg::ref_ptr<osg::Program> mFlatProgram;
     osg::ref_ptr<osg::Program> mTerrainProgram;
 
+    // Guards the caches, as meshes may be loaded from worker threads.
+    std::mutex mMutex;
+
     MeshManager();
     ~MeshManager();
 
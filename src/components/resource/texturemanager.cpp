@@ -9,6 +9,8 @@
 #include <osg/Texture2D>
 #include <osg/Texture2DArray>
 
+#include "misc/binaryreader.hpp"
+
 #include "components/vfs/manager.hpp"
 #include "components/dfosg/texloader.hpp"
 
@@ -51,44 +53,41 @@ TextureManager::~TextureManager()
 
 void TextureManager::initialize()
 {
-    VFS::IStreamPtr stream = VFS::Manager::get().open("PAL.PAL");
+    VFS::DataPtr data = VFS::Manager::get().read("PAL.PAL");
+    if(!data) throw std::runtime_error("Failed to open PAL.PAL");
+    Misc::BinaryReader reader(*data);
 
-    std::streamsize len = 0;
-    if(stream && stream->seekg(0, std::ios_base::end))
-    {
-        len = stream->tellg();
-        stream->seekg(0);
-    }
-
-    if(len == 776)
-    {
-        len -= 8;
-        stream->ignore(8);
-    }
+    if(reader.size() == 776)
+        reader.skip(8);
 
-    if(len != sizeof(mCurrentPalette))
+    if(reader.remaining() != sizeof(mCurrentPalette))
         throw std::runtime_error("Invalid palette size (expected 768 or 776 bytes)");
 
-    stream->read(reinterpret_cast<char*>(mCurrentPalette.data()), sizeof(mCurrentPalette));
+    reader.read(mCurrentPalette.data(), sizeof(mCurrentPalette));
 }
 
 
 osg::ref_ptr<osg::Texture> TextureManager::getTexture(size_t idx, int16_t *xoffset, int16_t *yoffset, float *xscale, float *yscale)
 {
-    auto iter = mTexCache.find(idx);
-    if(iter != mTexCache.end())
     {
-        osg::ref_ptr<osg::Texture> tex;
-        if(iter->second.mTexture.lock(tex))
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto iter = mTexCache.find(idx);
+        if(iter != mTexCache.end())
         {
-            *xoffset = iter->second.mXOffset;
-            *yoffset = iter->second.mYOffset;
-            *xscale = iter->second.mXScale;
-            *yscale = iter->second.mYScale;
-            return tex;
+            osg::ref_ptr<osg::Texture> tex;
+            if(iter->second.mTexture.lock(tex))
+            {
+                *xoffset = iter->second.mXOffset;
+                *yoffset = iter->second.mYOffset;
+                *xscale = iter->second.mXScale;
+                *yscale = iter->second.mYScale;
+                return tex;
+            }
         }
     }
 
+    // Loaded without the lock, so other threads can get cached textures or
+    // load others in the mean time.
     int16_t x_offset, y_offset, x_scale, y_scale;
     std::vector<osg::ref_ptr<osg::Image>> images = DFOSG::TexLoader::get().load(
         idx, &x_offset, &y_offset, &x_scale, &y_scale, mCurrentPalette
@@ -119,7 +118,20 @@ osg::ref_ptr<osg::Texture> TextureManager::getTexture(size_t idx, int16_t *xoffs
     tex->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST_MIPMAP_LINEAR);
     tex->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
 
-    mTexCache[idx] = TextureInfo{
+    // Another thread may have loaded it too, in which case use theirs so
+    // there's only one copy.
+    std::lock_guard<std::mutex> lock(mMutex);
+    TextureInfo &cached = mTexCache[idx];
+    osg::ref_ptr<osg::Texture> other;
+    if(cached.mTexture.lock(other) && other)
+    {
+        *xoffset = cached.mXOffset;
+        *yoffset = cached.mYOffset;
+        *xscale = cached.mXScale;
+        *yscale = cached.mYScale;
+        return other;
+    }
+    cached = TextureInfo{
         tex, x_offset, y_offset, 1.0f + x_scale/256.0f, 1.0f + y_scale/256.0f
     };
     return tex;
@@ -135,12 +147,15 @@ osg::ref_ptr<osg::Texture> TextureManager::getTexture(size_t idx)
 
 osg::ref_ptr<osg::Texture> TextureManager::getTerrainTileset(size_t idx)
 {
-    auto iter = mTexCache.find(idx|0x7f);
-    if(iter != mTexCache.end())
     {
-        osg::ref_ptr<osg::Texture> tex;
-        if(iter->second.mTexture.lock(tex))
-            return tex;
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto iter = mTexCache.find(idx|0x7f);
+        if(iter != mTexCache.end())
+        {
+            osg::ref_ptr<osg::Texture> tex;
+            if(iter->second.mTexture.lock(tex))
+                return tex;
+        }
     }
 
     std::vector<std::vector<osg::ref_ptr<osg::Image>>> images = DFOSG::TexLoader::get().loadAll(
@@ -178,7 +193,12 @@ osg::ref_ptr<osg::Texture> TextureManager::getTerrainTileset(size_t idx)
     tex->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST_MIPMAP_LINEAR);
     tex->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
 
-    mTexCache[idx|0x7f] = TextureInfo{
+    std::lock_guard<std::mutex> lock(mMutex);
+    TextureInfo &cached = mTexCache[idx|0x7f];
+    osg::ref_ptr<osg::Texture> other;
+    if(cached.mTexture.lock(other) && other)
+        return other;
+    cached = TextureInfo{
         tex, 0, 0, 1.0f, 1.0f
     };
     return tex;
@@ -4,6 +4,7 @@
 #include <string>
 #include <array>
 #include <map>
+#include <mutex>
 #include <cstdint>
 
 #include <osg/ref_ptr>
@@ -37,6 +38,8 @@ class TextureManager {
     static_assert(sizeof(Palette)==768, "Palette is not 768 bytes");
 
     std::map<size_t,TextureInfo> mTexCache;
+    // Guards the cache, as textures may be loaded from worker threads.
+    std::mutex mMutex;
 
     TextureManager(const TextureManager&) = delete;
     TextureManager& operator=(const TextureManager&) = delete;
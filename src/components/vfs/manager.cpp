@@ -4,6 +4,8 @@
 #ifdef _WIN32
 #include "dirent.h"
 #include "misc/fnmatch.h"
+#include <sys/types.h>
+#include <sys/stat.h>
 #else
 #include <dirent.h>
 #include <sys/stat.h>
@@ -14,13 +16,25 @@
 #include <sstream>
 #include <vector>
 #include <set>
+#include <array>
+#include <algorithm>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <cstring>
 
 #include <osgDB/Registry>
 
 #include "components/archives/archive.hpp"
 #include "components/archives/bsaarchive.hpp"
+#include "components/archives/mappedfile.hpp"
+#include "components/archives/batchreader.hpp"
 
 #include "osg_callbacks.hpp"
+#include "trace.hpp"
 
 
 namespace
@@ -34,6 +48,227 @@ std::vector<std::unique_ptr<Archives::Archive>> gArchives;
 Archives::BsaArchive gArchitecture;
 Archives::BsaArchive gSound;
 
+/* Where a named file is found. Entries from archives take precedence over
+ * loose files, and later archives and data paths take precedence over
+ * earlier ones.
+ */
+struct FileLocation {
+    Archives::Archive *mArchive;
+    std::string mPath;
+
+    FileLocation() : mArchive(nullptr) { }
+};
+// Archive entries are looked up regardless of case, so loose files are too
+// to keep them consistent.
+std::unordered_map<std::string,FileLocation,Archives::NameHash,Archives::NameEqual> gFileIndex;
+// All names in gFileIndex, sorted regardless of case, so patterns with a
+// literal prefix only need to check the matching range.
+std::vector<std::string> gSortedNames;
+
+void rebuild_sorted_names()
+{
+    gSortedNames.clear();
+    gSortedNames.reserve(gFileIndex.size());
+    for(const auto &file : gFileIndex)
+        gSortedNames.push_back(file.first);
+    std::sort(gSortedNames.begin(), gSortedNames.end(), Archives::NameLess());
+}
+
+/* Returns the part of the glob pattern before the first special character. */
+std::string literal_prefix(const char *pattern)
+{
+    size_t len = strcspn(pattern, "*?[\\");
+    return std::string(pattern, len);
+}
+
+bool has_prefix_nocase(const std::string &name, const std::string &prefix)
+{
+    return name.size() >= prefix.size() &&
+           Archives::NameEqual()(name.substr(0, prefix.size()), prefix);
+}
+
+std::shared_ptr<VFS::AccessTrace> gTrace;
+
+std::string base_name(const std::string &path)
+{
+    size_t pos = path.find_last_of("/\\");
+    return (pos == std::string::npos) ? path : path.substr(pos+1);
+}
+
+/* Wraps the stream for tracing, if a trace is running. */
+VFS::IStreamPtr trace_stream(VFS::IStreamPtr stream, uint64_t start, const std::string &archive, const std::string &name)
+{
+    std::shared_ptr<VFS::AccessTrace> trace = std::atomic_load(&gTrace);
+    if(!trace || !stream) return stream;
+
+    uint64_t id = trace->nextStreamId();
+    trace->record(start, id, "open", archive, name, 0, 0);
+    return VFS::IStreamPtr(new VFS::TraceStream(trace, std::move(stream), id));
+}
+
+uint64_t trace_start()
+{
+    std::shared_ptr<VFS::AccessTrace> trace = std::atomic_load(&gTrace);
+    return trace ? trace->now() : 0;
+}
+
+/* Records a whole-file read that didn't go through a stream. */
+void trace_read(uint64_t start, const std::string &archive, const std::string &name, std::streamsize bytes)
+{
+    std::shared_ptr<VFS::AccessTrace> trace = std::atomic_load(&gTrace);
+    if(!trace) return;
+
+    uint64_t id = trace->nextStreamId();
+    trace->record(start, id, "open", archive, name, 0, 0);
+    trace->record(start, id, "read", std::string(), std::string(), 0, bytes);
+    trace->record(trace->now(), id, "close", std::string(), std::string(), -1, 0);
+}
+
+std::unordered_map<std::string,VFS::ReadRequest,Archives::NameHash,Archives::NameEqual> gPrefetched;
+std::mutex gPrefetchMutex;
+
+/* Takes the prefetched file, if it's been read. One still waiting or being
+ * read is cancelled and left to the caller, rather than holding up a batch
+ * that will read it anyway. */
+VFS::DataPtr claim_prefetched(const std::string &name)
+{
+    std::unique_lock<std::mutex> lock(gPrefetchMutex);
+    auto iter = gPrefetched.find(name);
+    if(iter == gPrefetched.end())
+        return VFS::DataPtr();
+    VFS::ReadRequest request = std::move(iter->second);
+    gPrefetched.erase(iter);
+    lock.unlock();
+
+    if(request.ready())
+        return request.get();
+    request.cancel();
+    return VFS::DataPtr();
+}
+
+VFS::DataPtr read_stream(VFS::IStreamPtr stream)
+{
+    if(!stream) return VFS::DataPtr();
+
+    std::shared_ptr<std::vector<char>> data = std::make_shared<std::vector<char>>();
+    if(stream->seekg(0, std::ios_base::end))
+    {
+        std::streamoff len = stream->tellg();
+        if(len > 0 && stream->seekg(0))
+        {
+            data->resize(len);
+            stream->read(data->data(), len);
+            data->resize(stream->gcount());
+            return data;
+        }
+    }
+
+    // Unseekable, just read until the end.
+    stream->clear();
+    std::array<char,4096> buf;
+    while(stream->read(buf.data(), buf.size()) || stream->gcount() > 0)
+        data->insert(data->end(), buf.data(), buf.data()+stream->gcount());
+    return data;
+}
+
+VFS::DataPtr read_file(const char *name)
+{
+    return read_stream(VFS::Manager::get().open(name));
+}
+
+/* Loose files held in memory by Manager::makeResident. */
+std::unordered_map<std::string,VFS::DataPtr,Archives::NameHash,Archives::NameEqual> gResidentFiles;
+std::vector<VFS::ResidentInfo> gResidentInfo;
+std::mutex gResidentMutex;
+
+VFS::DataPtr find_resident(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(gResidentMutex);
+    auto iter = gResidentFiles.find(name);
+    return (iter != gResidentFiles.end()) ? iter->second : VFS::DataPtr();
+}
+
+/* Runs the residency loads, and waits for them on destruction so the thread
+ * doesn't outlive the archives.
+ */
+class ResidentLoader {
+    std::thread mThread;
+    std::atomic<bool> mQuit;
+    std::atomic<bool> mBusy;
+
+public:
+    ResidentLoader() : mQuit(false), mBusy(false) { }
+    ~ResidentLoader() { stop(); }
+
+    void start(std::function<void(const std::atomic<bool>&)> func)
+    {
+        stop();
+        mBusy = true;
+        mThread = std::thread([this, func]()
+        {
+            func(mQuit);
+            mBusy = false;
+        });
+    }
+
+    void stop()
+    {
+        mQuit = true;
+        if(mThread.joinable())
+            mThread.join();
+        mQuit = false;
+    }
+
+    bool isBusy() const { return mBusy; }
+};
+ResidentLoader gResidentLoader;
+
+// Archives opened for batch reads, by path. Only archives are kept open, as
+// there are only a few, and they're closed when the index is rebuilt. Loose
+// files are opened for each batch.
+std::map<std::string,std::shared_ptr<Archives::SharedFile>> gBatchArchives;
+std::mutex gBatchMutex;
+
+std::shared_ptr<Archives::SharedFile> get_batch_archive(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(gBatchMutex);
+    std::shared_ptr<Archives::SharedFile> &file = gBatchArchives[path];
+    if(!file) file = Archives::SharedFile::open(path);
+    return file;
+}
+
+void clear_batch_archives()
+{
+    std::lock_guard<std::mutex> lock(gBatchMutex);
+    gBatchArchives.clear();
+}
+
+/* Readers aren't thread-safe, so each thread doing batch reads gets its own
+ * (with its own ring, where io_uring is used). */
+Archives::BatchReader &get_batch_reader()
+{
+    static thread_local std::unique_ptr<Archives::BatchReader> reader;
+    if(!reader)
+        reader.reset(new Archives::BatchReader());
+    return *reader;
+}
+
+// Declared last so it's destroyed (and its threads stopped) first.
+VFS::ReadPool gReadPool([](const std::string &name) -> VFS::DataPtr
+{
+    return read_file(name.c_str());
+});
+
+std::string normalize_name(const char *name)
+{
+    std::string fname(name);
+    for(char &c : fname)
+    {
+        if(c == '\\') c = '/';
+    }
+    return fname;
+}
+
 }
 
 
@@ -65,6 +300,10 @@ void Manager::initialize(std::string&& root_path)
 
     gRootPaths.push_back(std::move(root_path));
 
+    rescan();
+
+    gReadPool.start(2);
+
     osgDB::Registry::instance()->setReadFileCallback(new OSGReadCallback());
 }
 
@@ -75,63 +314,451 @@ void Manager::addDataPath(std::string&& path)
     else if(path.back() != '/' && path.back() != '\\')
         path += "/";
     gRootPaths.push_back(std::move(path));
+
+    add_path_to_index(gRootPaths.back());
+    rebuild_sorted_names();
+}
+
+void Manager::add_path_to_index(const std::string &path)
+{
+    std::map<std::string,std::string> files;
+    add_dir(path+".", "", files);
+    for(auto &file : files)
+    {
+        FileLocation &loc = gFileIndex[file.first];
+        // Don't let loose files override archive entries.
+        if(loc.mArchive) continue;
+        loc.mPath = std::move(file.second);
+    }
+}
+
+void Manager::rescan()
+{
+    gFileIndex.clear();
+    clear_batch_archives();
+
+    for(const std::string &path : gRootPaths)
+        add_path_to_index(path);
+
+    for(const std::unique_ptr<Archives::Archive> &archive : gArchives)
+    {
+        for(const std::string &name : archive->list())
+        {
+            // Keep the archive's spelling of the name for listing.
+            auto iter = gFileIndex.find(name);
+            if(iter != gFileIndex.end() && iter->first != name)
+                gFileIndex.erase(iter);
+
+            FileLocation &loc = gFileIndex[name];
+            loc.mArchive = archive.get();
+            loc.mPath.clear();
+        }
+    }
+    rebuild_sorted_names();
 }
 
 
 IStreamPtr Manager::open(const char *name)
 {
-    auto iter = gArchives.rbegin();
-    while(iter != gArchives.rend())
+    auto iter = gFileIndex.find(normalize_name(name));
+    if(iter == gFileIndex.end())
+        return IStreamPtr();
+
+    uint64_t start = trace_start();
+    const FileLocation &loc = iter->second;
+    if(loc.mArchive)
+        return trace_stream(loc.mArchive->open(iter->first.c_str()), start,
+                            base_name(loc.mArchive->getFilename()), iter->first);
+
+    DataPtr data = find_resident(iter->first);
+    if(data)
+        return trace_stream(IStreamPtr(new Archives::MemoryStream(data, data->data(), data->size())),
+                            start, std::string(), loc.mPath);
+
+    std::unique_ptr<std::ifstream> stream(new std::ifstream(loc.mPath.c_str(), std::ios_base::binary));
+    if(!stream->good()) return IStreamPtr();
+    return trace_stream(IStreamPtr(std::move(stream)), start, std::string(), loc.mPath);
+}
+
+DataPtr Manager::read(const char *name)
+{
+    std::string fname = normalize_name(name);
+    DataPtr data = find_resident(fname);
+    if(data) return data;
+
     {
-        IStreamPtr stream((*iter)->open(name));
-        if(stream) return stream;
-        ++iter;
+        std::unique_lock<std::mutex> lock(gPrefetchMutex);
+        auto iter = gPrefetched.find(fname);
+        if(iter != gPrefetched.end())
+        {
+            ReadRequest request = iter->second;
+            gPrefetched.erase(iter);
+            lock.unlock();
+
+            // A cancelled prefetch comes back empty, so read it here.
+            DataPtr data = request.get();
+            if(data) return data;
+        }
     }
 
-    std::unique_ptr<std::ifstream> stream(new std::ifstream());
-    auto piter = gRootPaths.rbegin();
-    while(piter != gRootPaths.rend())
+    return read_file(name);
+}
+
+DataView Manager::view(const char *name)
+{
+    DataView view;
+    std::string fname = normalize_name(name);
+    auto iter = gFileIndex.find(fname);
+    if(iter != gFileIndex.end())
     {
-        stream->open((*piter+name).c_str(), std::ios_base::binary);
-        if(stream->good()) return IStreamPtr(std::move(stream));
-        ++piter;
+        uint64_t start = trace_start();
+        const FileLocation &loc = iter->second;
+        if(loc.mArchive)
+        {
+            const Archives::BsaArchive *archive = static_cast<const Archives::BsaArchive*>(loc.mArchive);
+            if(archive->getEntryData(iter->first.c_str(), view.mOwner, view.mData, view.mSize))
+            {
+                trace_read(start, base_name(archive->getFilename()), iter->first, view.mSize);
+                return view;
+            }
+        }
+        else if(!find_resident(iter->first))
+        {
+            // Mapping a loose file only reads the pages that get used.
+            std::shared_ptr<Archives::MappedFile> mapping = Archives::MappedFile::open(loc.mPath);
+            if(mapping)
+            {
+                view.mData = mapping->data();
+                view.mSize = mapping->size();
+                view.mOwner = std::move(mapping);
+                trace_read(start, std::string(), loc.mPath, view.mSize);
+                return view;
+            }
+        }
+    }
+
+    DataPtr data = read(fname);
+    if(data)
+    {
+        view.mData = data->data();
+        view.mSize = data->size();
+        view.mOwner = std::move(data);
+    }
+    return view;
+}
+
+std::vector<DataPtr> Manager::readBatch(const std::vector<std::string> &names)
+{
+    std::vector<DataPtr> result(names.size());
+    std::vector<std::shared_ptr<std::vector<char>>> buffers(names.size());
+
+    struct Pending {
+        size_t mIndex;
+        std::string mArchive;
+        std::string mName;
+    };
+    std::vector<Archives::BatchReader::Request> requests;
+    std::vector<Pending> pending;
+    // Keeps the files open until the reads are done, including loose files
+    // only opened for this batch.
+    std::vector<std::shared_ptr<Archives::SharedFile>> files;
+
+    for(size_t i = 0;i < names.size();++i)
+    {
+        std::string name = normalize_name(names[i].c_str());
+        result[i] = find_resident(name);
+        if(result[i]) continue;
+        result[i] = claim_prefetched(name);
+        if(result[i]) continue;
+
+        auto iter = gFileIndex.find(name);
+        if(iter == gFileIndex.end()) continue;
+
+        const FileLocation &loc = iter->second;
+        std::string path = loc.mPath;
+        std::streamsize offset = 0, size = -1;
+        if(loc.mArchive)
+        {
+            Archives::BsaArchive *archive = static_cast<Archives::BsaArchive*>(loc.mArchive);
+            if(archive->getResidentSize() > 0)
+            {
+                result[i] = read_file(name.c_str());
+                continue;
+            }
+            archive->getEntryRange(name.c_str(), offset, size);
+            path = archive->getFilename();
+        }
+
+        std::shared_ptr<Archives::SharedFile> file = loc.mArchive ? get_batch_archive(path) :
+                                                     Archives::SharedFile::open(path);
+        if(!file) continue;
+        if(size < 0) size = file->size();
+        if(size < 0) continue;
+
+        buffers[i] = std::make_shared<std::vector<char>>(size);
+
+        Archives::BatchReader::Request req;
+        req.mFile = file.get();
+        req.mOffset = offset;
+        req.mSize = size;
+        req.mBuffer = buffers[i]->data();
+        req.mResult = -1;
+        requests.push_back(req);
+        files.push_back(std::move(file));
+        pending.push_back(Pending{i, loc.mArchive ? base_name(path) : std::string(),
+                                  loc.mArchive ? name : path});
+    }
+
+    uint64_t start = trace_start();
+    get_batch_reader().read(requests.data(), requests.size());
+
+    for(size_t i = 0;i < requests.size();++i)
+    {
+        if(requests[i].mResult < 0)
+            continue;
+        size_t idx = pending[i].mIndex;
+        buffers[idx]->resize(requests[i].mResult);
+        result[idx] = std::move(buffers[idx]);
+        trace_read(start, pending[i].mArchive, pending[i].mName, requests[i].mResult);
+    }
+
+    return result;
+}
+
+std::vector<IStreamPtr> Manager::openBatch(const std::vector<std::string> &names)
+{
+    std::vector<DataPtr> data = readBatch(names);
+
+    std::vector<IStreamPtr> streams(data.size());
+    for(size_t i = 0;i < data.size();++i)
+    {
+        if(data[i])
+            streams[i].reset(new Archives::MemoryStream(data[i], data[i]->data(), data[i]->size()));
     }
+    return streams;
+}
 
-    return IStreamPtr();
+ReadRequest Manager::readAsync(std::string name, ReadPriority priority)
+{
+    name = normalize_name(name.c_str());
+    {
+        std::unique_lock<std::mutex> lock(gPrefetchMutex);
+        auto iter = gPrefetched.find(name);
+        if(iter != gPrefetched.end())
+        {
+            ReadRequest request = iter->second;
+            gPrefetched.erase(iter);
+            return request;
+        }
+    }
+    return gReadPool.submit(std::move(name), priority);
 }
 
+void Manager::prefetch(const std::vector<std::string> &names, ReadPriority priority)
+{
+    for(const std::string &rawname : names)
+    {
+        std::string name = normalize_name(rawname.c_str());
+        std::unique_lock<std::mutex> lock(gPrefetchMutex);
+        if(gPrefetched.find(name) != gPrefetched.end())
+            continue;
+        lock.unlock();
+
+        ReadRequest request = gReadPool.submit(name, priority);
+
+        // Another thread may have prefetched it meanwhile, so drop this read
+        // rather than leave it running with no handle.
+        lock.lock();
+        if(!gPrefetched.insert(std::make_pair(name, request)).second)
+            request.cancel();
+    }
+}
+
+void Manager::cancelPrefetch()
+{
+    std::unique_lock<std::mutex> lock(gPrefetchMutex);
+    for(auto &request : gPrefetched)
+        request.second.cancel();
+    gPrefetched.clear();
+}
+
+
 IStreamPtr Manager::openSoundId(size_t id)
 {
-    return gSound.open(id);
+    uint64_t start = trace_start();
+    return trace_stream(gSound.open(id), start, base_name(gSound.getFilename()), std::to_string(id));
 }
 
 IStreamPtr Manager::openArchId(size_t id)
 {
-    return gArchitecture.open(id);
+    uint64_t start = trace_start();
+    return trace_stream(gArchitecture.open(id), start, base_name(gArchitecture.getFilename()), std::to_string(id));
 }
 
-bool Manager::exists(const char *name)
+DataPtr Manager::readArchId(size_t id)
 {
-    auto iter = gArchives.rbegin();
-    while(iter != gArchives.rend())
+    return read_stream(openArchId(id));
+}
+
+
+void Manager::makeResident(const std::vector<std::string> &patterns, size_t budget)
+{
+    dropResident();
+
+    struct Candidate {
+        Archives::BsaArchive *mArchive;
+        std::string mName;
+        std::string mPath;
+    };
+    std::vector<Candidate> candidates;
+    std::set<std::string> seen;
+
+    std::vector<Archives::BsaArchive*> archives;
+    for(const std::unique_ptr<Archives::Archive> &archive : gArchives)
+        archives.push_back(static_cast<Archives::BsaArchive*>(archive.get()));
+    archives.push_back(&gArchitecture);
+    archives.push_back(&gSound);
+
+    for(const std::string &pattern : patterns)
     {
-        if((*iter)->exists(name))
-            return true;
-        ++iter;
+        for(Archives::BsaArchive *archive : archives)
+        {
+            std::string name = base_name(archive->getFilename());
+            if(fnmatch(pattern.c_str(), name.c_str(), FNM_CASEFOLD) == 0 && seen.insert(name).second)
+                candidates.push_back(Candidate{archive, name, std::string()});
+        }
+        for(const std::string &name : list(pattern.c_str()))
+        {
+            const FileLocation &loc = gFileIndex.find(name)->second;
+            if(!loc.mArchive && seen.insert(name).second)
+                candidates.push_back(Candidate{nullptr, name, loc.mPath});
+        }
     }
 
-    std::ifstream file;
-    for(const std::string &path : gRootPaths)
+    gResidentLoader.start([candidates, budget](const std::atomic<bool> &quit)
     {
-        file.open((path+name).c_str(), std::ios_base::binary);
-        if(file.is_open()) return true;
-    }
+        size_t total = 0;
+        for(const Candidate &candidate : candidates)
+        {
+            if(quit) break;
+
+            ResidentInfo info;
+            info.mName = candidate.mName;
+            info.mBytes = 0;
+            info.mMicroseconds = 0;
+            info.mSkipped = true;
+
+            auto start = std::chrono::steady_clock::now();
+            try {
+                size_t size;
+                if(candidate.mArchive)
+                    size = candidate.mArchive->getDataSize();
+                else
+                {
+                    std::ifstream file(candidate.mPath.c_str(), std::ios_base::binary | std::ios_base::ate);
+                    size = file.is_open() ? (size_t)file.tellg() : 0;
+                }
+
+                if(total+size <= budget)
+                {
+                    if(candidate.mArchive)
+                        info.mBytes = candidate.mArchive->loadResident();
+                    else
+                    {
+                        DataPtr data = read_file(candidate.mName.c_str());
+                        if(!data) throw std::runtime_error("Failed to read "+candidate.mPath);
+                        info.mBytes = data->size();
+                        std::lock_guard<std::mutex> lock(gResidentMutex);
+                        gResidentFiles[candidate.mName] = std::move(data);
+                    }
+                    info.mSkipped = false;
+                    total += info.mBytes;
+                }
+            }
+            catch(std::exception&) {
+                // Out of memory or a read error, leave it to load from disk.
+            }
+            auto end = std::chrono::steady_clock::now();
+            info.mMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+
+            std::lock_guard<std::mutex> lock(gResidentMutex);
+            gResidentInfo.push_back(std::move(info));
+        }
+    });
+}
+
+void Manager::dropResident()
+{
+    gResidentLoader.stop();
+
+    for(const std::unique_ptr<Archives::Archive> &archive : gArchives)
+        static_cast<Archives::BsaArchive*>(archive.get())->dropResident();
+    gArchitecture.dropResident();
+    gSound.dropResident();
 
-    return false;
+    std::lock_guard<std::mutex> lock(gResidentMutex);
+    gResidentFiles.clear();
+    gResidentInfo.clear();
+}
+
+bool Manager::isResidentLoading() const
+{
+    return gResidentLoader.isBusy();
+}
+
+std::vector<ResidentInfo> Manager::getResidentInfo() const
+{
+    std::lock_guard<std::mutex> lock(gResidentMutex);
+    return gResidentInfo;
 }
 
 
-void Manager::add_dir(const std::string &path, const std::string &pre, const char *pattern, std::set<std::string> &names)
+bool Manager::startTrace(const std::string &fname)
+{
+    std::shared_ptr<AccessTrace> trace = std::make_shared<AccessTrace>();
+    if(!trace->open(fname))
+        return false;
+
+    trace = std::atomic_exchange(&gTrace, trace);
+    if(trace) trace->close();
+    return true;
+}
+
+void Manager::stopTrace()
+{
+    std::shared_ptr<AccessTrace> trace = std::atomic_exchange(&gTrace, std::shared_ptr<AccessTrace>());
+    if(trace) trace->close();
+}
+
+bool Manager::isTracing() const
+{
+    return !!std::atomic_load(&gTrace);
+}
+
+bool Manager::exists(const char *name)
+{
+    return gFileIndex.find(normalize_name(name)) != gFileIndex.end();
+}
+
+bool Manager::getSource(const char *name, SourceInfo &info) const
+{
+    auto iter = gFileIndex.find(normalize_name(name));
+    if(iter == gFileIndex.end())
+        return false;
+
+    const FileLocation &loc = iter->second;
+    info.mPath = loc.mArchive ? loc.mArchive->getFilename() : loc.mPath;
+
+    struct stat st;
+    if(stat(info.mPath.c_str(), &st) != 0)
+        return false;
+    info.mSize = st.st_size;
+    info.mModTime = st.st_mtime;
+    return true;
+}
+
+
+void Manager::add_dir(const std::string &path, const std::string &pre, std::map<std::string,std::string> &files)
 {
     DIR *dir = opendir(path.c_str());
     if(!dir) return;
@@ -142,17 +769,20 @@ void Manager::add_dir(const std::string &path, const std::string &pre, const cha
         if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
             continue;
 
-        if(!S_ISDIR(ent->d_type))
+        std::string newpath = path+"/"+ent->d_name;
+        bool isdir = (ent->d_type == DT_DIR);
+        if(ent->d_type == DT_UNKNOWN)
         {
-            std::string fname = pre + ent->d_name;
-            if(!pattern || fnmatch(pattern, fname.c_str(), 0) == 0)
-                names.insert(fname);
+            struct stat st;
+            isdir = (stat(newpath.c_str(), &st) == 0 && S_ISDIR(st.st_mode));
         }
+
+        if(!isdir)
+            files[pre + ent->d_name] = std::move(newpath);
         else
         {
-            std::string newpath = path+"/"+ent->d_name;
             std::string newpre = pre+ent->d_name+"/";
-            add_dir(newpath, newpre, pattern, names);
+            add_dir(newpath, newpre, files);
         }
     }
 
@@ -161,26 +791,26 @@ void Manager::add_dir(const std::string &path, const std::string &pre, const cha
 
 std::set<std::string> Manager::list(const char *pattern) const
 {
-    std::set<std::string> files;
+    if(!pattern)
+        return std::set<std::string>(gSortedNames.begin(), gSortedNames.end());
 
-    auto piter = gRootPaths.rbegin();
-    while(piter != gRootPaths.rend())
+    std::string prefix = literal_prefix(pattern);
+    if(prefix.size() == strlen(pattern))
     {
-        add_dir(*piter+".", "", pattern, files);
-        ++piter;
+        std::set<std::string> files;
+        auto iter = gFileIndex.find(prefix);
+        if(iter != gFileIndex.end())
+            files.insert(iter->first);
+        return files;
     }
 
-    auto iter = gArchives.rbegin();
-    while(iter != gArchives.rend())
+    std::set<std::string> files;
+    auto iter = std::lower_bound(gSortedNames.begin(), gSortedNames.end(), prefix, Archives::NameLess());
+    for(;iter != gSortedNames.end() && has_prefix_nocase(*iter, prefix);++iter)
     {
-        for(const std::string &name : (*iter)->list())
-        {
-            if(!pattern || fnmatch(pattern, name.c_str(), 0) == 0)
-                files.insert(name);
-        }
-        ++iter;
+        if(fnmatch(pattern, iter->c_str(), FNM_CASEFOLD) == 0)
+            files.insert(*iter);
     }
-
     return files;
 }
 
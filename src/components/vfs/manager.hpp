@@ -6,6 +6,10 @@
 #include <memory>
 #include <string>
 #include <set>
+#include <map>
+#include <vector>
+
+#include "readpool.hpp"
 
 
 namespace VFS
@@ -13,29 +17,45 @@ namespace VFS
 
 typedef std::shared_ptr<std::istream> IStreamPtr;
 
-inline uint32_t read_le32(std::istream &stream)
-{
-    char buf[4];
-    if(!stream.read(buf, sizeof(buf)) || stream.gcount() != sizeof(buf))
-        return 0;
-    return ((uint32_t(buf[0]    )&0x000000ff) | (uint32_t(buf[1]<< 8)&0x0000ff00) |
-            (uint32_t(buf[2]<<16)&0x00ff0000) | (uint32_t(buf[3]<<24)&0xff000000));
-}
-
-inline uint16_t read_le16(std::istream &stream)
-{
-    char buf[2];
-    if(!stream.read(buf, sizeof(buf)) || stream.gcount() != sizeof(buf))
-        return 0;
-    return ((uint16_t(buf[0]   )&0x00ff) | (uint16_t(buf[1]<<8)&0xff00));
-}
+/* Startup cost and memory use of an archive or file loaded by
+ * Manager::makeResident. */
+struct ResidentInfo {
+    std::string mName;
+    size_t mBytes;
+    uint64_t mMicroseconds;
+    // Left on disk because it would exceed the memory budget, or failed to
+    // load.
+    bool mSkipped;
+};
+
+/* A file's data in memory, valid while mOwner is held. mOwner is null if the
+ * file doesn't exist. */
+struct DataView {
+    std::shared_ptr<const void> mOwner;
+    const char *mData;
+    size_t mSize;
 
+    DataView() : mData(nullptr), mSize(0) { }
+};
+
+/* Where a file in the VFS is stored on disk. */
+struct SourceInfo {
+    std::string mPath;
+    uint64_t mSize;
+    int64_t mModTime;
+};
 
 class Manager {
     Manager(const Manager&) = delete;
     Manager& operator=(const Manager&) = delete;
 
-    static void add_dir(const std::string &path, const std::string &pre, const char *pattern, std::set<std::string> &names);
+    /* Recursively adds the files in the given directory to the map, keyed by
+     * their name relative to the data path (with pre prepended), with the
+     * full path as the value. */
+    static void add_dir(const std::string &path, const std::string &pre, std::map<std::string,std::string> &files);
+    /* Adds the files in the given data path to the index. The sorted name
+     * list needs rebuilding after. */
+    static void add_path_to_index(const std::string &path);
 
     Manager();
 
@@ -43,12 +63,81 @@ public:
     void initialize(std::string&& root_path=std::string());
     void addDataPath(std::string&& path);
 
+    /* Rebuilds the file index from the archives and data paths. Needs to be
+     * called if the contents of the data paths change.
+     */
+    void rescan();
+
     IStreamPtr open(const char *name);
     IStreamPtr open(std::string&& name) { return open(name.c_str()); }
     IStreamPtr openSoundId(size_t id);
     IStreamPtr openArchId(size_t id);
 
+    /* Reads the whole file into memory. Returns null if it doesn't exist. */
+    DataPtr read(const char *name);
+    DataPtr read(const std::string &name) { return read(name.c_str()); }
+    DataPtr readArchId(size_t id);
+    /* Gets the whole file in memory without copying it where possible:
+     * entries in mapped or resident archives and resident files are used in
+     * place, and other loose files are mapped. Anything else is read as with
+     * read().
+     */
+    DataView view(const char *name);
+    DataView view(const std::string &name) { return view(name.c_str()); }
+
+    /* Reads a set of files whole, submitting all the reads at once (through
+     * io_uring, where available). Files that don't exist come back null.
+     * Prefetched files that have finished reading are taken as-is.
+     */
+    std::vector<DataPtr> readBatch(const std::vector<std::string> &names);
+    /* As readBatch, but returns streams over the read data. */
+    std::vector<IStreamPtr> openBatch(const std::vector<std::string> &names);
+
+    /* Queues the file to be read on the I/O threads. If the file was passed
+     * to prefetch(), the pending or completed request is returned instead.
+     * Must not be used while rescanning or adding data paths.
+     */
+    ReadRequest readAsync(std::string name, ReadPriority priority=ReadPriority_Normal);
+
+    /* Hints that the given files will be needed soon, so they can be read in
+     * the background. The results are held until claimed by read(),
+     * readBatch(), or readAsync(), or dropped with cancelPrefetch().
+     */
+    void prefetch(const std::vector<std::string> &names, ReadPriority priority=ReadPriority_Low);
+    void cancelPrefetch();
+
+    /* Reads the archives and loose files matching the given patterns (e.g.
+     * "BLOCKS.BSA", "TEXTURE.*") fully into memory on a background thread,
+     * after which they're opened without touching the disk. Anything that
+     * would go over budget bytes in total is left on disk. Must be called
+     * after all data paths are added.
+     */
+    void makeResident(const std::vector<std::string> &patterns, size_t budget);
+    void dropResident();
+    bool isResidentLoading() const;
+    std::vector<ResidentInfo> getResidentInfo() const;
+
+    /* Starts recording every open, read, and seek to the given CSV file (see
+     * AccessTrace). Only files opened after this are traced.
+     */
+    bool startTrace(const std::string &fname);
+    void stopTrace();
+    bool isTracing() const;
+
     bool exists(const char *name);
+
+    /* Gets the path, size, and modification time of the file on disk the
+     * named file comes from (its archive, for archived files), to tell when
+     * data derived from it is out of date. Returns false if it doesn't exist.
+     */
+    bool getSource(const char *name, SourceInfo &info) const;
+
+    /* Lists the files matching the glob pattern. Like every other lookup,
+     * matching ignores case, with or without wildcards, and names are listed
+     * with the spelling from their archive or data path. Patterns starting
+     * with a literal prefix (e.g. "MAPNAMES.[0-9]*") only check names with
+     * that prefix.
+     */
     std::set<std::string> list(const char *pattern=nullptr) const;
 
     static Manager &get()
@@ -0,0 +1,38 @@
+
+#include "readpool.hpp"
+
+
+namespace VFS
+{
+
+DataPtr ReadRequest::get() const
+{
+    try {
+        return mFuture.get();
+    }
+    catch(std::future_error &e) {
+        // Dropped by the pool stopping, same as being cancelled.
+        if(e.code() != std::future_errc::broken_promise)
+            throw;
+        return DataPtr();
+    }
+}
+
+
+ReadRequest ReadPool::submit(std::string name, ReadPriority priority)
+{
+    std::shared_ptr<std::atomic<bool>> cancelled = std::make_shared<std::atomic<bool>>(false);
+
+    ReadRequest request;
+    request.mCancelled = cancelled;
+    // The read priorities are in the same order as the task priorities.
+    request.mFuture = mPool.submit([this, name, cancelled]() -> DataPtr
+    {
+        if(*cancelled)
+            return DataPtr();
+        return mReadFunc(name);
+    }, static_cast<Misc::TaskPriority>(priority)).share();
+    return request;
+}
+
+} // namespace VFS
@@ -0,0 +1,76 @@
+#ifndef COMPONENTS_VFS_READPOOL_HPP
+#define COMPONENTS_VFS_READPOOL_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+#include <atomic>
+#include <functional>
+
+#include "misc/threadpool.hpp"
+
+
+namespace VFS
+{
+
+// A fully read, immutable file.
+typedef std::shared_ptr<const std::vector<char>> DataPtr;
+
+enum ReadPriority {
+    ReadPriority_Low,
+    ReadPriority_Normal,
+    ReadPriority_High
+};
+
+/* A handle to a queued read. The result is null if the file doesn't exist, or
+ * if the request was cancelled before it started.
+ */
+class ReadRequest {
+    std::shared_future<DataPtr> mFuture;
+    std::shared_ptr<std::atomic<bool>> mCancelled;
+
+    friend class ReadPool;
+
+public:
+    bool valid() const { return mFuture.valid(); }
+    bool ready() const
+    { return valid() && mFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+
+    // Blocks until the read completes.
+    DataPtr get() const;
+
+    void cancel() { if(mCancelled) *mCancelled = true; }
+};
+
+
+/* A small pool of I/O threads servicing read requests in priority order
+ * (FIFO within the same priority). Reads still queued when the pool is
+ * stopped come back null.
+ */
+class ReadPool {
+public:
+    typedef std::function<DataPtr(const std::string&)> ReadFunc;
+
+private:
+    ReadFunc mReadFunc;
+    // Declared after the read function, so the threads are stopped before
+    // it's destroyed.
+    Misc::ThreadPool mPool;
+
+    ReadPool(const ReadPool&) = delete;
+    ReadPool& operator=(const ReadPool&) = delete;
+
+public:
+    ReadPool(ReadFunc func) : mReadFunc(std::move(func)) { }
+
+    void start(size_t numthreads) { mPool.start(numthreads); }
+    // Cancels any queued reads and waits for the threads to finish.
+    void stop() { mPool.stop(); }
+
+    ReadRequest submit(std::string name, ReadPriority priority);
+};
+
+} // namespace VFS
+
+#endif /* COMPONENTS_VFS_READPOOL_HPP */
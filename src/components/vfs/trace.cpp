@@ -0,0 +1,121 @@
+
+#include "trace.hpp"
+
+
+namespace
+{
+
+std::string csvQuote(const std::string &str)
+{
+    if(str.find_first_of(",\"\n") == std::string::npos)
+        return str;
+
+    std::string ret(1, '"');
+    for(char c : str)
+    {
+        if(c == '"') ret += '"';
+        ret += (c == '\n') ? ' ' : c;
+    }
+    ret += '"';
+    return ret;
+}
+
+} // namespace
+
+namespace VFS
+{
+
+bool AccessTrace::open(const std::string &fname)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mFile.open(fname.c_str(), std::ios_base::binary);
+    if(!mFile.is_open())
+        return false;
+
+    mStart = std::chrono::steady_clock::now();
+    mFile<< "time_us,stream,op,archive,name,offset,bytes,duration_us\n";
+    return true;
+}
+
+void AccessTrace::close()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    if(mFile.is_open())
+        mFile.close();
+}
+
+uint64_t AccessTrace::now() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - mStart
+    ).count();
+}
+
+void AccessTrace::record(uint64_t start, uint64_t stream, const char *op, const std::string &archive,
+                         const std::string &name, std::streamoff offset, std::streamsize bytes)
+{
+    uint64_t end = now();
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    if(!mFile.is_open()) return;
+    mFile<< start<<","<<stream<<","<<op<<","<<csvQuote(archive)<<","<<csvQuote(name)<<","<<offset<<","<<bytes<<","<<(end-start)<<"\n";
+}
+
+
+TraceStreamBuf::TraceStreamBuf(std::shared_ptr<AccessTrace> trace, IStreamPtr stream, uint64_t id)
+  : mTrace(std::move(trace)), mStream(std::move(stream)), mId(id)
+{
+}
+
+TraceStreamBuf::~TraceStreamBuf()
+{
+    mTrace->record(mTrace->now(), mId, "close", std::string(), std::string(), -1, 0);
+}
+
+TraceStreamBuf::int_type TraceStreamBuf::underflow()
+{
+    return mStream->peek();
+}
+
+TraceStreamBuf::int_type TraceStreamBuf::uflow()
+{
+    uint64_t start = mTrace->now();
+    std::streamoff offset = mStream->tellg();
+    int_type ret = mStream->get();
+    mTrace->record(start, mId, "read", std::string(), std::string(), offset,
+                   traits_type::eq_int_type(ret, traits_type::eof()) ? 0 : 1);
+    return ret;
+}
+
+std::streamsize TraceStreamBuf::xsgetn(char_type *s, std::streamsize count)
+{
+    uint64_t start = mTrace->now();
+    std::streamoff offset = mStream->tellg();
+    mStream->read(s, count);
+    std::streamsize got = mStream->gcount();
+    mTrace->record(start, mId, "read", std::string(), std::string(), offset, got);
+    return got;
+}
+
+TraceStreamBuf::pos_type TraceStreamBuf::seekoff(off_type offset, std::ios_base::seekdir whence, std::ios_base::openmode mode)
+{
+    if((mode&std::ios_base::out) || !(mode&std::ios_base::in))
+        return traits_type::eof();
+
+    uint64_t start = mTrace->now();
+    mStream->clear();
+    if(!mStream->seekg(offset, whence))
+        return traits_type::eof();
+    pos_type pos = mStream->tellg();
+    // Don't record tellg() calls.
+    if(whence != std::ios_base::cur || offset != 0)
+        mTrace->record(start, mId, "seek", std::string(), std::string(), pos, 0);
+    return pos;
+}
+
+TraceStreamBuf::pos_type TraceStreamBuf::seekpos(pos_type pos, std::ios_base::openmode mode)
+{
+    return seekoff(pos, std::ios_base::beg, mode);
+}
+
+} // namespace VFS
@@ -0,0 +1,86 @@
+#ifndef COMPONENTS_VFS_TRACE_HPP
+#define COMPONENTS_VFS_TRACE_HPP
+
+#include <string>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "manager.hpp"
+
+
+namespace VFS
+{
+
+/* Records file accesses to a CSV file, one line per operation:
+ *
+ * time_us,stream,op,archive,name,offset,bytes,duration_us
+ *
+ * where time_us is the time since the trace started, stream is a unique ID
+ * for each opened file, and op is one of open, read, seek, or close. The
+ * archive and name columns are only filled in for open; archive is empty for
+ * loose files (in which case name is the file's path), and name is the entry
+ * ID for archives addressed by ID. offset is the position in the file before
+ * the operation (or the target position, for seeks). Names with commas or
+ * quotes are quoted, with quotes doubled.
+ */
+class AccessTrace {
+    std::ofstream mFile;
+    std::mutex mMutex;
+    std::chrono::steady_clock::time_point mStart;
+    std::atomic<uint64_t> mNextStream;
+
+public:
+    AccessTrace() : mNextStream(1) { }
+
+    bool open(const std::string &fname);
+    void close();
+
+    uint64_t now() const;
+    uint64_t nextStreamId() { return mNextStream++; }
+
+    void record(uint64_t start, uint64_t stream, const char *op, const std::string &archive,
+                const std::string &name, std::streamoff offset, std::streamsize bytes);
+};
+
+
+/* Wraps a stream, recording each open, read, and seek operation to a trace.
+ * Reads aren't buffered here so the recorded pattern matches what the caller
+ * requested.
+ */
+class TraceStreamBuf : public std::streambuf {
+    std::shared_ptr<AccessTrace> mTrace;
+    IStreamPtr mStream;
+    uint64_t mId;
+
+public:
+    TraceStreamBuf(std::shared_ptr<AccessTrace> trace, IStreamPtr stream, uint64_t id);
+    ~TraceStreamBuf();
+
+    virtual int_type underflow();
+    virtual int_type uflow();
+    virtual std::streamsize xsgetn(char_type *s, std::streamsize count);
+
+    virtual pos_type seekoff(off_type offset, std::ios_base::seekdir whence, std::ios_base::openmode mode);
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode mode);
+};
+
+class TraceStream : public std::istream {
+public:
+    TraceStream(std::shared_ptr<AccessTrace> trace, IStreamPtr stream, uint64_t id)
+        : std::istream(new TraceStreamBuf(std::move(trace), std::move(stream), id))
+    {
+    }
+
+    ~TraceStream()
+    {
+        delete rdbuf();
+    }
+};
+
+} // namespace VFS
+
+#endif /* COMPONENTS_VFS_TRACE_HPP */
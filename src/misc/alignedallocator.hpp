@@ -0,0 +1,59 @@
+#ifndef MISC_ALIGNEDALLOCATOR_HPP
+#define MISC_ALIGNEDALLOCATOR_HPP
+
+#include <new>
+#include <cstddef>
+#include <stdint.h>
+
+
+namespace Misc
+{
+
+/* An allocator for containers whose storage should start on an Align-byte
+ * boundary, e.g. a cache line. Align must be a power of two, at least the
+ * size of a pointer.
+ *
+ * Each block is over-allocated by Align bytes, and the pointer to the start
+ * of the real allocation is kept just before the aligned storage.
+ */
+template<typename T, size_t Align>
+class AlignedAllocator {
+    static_assert((Align & (Align-1)) == 0, "Alignment must be a power of two");
+    static_assert(Align >= sizeof(void*) && Align >= alignof(T), "Alignment is too small");
+
+public:
+    typedef T value_type;
+
+    template<typename U>
+    struct rebind { typedef AlignedAllocator<U,Align> other; };
+
+    AlignedAllocator() { }
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U,Align>&) { }
+
+    T *allocate(size_t count)
+    {
+        if(count > (size_t(-1)-Align) / sizeof(T))
+            throw std::bad_alloc();
+
+        char *base = static_cast<char*>(::operator new(count*sizeof(T) + Align));
+        uintptr_t addr = (reinterpret_cast<uintptr_t>(base) + Align) & ~uintptr_t(Align-1);
+        void **ptr = reinterpret_cast<void**>(addr);
+        ptr[-1] = base;
+        return reinterpret_cast<T*>(ptr);
+    }
+
+    void deallocate(T *ptr, size_t)
+    {
+        if(ptr) ::operator delete(reinterpret_cast<void**>(ptr)[-1]);
+    }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U,Align>&) const { return true; }
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U,Align>&) const { return false; }
+};
+
+} // namespace Misc
+
+#endif /* MISC_ALIGNEDALLOCATOR_HPP */
@@ -0,0 +1,149 @@
+#ifndef MISC_BINARYREADER_HPP
+#define MISC_BINARYREADER_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace Misc
+{
+
+inline uint32_t read_le32(std::istream &stream)
+{
+    char buf[4];
+    if(!stream.read(buf, sizeof(buf)) || stream.gcount() != sizeof(buf))
+        return 0;
+    return ((uint32_t(buf[0]    )&0x000000ff) | (uint32_t(buf[1]<< 8)&0x0000ff00) |
+            (uint32_t(buf[2]<<16)&0x00ff0000) | (uint32_t(buf[3]<<24)&0xff000000));
+}
+
+inline uint16_t read_le16(std::istream &stream)
+{
+    char buf[2];
+    if(!stream.read(buf, sizeof(buf)) || stream.gcount() != sizeof(buf))
+        return 0;
+    return ((uint16_t(buf[0]   )&0x00ff) | (uint16_t(buf[1]<<8)&0xff00));
+}
+
+
+/* Reads little-endian values from a block of memory, such as a file read
+ * whole or an archive mapping. Unlike reading from a stream, every read is
+ * bounds-checked, throwing std::runtime_error when going past the end rather
+ * than silently returning 0. The reader doesn't own the data.
+ */
+class BinaryReader {
+    const unsigned char *mBegin;
+    const unsigned char *mPos;
+    const unsigned char *mEnd;
+
+    void check(size_t count) const
+    {
+        if(count > size_t(mEnd - mPos))
+            throw std::runtime_error("Read of "+std::to_string(count)+" bytes at offset "+
+                                     std::to_string(tell())+" past end of data ("+
+                                     std::to_string(size())+" bytes)");
+    }
+
+public:
+    BinaryReader(const char *data, size_t size)
+      : mBegin(reinterpret_cast<const unsigned char*>(data)), mPos(mBegin), mEnd(mBegin+size)
+    { }
+    explicit BinaryReader(const std::vector<char> &data)
+      : BinaryReader(data.data(), data.size())
+    { }
+
+    size_t size() const { return mEnd - mBegin; }
+    size_t tell() const { return mPos - mBegin; }
+    size_t remaining() const { return mEnd - mPos; }
+    bool eof() const { return mPos == mEnd; }
+
+    void seek(size_t pos)
+    {
+        if(pos > size())
+            throw std::runtime_error("Seek to offset "+std::to_string(pos)+" past end of data ("+
+                                     std::to_string(size())+" bytes)");
+        mPos = mBegin + pos;
+    }
+    void skip(size_t count)
+    {
+        check(count);
+        mPos += count;
+    }
+
+    /* Returns the next count bytes and moves past them, so a fixed-size
+     * record can be decoded with a single bounds check. */
+    const unsigned char *take(size_t count)
+    {
+        check(count);
+        const unsigned char *ptr = mPos;
+        mPos += count;
+        return ptr;
+    }
+
+    uint8_t read8()
+    {
+        check(1);
+        return *(mPos++);
+    }
+    uint16_t read16()
+    {
+        check(2);
+        uint16_t val = mPos[0] | (mPos[1]<<8);
+        mPos += 2;
+        return val;
+    }
+    uint32_t read32()
+    {
+        check(4);
+        uint32_t val = uint32_t(mPos[0]) | (uint32_t(mPos[1])<<8) |
+                       (uint32_t(mPos[2])<<16) | (uint32_t(mPos[3])<<24);
+        mPos += 4;
+        return val;
+    }
+    uint64_t read64()
+    {
+        uint64_t lo = read32();
+        uint64_t hi = read32();
+        return lo | (hi<<32);
+    }
+
+    /* Bulk reads. Raw bytes are copied as-is, while 16- and 32-bit values are
+     * converted from little-endian as needed. */
+    void read(void *dst, size_t count)
+    {
+        check(count);
+        memcpy(dst, mPos, count);
+        mPos += count;
+    }
+    void read16(uint16_t *dst, size_t count)
+    {
+        check(count*2);
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_WIN32)
+        memcpy(dst, mPos, count*2);
+        mPos += count*2;
+#else
+        for(size_t i = 0;i < count;++i)
+            dst[i] = read16();
+#endif
+    }
+    void read32(uint32_t *dst, size_t count)
+    {
+        check(count*4);
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_WIN32)
+        memcpy(dst, mPos, count*4);
+        mPos += count*4;
+#else
+        for(size_t i = 0;i < count;++i)
+            dst[i] = read32();
+#endif
+    }
+};
+
+} // namespace Misc
+
+#endif /* MISC_BINARYREADER_HPP */
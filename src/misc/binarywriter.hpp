@@ -0,0 +1,70 @@
+#ifndef MISC_BINARYWRITER_HPP
+#define MISC_BINARYWRITER_HPP
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace Misc
+{
+
+/* Appends little-endian values to a byte vector, the counterpart to
+ * BinaryReader.
+ */
+class BinaryWriter {
+    std::vector<char> &mData;
+
+public:
+    explicit BinaryWriter(std::vector<char> &data) : mData(data) { }
+
+    size_t tell() const { return mData.size(); }
+
+    /* Extends the data by count bytes, returning a pointer to fill them in.
+     * The pointer is invalidated by the next write. */
+    unsigned char *append(size_t count)
+    {
+        size_t pos = mData.size();
+        mData.resize(pos + count);
+        return reinterpret_cast<unsigned char*>(&mData[pos]);
+    }
+
+    void write8(uint8_t val)
+    {
+        mData.push_back(char(val));
+    }
+    void write16(uint16_t val)
+    {
+        unsigned char *dst = append(2);
+        dst[0] = val; dst[1] = val>>8;
+    }
+    void write32(uint32_t val)
+    {
+        unsigned char *dst = append(4);
+        dst[0] = val; dst[1] = val>>8; dst[2] = val>>16; dst[3] = val>>24;
+    }
+    void write64(uint64_t val)
+    {
+        write32(uint32_t(val));
+        write32(uint32_t(val>>32));
+    }
+    void write(const void *src, size_t count)
+    {
+        if(count > 0)
+            memcpy(append(count), src, count);
+    }
+
+    /* Overwrites a previously written 32-bit value, e.g. a size that wasn't
+     * known until later. */
+    void patch32(size_t pos, uint32_t val)
+    {
+        unsigned char *dst = reinterpret_cast<unsigned char*>(mData.data()) + pos;
+        dst[0] = val; dst[1] = val>>8; dst[2] = val>>16; dst[3] = val>>24;
+    }
+};
+
+} // namespace Misc
+
+#endif /* MISC_BINARYWRITER_HPP */
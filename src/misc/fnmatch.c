@@ -31,6 +31,7 @@ Library General Public License for more details.  */
 /* #include <ansidecl.h> */
 /* @) */
 #include <errno.h>
+#include <ctype.h>
 #include "fnmatch.h"
 
 #if !defined(__GNU_LIBRARY__) && !defined(STDC_HEADERS) && !defined(_MSC_VER)
@@ -45,6 +46,10 @@ fnmatch (const char *pattern, const char *string, int flags)
   register const char *p = pattern, *n = string;
   register char c;
 
+/* Note that this evaluates C many times.  */
+#define FOLD(c)	((flags & FNM_CASEFOLD) && isupper ((unsigned char) (c)) \
+		 ? tolower ((unsigned char) (c)) : (c))
+
   if ((flags & ~__FNM_FLAGS) != 0)
     {
       errno = EINVAL;
@@ -68,7 +73,7 @@ fnmatch (const char *pattern, const char *string, int flags)
 	case '\\':
 	  if (!(flags & FNM_NOESCAPE))
 	    c = *p++;
-	  if (*n != c)
+	  if (FOLD (*n) != FOLD (c))
 	    return FNM_NOMATCH;
 	  break;
 	  
@@ -87,8 +92,9 @@ fnmatch (const char *pattern, const char *string, int flags)
 	  
 	  {
 	    char c1 = (!(flags & FNM_NOESCAPE) && c == '\\') ? *p : c;
+	    c1 = FOLD (c1);
 	    for (--p; *n != '\0'; ++n)
-	      if ((c == '[' || *n == c1) &&
+	      if ((c == '[' || FOLD (*n) == c1) &&
 		  fnmatch(p, n, flags & ~FNM_PERIOD) == 0)
 		return 0;
 	    return FNM_NOMATCH;
@@ -118,6 +124,8 @@ fnmatch (const char *pattern, const char *string, int flags)
 		if (!(flags & FNM_NOESCAPE) && c == '\\')
 		  cstart = cend = *p++;
 		
+		cstart = cend = FOLD (cstart);
+		
 		if (c == '\0')
 		  /* [ (unterminated) loses.  */
 		  return FNM_NOMATCH;
@@ -135,10 +143,11 @@ fnmatch (const char *pattern, const char *string, int flags)
 		      cend = *p++;
 		    if (cend == '\0')
 		      return FNM_NOMATCH;
+		    cend = FOLD (cend);
 		    c = *p++;
 		  }
 		
-		if (*n >= cstart && *n <= cend)
+		if (FOLD (*n) >= cstart && FOLD (*n) <= cend)
 		  goto matched;
 		
 		if (c == ']')
@@ -167,7 +176,7 @@ fnmatch (const char *pattern, const char *string, int flags)
 	  break;
 	  
 	default:
-	  if (FOLD_FN_CHAR (c) != FOLD_FN_CHAR (*n))
+	  if (FOLD_FN_CHAR (FOLD (c)) != FOLD_FN_CHAR (FOLD (*n)))
 	    return FNM_NOMATCH;
 	}
       
@@ -179,3 +188,5 @@ fnmatch (const char *pattern, const char *string, int flags)
 
   return FNM_NOMATCH;
 }
+
+#undef FOLD
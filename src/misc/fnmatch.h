@@ -26,8 +26,10 @@ extern "C" {
 #define	FNM_NOESCAPE	(1 << 1)/* Backslashes don't quote special chars.  */
 #undef FNM_PERIOD
 #define	FNM_PERIOD	(1 << 2)/* Leading `.' is matched only explicitly.  */
+#undef FNM_CASEFOLD
+#define	FNM_CASEFOLD	(1 << 4)/* Compare without regard to case.  */
 #undef __FNM_FLAGS
-#define	__FNM_FLAGS	(FNM_PATHNAME|FNM_NOESCAPE|FNM_PERIOD)
+#define	__FNM_FLAGS	(FNM_PATHNAME|FNM_NOESCAPE|FNM_PERIOD|FNM_CASEFOLD)
 
 /* Value returned by `fnmatch' if STRING does not match PATTERN.  */
 #undef FNM_NOMATCH
@@ -0,0 +1,166 @@
+#include "nameindex.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace
+{
+
+inline unsigned char foldCase(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (c - 'A' + 'a') : c;
+}
+
+/* Compares the first len characters ignoring case, like strncasecmp but
+ * without depending on the locale. */
+int compareNoCase(const char *lhs, const char *rhs, size_t len)
+{
+    for(size_t i = 0;i < len;++i)
+    {
+        unsigned char l = foldCase(lhs[i]);
+        unsigned char r = foldCase(rhs[i]);
+        if(l != r) return (l < r) ? -1 : 1;
+    }
+    return 0;
+}
+
+int compareNoCase(const std::string &lhs, const std::string &rhs)
+{
+    int cmp = compareNoCase(lhs.data(), rhs.data(), std::min(lhs.size(), rhs.size()));
+    if(cmp != 0) return cmp;
+    return (lhs.size() < rhs.size()) ? -1 : (lhs.size() > rhs.size()) ? 1 : 0;
+}
+
+} // namespace
+
+
+namespace Misc
+{
+
+size_t NameIndex::hash(const char *str, size_t len)
+{
+    // FNV-1a
+    uint32_t val = 2166136261u;
+    for(size_t i = 0;i < len;++i)
+    {
+        val ^= foldCase(str[i]);
+        val *= 16777619u;
+    }
+    return val;
+}
+
+
+void NameIndex::clear()
+{
+    mEntries.clear();
+    mBuckets.clear();
+}
+
+void NameIndex::add(std::string name, uint32_t value)
+{
+    Entry entry;
+    entry.mName = std::move(name);
+    entry.mValue = value;
+    mEntries.push_back(std::move(entry));
+}
+
+void NameIndex::build()
+{
+    std::stable_sort(mEntries.begin(), mEntries.end(),
+        [](const Entry &lhs, const Entry &rhs) -> bool
+        { return compareNoCase(lhs.mName, rhs.mName) < 0; }
+    );
+
+    // Keep the table at most half full, so probe sequences stay short.
+    size_t numbuckets = 16;
+    while(numbuckets < mEntries.size()*2)
+        numbuckets <<= 1;
+    mBuckets.assign(numbuckets, 0);
+
+    for(size_t i = 0;i < mEntries.size();++i)
+    {
+        const std::string &name = mEntries[i].mName;
+        if(i > 0 && compareNoCase(mEntries[i-1].mName, name) == 0)
+            continue;
+
+        size_t slot = hash(name.data(), name.size()) & (numbuckets-1);
+        while(mBuckets[slot] != 0)
+            slot = (slot+1) & (numbuckets-1);
+        mBuckets[slot] = i+1;
+    }
+}
+
+
+NameIndex::range NameIndex::find(const std::string &name) const
+{
+    if(mBuckets.empty())
+        return range(end(), end());
+
+    size_t mask = mBuckets.size()-1;
+    size_t slot = hash(name.data(), name.size()) & mask;
+    while(mBuckets[slot] != 0)
+    {
+        iterator first = mEntries.begin() + (mBuckets[slot]-1);
+        if(first->mName.size() == name.size() &&
+           compareNoCase(first->mName.data(), name.data(), name.size()) == 0)
+        {
+            iterator last = first+1;
+            while(last != end() && compareNoCase(last->mName, name) == 0)
+                ++last;
+            return range(first, last);
+        }
+        slot = (slot+1) & mask;
+    }
+    return range(end(), end());
+}
+
+NameIndex::range NameIndex::findPrefix(const std::string &prefix) const
+{
+    // Names starting with the prefix sort together, since the prefix sorts
+    // before them and anything after them differs within its length.
+    iterator first = std::lower_bound(begin(), end(), prefix,
+        [](const Entry &entry, const std::string &pfx) -> bool
+        { return compareNoCase(entry.mName, pfx) < 0; }
+    );
+    iterator last = std::upper_bound(first, end(), prefix,
+        [](const std::string &pfx, const Entry &entry) -> bool
+        {
+            size_t len = std::min(entry.mName.size(), pfx.size());
+            return compareNoCase(pfx.data(), entry.mName.data(), len) < 0;
+        }
+    );
+    return range(first, last);
+}
+
+size_t NameIndex::findSubstring(const std::string &text, std::vector<iterator> &matches, size_t limit) const
+{
+    size_t count = 0;
+    for(iterator iter = begin();iter != end();++iter)
+    {
+        const std::string &name = iter->mName;
+        if(name.size() < text.size())
+            continue;
+        for(size_t pos = 0;pos <= name.size()-text.size();++pos)
+        {
+            if(compareNoCase(name.data()+pos, text.data(), text.size()) == 0)
+            {
+                if(count++ < limit)
+                    matches.push_back(iter);
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+
+size_t NameIndex::getMemoryUsage() const
+{
+    size_t total = mEntries.capacity()*sizeof(Entry) + mBuckets.capacity()*sizeof(uint32_t);
+    for(const Entry &entry : mEntries)
+        total += entry.mName.capacity();
+    return total;
+}
+
+} // namespace Misc
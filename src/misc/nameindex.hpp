@@ -0,0 +1,61 @@
+#ifndef MISC_NAMEINDEX_HPP
+#define MISC_NAMEINDEX_HPP
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace Misc
+{
+
+/* An index of names, each with a value, looked up ignoring ASCII case. Exact
+ * lookups go through a hash table, and prefix lookups through the names kept
+ * sorted, so both avoid going through every name. The same name may be added
+ * more than once, in which case lookups give all of them, in the order they
+ * were added.
+ *
+ * Names are added with add(), then build() must be called before looking
+ * anything up.
+ */
+class NameIndex {
+public:
+    struct Entry {
+        std::string mName;
+        uint32_t mValue;
+    };
+    typedef std::vector<Entry>::const_iterator iterator;
+    typedef std::pair<iterator,iterator> range;
+
+private:
+    std::vector<Entry> mEntries;
+    // Open-addressed table of the first entry of each distinct name, plus
+    // one, or 0 for an empty slot.
+    std::vector<uint32_t> mBuckets;
+
+    static size_t hash(const char *str, size_t len);
+
+public:
+    void clear();
+    void reserve(size_t count) { mEntries.reserve(count); }
+    void add(std::string name, uint32_t value);
+    void build();
+
+    size_t size() const { return mEntries.size(); }
+    iterator begin() const { return mEntries.begin(); }
+    iterator end() const { return mEntries.end(); }
+
+    range find(const std::string &name) const;
+    range findPrefix(const std::string &prefix) const;
+    /* Finds names containing the given text anywhere, storing up to limit of
+     * them. Returns the total number found. This checks every name. */
+    size_t findSubstring(const std::string &text, std::vector<iterator> &matches, size_t limit) const;
+
+    size_t getMemoryUsage() const;
+};
+
+} // namespace Misc
+
+#endif /* MISC_NAMEINDEX_HPP */
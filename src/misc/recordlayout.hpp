@@ -0,0 +1,218 @@
+#ifndef MISC_RECORDLAYOUT_HPP
+#define MISC_RECORDLAYOUT_HPP
+
+#include <type_traits>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+
+#include "binaryreader.hpp"
+#include "binarywriter.hpp"
+
+
+namespace Misc
+{
+
+/* How a field is shown when a record is dumped. */
+enum FieldFormat {
+    Field_Dec,
+    Field_Hex,
+    Field_String, /* NUL-padded character array */
+    Field_Hidden  /* Decoded, but not dumped */
+};
+
+template<typename T>
+inline T fromLittleEndian(const unsigned char *src)
+{
+    typedef typename std::make_unsigned<T>::type U;
+    U val = 0;
+    for(size_t i = 0;i < sizeof(T);++i)
+        val |= U(U(src[i]) << (i*8));
+    return T(val);
+}
+
+template<typename T>
+inline void toLittleEndian(unsigned char *dst, T val)
+{
+    typedef typename std::make_unsigned<T>::type U;
+    for(size_t i = 0;i < sizeof(T);++i)
+        dst[i] = (unsigned char)(U(val) >> (i*8));
+}
+
+template<typename S, typename T>
+inline void printFieldValues(S &stream, const T *vals, size_t count, FieldFormat format)
+{
+    typedef typename std::make_unsigned<T>::type U;
+    for(size_t i = 0;i < count;++i)
+    {
+        if(format == Field_Hex)
+        {
+            // Formatted separately so the stream's fill and base are untouched
+            char hex[24];
+            snprintf(hex, sizeof(hex), " 0x%0*llx", int(sizeof(T)*2), (unsigned long long)U(vals[i]));
+            stream<< hex;
+        }
+        else
+            stream<< " "<<+vals[i];
+    }
+}
+
+template<typename S>
+inline void printFieldValues(S &stream, const char *vals, size_t count, FieldFormat format)
+{
+    if(format == Field_String)
+        stream<< " \""<<std::string(vals, strnlen(vals, count))<<"\"";
+    else
+        printFieldValues<S,char>(stream, vals, count, format);
+}
+
+
+/* Describes one on-disk field of record type R, stored in a member of type T.
+ * T is an integer type or a one-dimensional array of them, and its size is the
+ * size of the field on disk, stored little-endian.
+ */
+template<typename R, typename T>
+class Field {
+    typedef typename std::remove_extent<T>::type value_type;
+    static_assert(std::is_integral<value_type>::value && !std::is_array<value_type>::value,
+                  "Record fields must be integers or arrays of integers");
+
+    T R::*mMember;
+    const char *mName;
+    FieldFormat mFormat;
+
+public:
+    constexpr Field(T R::*member, const char *name, FieldFormat format)
+      : mMember(member), mName(name), mFormat(format)
+    { }
+
+    static constexpr size_t size() { return sizeof(T); }
+
+    template<typename U>
+    void decode(U &rec, const unsigned char *src) const
+    {
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_WIN32)
+        memcpy(&(rec.*mMember), src, sizeof(T));
+#else
+        value_type *dst = reinterpret_cast<value_type*>(&(rec.*mMember));
+        for(size_t i = 0;i < sizeof(T)/sizeof(value_type);++i)
+            dst[i] = fromLittleEndian<value_type>(src + i*sizeof(value_type));
+#endif
+    }
+
+    template<typename U>
+    void encode(const U &rec, unsigned char *dst) const
+    {
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_WIN32)
+        memcpy(dst, &(rec.*mMember), sizeof(T));
+#else
+        const value_type *src = reinterpret_cast<const value_type*>(&(rec.*mMember));
+        for(size_t i = 0;i < sizeof(T)/sizeof(value_type);++i)
+            toLittleEndian<value_type>(dst + i*sizeof(value_type), src[i]);
+#endif
+    }
+
+    template<typename S, typename U>
+    void print(S &stream, const U &rec, const char *indent) const
+    {
+        if(mFormat == Field_Hidden)
+            return;
+        stream<< indent<<mName<<":";
+        printFieldValues(stream, reinterpret_cast<const value_type*>(&(rec.*mMember)),
+                         sizeof(T)/sizeof(value_type), mFormat);
+        stream<< "\n";
+    }
+};
+
+template<typename R, typename T>
+constexpr Field<R,T> field(T R::*member, const char *name, FieldFormat format=Field_Dec)
+{
+    return Field<R,T>(member, name, format);
+}
+
+
+/* An ordered list of fields making up a fixed-size record. The record size is
+ * known at compile time, so a record is decoded with one bounds check and a
+ * series of fixed-size copies. Layouts are meant to be declared constexpr, so
+ * the member pointers fold into constant offsets.
+ */
+template<typename... Fields>
+class RecordLayout;
+
+template<>
+class RecordLayout<> {
+public:
+    constexpr RecordLayout() { }
+
+    static constexpr size_t size() { return 0; }
+
+    template<typename R>
+    void decode(R&, const unsigned char*) const { }
+
+    template<typename R>
+    void encode(const R&, unsigned char*) const { }
+
+    template<typename S, typename R>
+    void print(S&, const R&, const char*) const { }
+};
+
+template<typename F, typename... Rest>
+class RecordLayout<F, Rest...> {
+    F mField;
+    RecordLayout<Rest...> mRest;
+
+public:
+    constexpr RecordLayout(const F &field, const Rest&... rest)
+      : mField(field), mRest(rest...)
+    { }
+
+    static constexpr size_t size() { return F::size() + RecordLayout<Rest...>::size(); }
+
+    template<typename R>
+    void decode(R &rec, const unsigned char *src) const
+    {
+        mField.decode(rec, src);
+        mRest.decode(rec, src + F::size());
+    }
+
+    template<typename R>
+    void encode(const R &rec, unsigned char *dst) const
+    {
+        mField.encode(rec, dst);
+        mRest.encode(rec, dst + F::size());
+    }
+
+    template<typename R>
+    void read(BinaryReader &reader, R &rec) const
+    {
+        decode(rec, reader.take(size()));
+    }
+
+    /* Writes the record back out in the same format it's read in. */
+    template<typename R>
+    void write(BinaryWriter &writer, const R &rec) const
+    {
+        encode(rec, writer.append(size()));
+    }
+
+    /* Writes each field not marked hidden on its own line, as
+     * "<indent><name>: <values>". */
+    template<typename S, typename R>
+    void print(S &stream, const R &rec, const char *indent) const
+    {
+        mField.print(stream, rec, indent);
+        mRest.print(stream, rec, indent);
+    }
+};
+
+template<typename... Fields>
+constexpr RecordLayout<Fields...> layout(const Fields&... fields)
+{
+    return RecordLayout<Fields...>(fields...);
+}
+
+} // namespace Misc
+
+#endif /* MISC_RECORDLAYOUT_HPP */
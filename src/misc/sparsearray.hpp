@@ -103,6 +103,12 @@ public:
         mData.clear();
     }
 
+    void swap(SparseArray &other)
+    {
+        mIdxLookup.swap(other.mIdxLookup);
+        mData.swap(other.mData);
+    }
+
     bool exists(size_t idx) const
     { return lookupKey(idx) != mIdxLookup.end(); }
 
@@ -184,7 +190,7 @@ public:
     {
         auto iter = lookupKey(idx);
         if(iter == mIdxLookup.cend())
-            mData.end();
+            return mData.end();
 
         return mData.begin() + std::distance(mIdxLookup.cbegin(), iter);
     }
@@ -192,7 +198,7 @@ public:
     {
         auto iter = lookupKey(idx);
         if(iter == mIdxLookup.cend())
-            mData.cend();
+            return mData.cend();
 
         return mData.cbegin() + std::distance(mIdxLookup.cbegin(), iter);
     }
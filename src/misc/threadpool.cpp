@@ -0,0 +1,146 @@
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+
+namespace Misc
+{
+
+ThreadPool::ThreadPool()
+  : mSequence(0), mQuit(false)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+    stop();
+}
+
+
+void ThreadPool::start(size_t numthreads)
+{
+    if(numthreads == 0)
+        numthreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mQuit = false;
+    while(mThreads.size() < numthreads)
+        mThreads.push_back(std::thread(std::bind(&ThreadPool::worker, this)));
+}
+
+void ThreadPool::stop()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mQuit = true;
+    while(!mJobs.empty())
+        mJobs.pop();
+    lock.unlock();
+    mCondVar.notify_all();
+
+    for(std::thread &thread : mThreads)
+        thread.join();
+    mThreads.clear();
+}
+
+
+void ThreadPool::worker()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while(1)
+    {
+        mCondVar.wait(lock, [this]() -> bool { return mQuit || !mJobs.empty(); });
+        if(mQuit) break;
+
+        Job job = mJobs.top();
+        mJobs.pop();
+        lock.unlock();
+
+        // Exceptions are captured by the packaged_task.
+        job.mFunc();
+        // Release the task and what it holds before relocking, so it isn't
+        // destroyed under the pool's lock.
+        job.mFunc = nullptr;
+
+        lock.lock();
+    }
+}
+
+
+void ThreadPool::parallelFor(size_t count, std::function<void(size_t)> func, TaskPriority priority)
+{
+    struct State {
+        std::function<void(size_t)> mFunc;
+        size_t mCount;
+        std::atomic<size_t> mNext;
+
+        std::mutex mMutex;
+        std::condition_variable mCondVar;
+        size_t mFinished;
+        std::exception_ptr mError;
+
+        void run()
+        {
+            size_t idx;
+            while((idx = mNext++) < mCount)
+            {
+                std::exception_ptr error;
+                try {
+                    mFunc(idx);
+                }
+                catch(...) {
+                    error = std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> lock(mMutex);
+                if(error && !mError) mError = error;
+                if(++mFinished == mCount)
+                    mCondVar.notify_all();
+            }
+        }
+    };
+    if(count == 0)
+        return;
+
+    // Helpers that only start once everything's been taken just return, so
+    // the state is shared with them rather than left on the stack.
+    std::shared_ptr<State> state = std::make_shared<State>();
+    state->mFunc = std::move(func);
+    state->mCount = count;
+    state->mNext = 0;
+    state->mFinished = 0;
+
+    size_t helpers = std::min(count-1, getThreadCount());
+    for(size_t i = 0;i < helpers;++i)
+        push([state]() { state->run(); }, priority);
+    state->run();
+
+    std::unique_lock<std::mutex> lock(state->mMutex);
+    state->mCondVar.wait(lock, [&state]() -> bool { return state->mFinished == state->mCount; });
+    if(state->mError)
+        std::rethrow_exception(state->mError);
+}
+
+
+void ThreadPool::push(std::function<void()>&& func, TaskPriority priority)
+{
+    Job job;
+    job.mPriority = priority;
+    job.mFunc = std::move(func);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    if(mThreads.empty())
+    {
+        // Not started, so run it here rather than leave it waiting forever.
+        lock.unlock();
+        job.mFunc();
+        return;
+    }
+    job.mSequence = mSequence++;
+    mJobs.push(std::move(job));
+    lock.unlock();
+
+    mCondVar.notify_one();
+}
+
+} // namespace Misc
@@ -0,0 +1,90 @@
+#ifndef MISC_THREADPOOL_HPP
+#define MISC_THREADPOOL_HPP
+
+#include <vector>
+#include <memory>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <queue>
+#include <type_traits>
+#include <cstdint>
+
+
+namespace Misc
+{
+
+enum TaskPriority {
+    TaskPriority_Low,
+    TaskPriority_Normal,
+    TaskPriority_High
+};
+
+/* A pool of worker threads running queued tasks in priority order (FIFO
+ * within the same priority). A task's result, or the exception it threw, is
+ * delivered through the returned future. Tasks still queued when the pool is
+ * stopped are dropped, and their futures report a broken promise. Tasks
+ * submitted while the pool isn't running are run immediately by the caller.
+ */
+class ThreadPool {
+    struct Job {
+        TaskPriority mPriority;
+        uint64_t mSequence;
+        std::function<void()> mFunc;
+
+        bool operator<(const Job &rhs) const
+        {
+            if(mPriority != rhs.mPriority)
+                return mPriority < rhs.mPriority;
+            return mSequence > rhs.mSequence;
+        }
+    };
+
+    std::vector<std::thread> mThreads;
+    std::priority_queue<Job> mJobs;
+    uint64_t mSequence;
+    bool mQuit;
+
+    std::mutex mMutex;
+    std::condition_variable mCondVar;
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void worker();
+    void push(std::function<void()>&& func, TaskPriority priority);
+
+public:
+    ThreadPool();
+    ~ThreadPool();
+
+    // Starts numthreads workers, or one per hardware thread if 0.
+    void start(size_t numthreads=0);
+    // Drops any queued tasks and waits for running ones to finish.
+    void stop();
+
+    size_t getThreadCount() const { return mThreads.size(); }
+
+    template<typename F>
+    std::future<typename std::result_of<F()>::type> submit(F&& func, TaskPriority priority=TaskPriority_Normal)
+    {
+        typedef typename std::result_of<F()>::type R;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(func));
+        std::future<R> future = task->get_future();
+        push([task]() { (*task)(); }, priority);
+        return future;
+    }
+
+    /* Calls func for each index in [0, count), spread over the workers, and
+     * waits for them all. The calling thread takes indices too, so this is
+     * safe to use from a task without tying up the pool. The first exception
+     * thrown is rethrown here, once the rest are done.
+     */
+    void parallelFor(size_t count, std::function<void(size_t)> func, TaskPriority priority=TaskPriority_Normal);
+};
+
+} // namespace Misc
+
+#endif /* MISC_THREADPOOL_HPP */
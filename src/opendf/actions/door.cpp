@@ -86,4 +86,12 @@ void Door::update(float timediff)
 }
 
 
+void Door::swapObjects(Door &other)
+{
+    mClosed.swap(other.mClosed);
+    mOpening.swap(other.mOpening);
+    mOpened.swap(other.mOpened);
+    mClosing.swap(other.mClosing);
+}
+
 } // namespace DF
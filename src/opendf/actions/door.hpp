@@ -37,6 +37,8 @@ public:
 
     void update(float timediff);
 
+    void swapObjects(Door &other);
+
     static Door &get() { return sDoors; }
 };
 
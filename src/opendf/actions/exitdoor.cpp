@@ -45,4 +45,11 @@ void ExitDoor::update()
     }
 }
 
+
+void ExitDoor::swapObjects(ExitDoor &other)
+{
+    mExits.swap(other.mExits);
+    mActivatedExit.swap(other.mActivatedExit);
+}
+
 } // namespace DF
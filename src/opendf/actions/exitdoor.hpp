@@ -26,6 +26,8 @@ public:
 
     void update();
 
+    void swapObjects(ExitDoor &other);
+
     static ExitDoor &get() { return sExitDoors; }
 };
 
@@ -20,6 +20,7 @@ class Linker {
 
 public:
     void update();
+    void swapObjects(Linker &other) { mActive.swap(other.mActive); }
 
     static void activateFunc(size_t idx) { sLinkers.mActive[idx] = idx; }
     static void deallocateFunc(size_t idx) { sLinkers.mActive.erase(idx); }
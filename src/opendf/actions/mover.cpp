@@ -167,4 +167,18 @@ void Mover::update(float timediff)
     }
 }
 
+
+void Mover::swapObjects(Mover &other)
+{
+    mSoundIds.swap(other.mSoundIds);
+    mTranslateStart.swap(other.mTranslateStart);
+    mActiveTrans.swap(other.mActiveTrans);
+    mTranslateEnd.swap(other.mTranslateEnd);
+    mActiveTransRev.swap(other.mActiveTransRev);
+    mRotateStart.swap(other.mRotateStart);
+    mActiveRot.swap(other.mActiveRot);
+    mRotateEnd.swap(other.mRotateEnd);
+    mActiveRotRev.swap(other.mActiveRotRev);
+}
+
 } // namespace DF
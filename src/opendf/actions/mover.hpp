@@ -56,6 +56,8 @@ public:
 
     void update(float timediff);
 
+    void swapObjects(Mover &other);
+
     static Mover &get() { return sMovers; }
 };
 
@@ -54,4 +54,11 @@ void UnknownAction::update()
     }
 }
 
+
+void UnknownAction::swapObjects(UnknownAction &other)
+{
+    mUnknowns.swap(other.mUnknowns);
+    mActive.swap(other.mActive);
+}
+
 } // namespace DF
@@ -28,6 +28,8 @@ public:
 
     void update();
 
+    void swapObjects(UnknownAction &other);
+
     static UnknownAction &get() { return sActions; }
 };
 
@@ -67,4 +67,13 @@ void Activator::deactivate(size_t idx)
     }
 }
 
+
+void Activator::swapObjects(Activator &other)
+{
+    mDeallocators.swap(other.mDeallocators);
+    mFlags.swap(other.mFlags);
+    mInactive.swap(other.mInactive);
+    mActive.swap(other.mActive);
+}
+
 } // namespace DF
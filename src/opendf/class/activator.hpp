@@ -34,6 +34,8 @@ public:
     void activate(size_t idx);
     void deactivate(size_t idx);
 
+    void swapObjects(Activator &other);
+
     static Activator &get() { return sActivators; }
 };
 
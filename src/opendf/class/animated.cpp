@@ -38,4 +38,10 @@ void Animated::update(float timediff)
     }
 }
 
+
+void Animated::swapObjects(Animated &other)
+{
+    mAnimations.swap(other.mAnimations);
+}
+
 } // namespace DF
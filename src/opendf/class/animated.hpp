@@ -26,6 +26,8 @@ public:
 
     void update(float timediff);
 
+    void swapObjects(Animated &other);
+
     static Animated &get() { return sAnimated; }
 };
 
@@ -39,4 +39,10 @@ void Placeable::setPoint(size_t idx, const osg::Vec3f &pt)
     Renderer::get().markDirty(idx, pos);
 }
 
+
+void Placeable::swapObjects(Placeable &other)
+{
+    mPositions.swap(other.mPositions);
+}
+
 } // namespace DF
@@ -53,6 +53,10 @@ public:
 
     const Position &getPos(size_t idx) const { return mPositions.at(idx); };
 
+    /* Exchanges all object state with another instance, for setting a
+     * location's objects aside while it's not in use. */
+    void swapObjects(Placeable &other);
+
     static Placeable &get() { return sPlaceables; }
 };
 
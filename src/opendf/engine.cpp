@@ -126,6 +126,11 @@ namespace DF
 CVAR(CVarInt, vid_width, 1280, 0);
 CVAR(CVarInt, vid_height, 720, 0);
 CVAR(CVarBool, vid_fullscreen, false);
+CVAR(CVarString, vfs_tracefile, "");
+// Space-separated archives and files to hold in memory, e.g.
+// "BLOCKS.BSA ARCH3D.BSA TEXTURE.*"
+CVAR(CVarString, vfs_resident, "");
+CVAR(CVarInt, vfs_residentbudget, 512, 0); // MB
 
 CCMD(qqq)
 {
@@ -160,6 +165,53 @@ CCMD(savecfg)
     CVar::writeAll(ocfg);
 }
 
+CCMD(vfstrace)
+{
+    if(params.empty())
+    {
+        if(VFS::Manager::get().isTracing())
+            Log::get().message("VFS trace is running");
+        else
+            Log::get().message("VFS trace is not running");
+        Log::get().message("Usage: vfstrace <filename.csv|off>");
+        return;
+    }
+
+    if(params == "off")
+    {
+        VFS::Manager::get().stopTrace();
+        Log::get().message("Stopped VFS trace");
+    }
+    else if(!VFS::Manager::get().startTrace(params))
+        Log::get().stream(Log::Level_Error)<< "Failed to open "<<params<<" for VFS trace";
+    else
+        Log::get().stream()<< "Writing VFS trace to "<<params;
+}
+
+CCMD(vfsresident)
+{
+    std::vector<VFS::ResidentInfo> infos = VFS::Manager::get().getResidentInfo();
+    if(infos.empty())
+    {
+        Log::get().message("No files are held in memory (see vfs_resident)");
+        return;
+    }
+
+    size_t total = 0;
+    uint64_t usecs = 0;
+    for(const VFS::ResidentInfo &info : infos)
+    {
+        if(info.mSkipped)
+            Log::get().stream()<< "  "<<info.mName<<": left on disk";
+        else
+            Log::get().stream()<< "  "<<info.mName<<": "<<info.mBytes<<" bytes in "<<(info.mMicroseconds/1000)<<"ms";
+        total += info.mBytes;
+        usecs += info.mMicroseconds;
+    }
+    Log::get().stream()<< "Total: "<<total<<" bytes in "<<(usecs/1000)<<"ms"<<
+                          (VFS::Manager::get().isResidentLoading() ? " (still loading)" : "");
+}
+
 
 Engine::Engine(void)
   : mSDLWindow(nullptr)
@@ -386,6 +438,25 @@ bool Engine::go(void)
         }
     }
 
+    if(!vfs_tracefile->empty())
+    {
+        if(!VFS::Manager::get().startTrace(*vfs_tracefile))
+            Log::get().stream(Log::Level_Error)<< "Failed to open "<<*vfs_tracefile<<" for VFS trace";
+        else
+            Log::get().stream()<< "Writing VFS trace to "<<*vfs_tracefile;
+    }
+
+    if(!vfs_resident->empty())
+    {
+        std::vector<std::string> patterns;
+        std::istringstream sstr(*vfs_resident);
+        std::string pattern;
+        while(sstr >> pattern)
+            patterns.push_back(pattern);
+        Log::get().stream()<< "  Loading "<<*vfs_resident<<" into memory...";
+        VFS::Manager::get().makeResident(patterns, size_t(*vfs_residentbudget) << 20);
+    }
+
     // Configure
     osg::ref_ptr<osgViewer::Viewer> viewer;
     {
@@ -506,7 +577,25 @@ bool Engine::go(void)
 
     CVar::registerAll();
 
-    WorldIface::get().initialize(viewer, mSceneRoot);
+    {
+        // Goes alongside the user config, if there's somewhere to put it.
+        std::string cachefile;
+        std::string user_path = getUserConfigDir();
+        if(!user_path.empty())
+        {
+            user_path += "/opendf";
+            struct stat st;
+            try {
+                if(stat(user_path.c_str(), &st) != 0)
+                    makeDirRecurse(user_path);
+                cachefile = user_path+"/world.cache";
+            }
+            catch(std::exception &e) {
+                Log::get().stream(Log::Level_Error)<< e.what();
+            }
+        }
+        WorldIface::get().initialize(viewer, mSceneRoot, cachefile);
+    }
 
     // Region: Daggerfall, Location: Privateer's Hold
     WorldIface::get().loadDungeonByExterior(17, 179);
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <map>
+#include <algorithm>
 
 #include <MYGUI/MyGUI.h>
 
@@ -359,6 +360,7 @@ GuiIface &GuiIface::sInstance = Gui::sGui;
 Gui::Gui()
   : mGui(nullptr)
   , mStatusMessages(nullptr)
+  , mLoadProgress(nullptr)
   , mConsole(nullptr)
   , mActiveModes(0)
 {
@@ -412,6 +414,15 @@ void Gui::initialize(osgViewer::Viewer *viewer, osg::Group *sceneroot)
     mStatusMessages->setTextColour(MyGUI::Colour::White);
     mStatusMessages->setVisible(false);
 
+    mLoadProgress = mGui->createWidgetReal<MyGUI::TextBox>("TextBox",
+        MyGUI::FloatCoord(0.f, .9f, 1.f, .1f), MyGUI::Align::Default,
+        "Overlapped"
+    );
+    mLoadProgress->setTextAlign(MyGUI::Align::Center);
+    mLoadProgress->setTextShadow(true);
+    mLoadProgress->setTextColour(MyGUI::Colour::White);
+    mLoadProgress->setVisible(false);
+
     mConsole = new Console("Console.layout");
 }
 
@@ -422,6 +433,8 @@ void Gui::deinitialize()
 
     if(mGui)
     {
+        mGui->destroyWidget(mLoadProgress);
+        mLoadProgress = nullptr;
         mGui->destroyWidget(mStatusMessages);
         mStatusMessages = nullptr;
 
@@ -596,4 +609,16 @@ void Gui::updateStatus(std::string&& str)
     }
 }
 
+void Gui::updateLoadProgress(const std::string &name, float progress)
+{
+    if(name.empty())
+        mLoadProgress->setVisible(false);
+    else
+    {
+        int percent = std::min(std::max(int(progress*100.0f + 0.5f), 0), 100);
+        mLoadProgress->setCaption(MyGUI::UString("Loading "+name+"... "+std::to_string(percent)+"%"));
+        mLoadProgress->setVisible(true);
+    }
+}
+
 } // namespace DF
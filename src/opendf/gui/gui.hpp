@@ -31,6 +31,7 @@ class Gui : public GuiIface {
     MyGUI::Gui *mGui;
 
     MyGUI::TextBox *mStatusMessages;
+    MyGUI::TextBox *mLoadProgress;
 
     Console *mConsole;
 
@@ -64,6 +65,7 @@ public:
     virtual void injectTextInput(const char *text) final;
 
     virtual void updateStatus(std::string&& str) final;
+    virtual void updateLoadProgress(const std::string &name, float progress) final;
 
     void updateStatus(const std::string &str);
 };
@@ -67,6 +67,11 @@ public:
     virtual void injectTextInput(const char *text) = 0;
 
     virtual void updateStatus(std::string&& str) = 0;
+    /**
+     * Shows how far along loading the named location is, with \param progress
+     * in [0, 1]. An empty \param name hides it.
+     */
+    virtual void updateLoadProgress(const std::string &name, float progress) = 0;
 
     static GuiIface &get() { return sInstance; }
 };
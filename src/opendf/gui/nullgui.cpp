@@ -0,0 +1,11 @@
+
+#include "nullgui.hpp"
+
+
+namespace DF
+{
+
+NullGui NullGui::sGui;
+GuiIface &GuiIface::sInstance = NullGui::sGui;
+
+} // namespace DF
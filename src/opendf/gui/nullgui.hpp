@@ -0,0 +1,62 @@
+#ifndef GUI_NULLGUI_HPP
+#define GUI_NULLGUI_HPP
+
+#include <vector>
+#include <string>
+
+#include "iface.hpp"
+
+
+namespace DF
+{
+
+/* Stands in for the GUI, which needs a window. Messages that get through the
+ * log level are kept, to go with the location being loaded.
+ */
+class NullGui : public GuiIface {
+    std::vector<std::string> mMessages;
+
+public:
+    static NullGui sGui;
+
+    virtual void initialize(osgViewer::Viewer*, osg::Group*) final { }
+    virtual void deinitialize() final { }
+
+    virtual void printToConsole(const std::string &str) final { mMessages.push_back(str); }
+
+    virtual void addConsoleCallback(const char*, CommandDelegateT*) final { }
+
+    virtual void pushMode(Mode) final { }
+    virtual void popMode(Mode) final { }
+    virtual bool testMode(Mode mode) const final { return mode == Mode_Game; }
+    virtual Mode getMode() const final { return Mode_Game; }
+
+    virtual void getMousePosition(float &x, float &y) final { x = y = 0.5f; }
+
+    virtual void mouseMoved(int, int, int) final { }
+    virtual void mousePressed(int, int, int) final { }
+    virtual void mouseReleased(int, int, int) final { }
+    virtual void injectKeyPress(SDL_Keycode) final { }
+    virtual void injectKeyRelease(SDL_Keycode) final { }
+    virtual void injectTextInput(const char*) final { }
+
+    virtual void updateStatus(std::string&&) final { }
+    virtual void updateLoadProgress(const std::string&, float) final { }
+
+    /* Returns the messages since the last call, joined with "; ". */
+    std::string takeMessages()
+    {
+        std::string ret;
+        for(const std::string &msg : mMessages)
+        {
+            if(!ret.empty()) ret += "; ";
+            ret += msg;
+        }
+        mMessages.clear();
+        return ret;
+    }
+};
+
+} // namespace DF
+
+#endif /* GUI_NULLGUI_HPP */
@@ -77,4 +77,11 @@ void Renderer::update()
 }
 
 
+void Renderer::swapObjects(Renderer &other)
+{
+    mBaseNodes.swap(other.mBaseNodes);
+    mAnimUniform.swap(other.mAnimUniform);
+    std::swap(mDirtyNodes, other.mDirtyNodes);
+}
+
 } // namespace DF
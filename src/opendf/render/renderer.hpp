@@ -52,6 +52,10 @@ public:
 
     void update();
 
+    /* Exchanges the objects' nodes and pending updates with another instance.
+     * The object root stays. */
+    void swapObjects(Renderer &other);
+
     static Renderer &get() { return sRenderer; }
 };
 
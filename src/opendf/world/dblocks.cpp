@@ -3,13 +3,15 @@
 
 #include <algorithm>
 #include <iomanip>
+#include <stdexcept>
 
 #include <osg/MatrixTransform>
 
 #include "world.hpp"
+#include "scenestaging.hpp"
 #include "log.hpp"
 
-#include "components/vfs/manager.hpp"
+#include "misc/binaryreader.hpp"
 #include "components/resource/meshmanager.hpp"
 
 #include "render/renderer.hpp"
@@ -96,8 +98,11 @@ struct ModelObject : public ObjectBase {
 
     ModelObject(size_t id, int x, int y, int z) : ObjectBase(id, ObjectType_Model, x, y, z) { }
 
-    void load(std::istream &stream, const std::array<std::array<char,8>,750> &mdldata,
-              size_t regnum, size_t locnum, const osg::Vec3 &basepos);
+    void load(Misc::BinaryReader &reader, const std::array<std::array<char,8>,750> &mdldata);
+    void allocate(SceneStaging &scene, size_t regnum, size_t locnum, const osg::Vec3 &basepos) const;
+
+    // The ARCH3D mesh index, or -1 if there's no mesh.
+    size_t getMeshIndex() const;
 
     virtual void print(std::ostream &stream) const final;
 };
@@ -113,29 +118,41 @@ struct FlatObject : public ObjectBase {
 
     FlatObject(size_t id, int x, int y, int z) : ObjectBase(id, ObjectType_Flat, x, y, z) { }
 
-    void load(std::istream &stream, const osg::Vec3 &basepos);
+    void load(Misc::BinaryReader &reader);
+    void allocate(SceneStaging &scene, const osg::Vec3 &basepos) const;
 
     virtual void print(std::ostream &stream) const final;
 };
 
 
 ObjectBase::~ObjectBase()
+{
+}
+
+void ObjectBase::deallocate()
 {
     Activator::get().deallocate(mId);
     Animated::get().deallocate(mId);
 }
 
-void ObjectBase::loadAction(std::istream &stream, int32_t actionoffset, uint32_t actionflags, uint8_t soundid, const osg::Vec3 &pos, const osg::Vec3f &rot)
+void ObjectBase::loadAction(Misc::BinaryReader &reader, int32_t actionoffset)
+{
+    reader.seek(actionoffset);
+    reader.read(mAction.mData.data(), mAction.mData.size());
+    mAction.mTarget = reader.read32();
+    mAction.mType = reader.read8();
+    mHasAction = true;
+}
+
+void ObjectBase::allocateAction(SceneStaging &scene, uint32_t actionflags, uint8_t soundid, const osg::Vec3f &pos, const osg::Vec3f &rot) const
 {
-    std::array<uint8_t,5> adata;
-    stream.seekg(actionoffset);
-    stream.read(reinterpret_cast<char*>(adata.data()), adata.size());
-    int32_t target = VFS::read_le32(stream);
-    uint8_t type = stream.get();
+    const std::array<uint8_t,5> &adata = mAction.mData;
+    uint8_t type = mAction.mType;
 
+    size_t id = mId;
     size_t link = ~static_cast<size_t>(0);
-    if(target > 0)
-        link = target | (mId&0xff000000);
+    if(mAction.mTarget > 0)
+        link = mAction.mTarget | (mId&0xff000000);
 
     if(type == Action_Translate)
     {
@@ -143,8 +160,10 @@ void ObjectBase::loadAction(std::istream &stream, int32_t actionoffset, uint32_t
         float duration;
         getActionData<ActionTranslate>(adata, amount, duration);
 
-        Mover::get().allocateTranslate(mId, actionflags, link, soundid,
-                                       pos, amount, duration);
+        scene.defer([id, actionflags, link, soundid, pos, amount, duration]() {
+            Mover::get().allocateTranslate(id, actionflags, link, soundid,
+                                           pos, amount, duration);
+        });
     }
     else if(type == Action_Rotate)
     {
@@ -152,18 +171,25 @@ void ObjectBase::loadAction(std::istream &stream, int32_t actionoffset, uint32_t
         float duration;
         getActionData<ActionRotate>(adata, amount, duration);
 
-        Mover::get().allocateRotate(mId, actionflags, link, soundid,
-                                    rot, amount, duration);
+        scene.defer([id, actionflags, link, soundid, rot, amount, duration]() {
+            Mover::get().allocateRotate(id, actionflags, link, soundid,
+                                        rot, amount, duration);
+        });
     }
     else if(type == Action_Linker)
     {
-        Activator::get().allocate(mId, actionflags, link, Linker::activateFunc,
-                                  Linker::deallocateFunc);
+        scene.defer([id, actionflags, link]() {
+            Activator::get().allocate(id, actionflags, link, Linker::activateFunc,
+                                      Linker::deallocateFunc);
+        });
     }
     else
     {
-        UnknownAction::get().allocate(mId, actionflags, link, type, adata);
-        Log::get().stream(Log::Level_Error)<< "Unhandled action type: 0x"<<std::hex<<std::setfill('0')<<std::setw(2)<<(int)type;
+        // Logged on commit, since the log isn't safe to use from other threads.
+        scene.defer([id, actionflags, link, type, adata]() {
+            UnknownAction::get().allocate(id, actionflags, link, type, adata);
+            Log::get().stream(Log::Level_Error)<< "Unhandled action type: 0x"<<std::hex<<std::setfill('0')<<std::setw(2)<<(int)type;
+        });
     }
 }
 
@@ -175,44 +201,63 @@ void ObjectBase::print(std::ostream &stream) const
 }
 
 
-void ModelObject::load(std::istream &stream, const std::array<std::array<char,8>,750> &mdldata, size_t regnum, size_t locnum, const osg::Vec3 &basepos)
+void ModelObject::load(Misc::BinaryReader &reader, const std::array<std::array<char,8>,750> &mdldata)
 {
-    mXRot = VFS::read_le32(stream);
-    mYRot = VFS::read_le32(stream);
-    mZRot = VFS::read_le32(stream);
+    mXRot = reader.read32();
+    mYRot = reader.read32();
+    mZRot = reader.read32();
 
-    mModelIdx = VFS::read_le16(stream);
-    mActionFlags = VFS::read_le32(stream);
-    mSoundId = stream.get();
-    mActionOffset = VFS::read_le32(stream);
+    mModelIdx = reader.read16();
+    mActionFlags = reader.read32();
+    mSoundId = reader.read8();
+    mActionOffset = reader.read32();
 
     mModelData = mdldata.at(mModelIdx);
 
-    osg::Vec3 pos = basepos + osg::Vec3(mXPos, mYPos, mZPos);
     if(mActionOffset > 0)
-        loadAction(stream, mActionOffset, mActionFlags, mSoundId, pos, osg::Vec3(mXRot, mYRot, mZRot));
+        loadAction(reader, mActionOffset);
+}
 
-    if(mModelData[0] == -1)
-        return;
+void ModelObject::allocate(SceneStaging &scene, size_t regnum, size_t locnum, const osg::Vec3 &basepos) const
+{
+    osg::Vec3 pos = basepos + osg::Vec3(mXPos, mYPos, mZPos);
+    if(mHasAction)
+        allocateAction(scene, mActionFlags, mSoundId, pos, osg::Vec3(mXRot, mYRot, mZRot));
 
-    std::array<char,6> id{{ mModelData[0], mModelData[1], mModelData[2],
-                            mModelData[3], mModelData[4], 0 }};
-    size_t mdlidx = strtol(id.data(), nullptr, 10);
+    size_t mdlidx = getMeshIndex();
+    if(mdlidx == ~static_cast<size_t>(0))
+        return;
 
     osg::ref_ptr<osg::MatrixTransform> node(new osg::MatrixTransform());
     node->setNodeMask(Renderer::Mask_Static);
     node->setUserData(new ObjectRef(mId));
     node->addChild(Resource::MeshManager::get().get(mdlidx));
-    Renderer::get().getObjectRoot()->addChild(node);
 
+    size_t objid = mId;
+    uint32_t flags = mActionFlags|0x02;
+    osg::Vec3f rot(mXRot, mYRot, mZRot);
     // Is this how doors are specified, or is it determined by the model index?
     // What to do if a door has an action?
     if(mActionOffset <= 0 && mModelData[5] == 'D' && mModelData[6] == 'O' && mModelData[7] == 'R')
-        Door::get().allocate(mId, mActionFlags|0x02, ~static_cast<size_t>(0), osg::Vec3f(mXRot, mYRot, mZRot));
+        scene.defer([objid, flags, rot]() {
+            Door::get().allocate(objid, flags, ~static_cast<size_t>(0), rot);
+        });
     else if(mModelData[5] == 'E' && mModelData[6] == 'X' && mModelData[7] == 'T')
-        ExitDoor::get().allocate(mId, mActionFlags|0x02, ~static_cast<size_t>(0), regnum, locnum);
-    Renderer::get().setNode(mId, node);
-    Placeable::get().setPos(mId, pos, osg::Vec3f(mXRot, mYRot, mZRot));
+        scene.defer([objid, flags, regnum, locnum]() {
+            ExitDoor::get().allocate(objid, flags, ~static_cast<size_t>(0), regnum, locnum);
+        });
+    scene.addNode(mId, node);
+    scene.defer([objid, pos, rot]() { Placeable::get().setPos(objid, pos, rot); });
+}
+
+size_t ModelObject::getMeshIndex() const
+{
+    if(mModelData[0] == -1)
+        return ~static_cast<size_t>(0);
+
+    std::array<char,6> id{{ mModelData[0], mModelData[1], mModelData[2],
+                            mModelData[3], mModelData[4], 0 }};
+    return strtol(id.data(), nullptr, 10);
 }
 
 void ModelObject::print(std::ostream &stream) const
@@ -229,32 +274,40 @@ void ModelObject::print(std::ostream &stream) const
 }
 
 
-void FlatObject::load(std::istream &stream, const osg::Vec3 &basepos)
+void FlatObject::load(Misc::BinaryReader &reader)
 {
-    mTexture = VFS::read_le16(stream);
-    mGender = VFS::read_le16(stream);
-    mFactionId = VFS::read_le16(stream);
-    mActionOffset = VFS::read_le32(stream);
-    mUnknown = stream.get();
+    mTexture = reader.read16();
+    mGender = reader.read16();
+    mFactionId = reader.read16();
+    mActionOffset = reader.read32();
+    mUnknown = reader.read8();
 
-    osg::Vec3 pos = basepos + osg::Vec3(mXPos, mYPos, mZPos);
     if(mActionOffset > 0)
-        loadAction(stream, mActionOffset, 0x02, 0, pos, osg::Vec3());
+        loadAction(reader, mActionOffset);
+}
+
+void FlatObject::allocate(SceneStaging &scene, const osg::Vec3 &basepos) const
+{
+    osg::Vec3 pos = basepos + osg::Vec3(mXPos, mYPos, mZPos);
+    if(mHasAction)
+        allocateAction(scene, 0x02, 0, pos, osg::Vec3());
 
     size_t numframes = 0;
     osg::ref_ptr<osg::MatrixTransform> node(new osg::MatrixTransform());
     node->setNodeMask(Renderer::Mask_Flat);
     node->setUserData(new ObjectRef(mId));
     node->addChild(Resource::MeshManager::get().loadFlat(mTexture, true, &numframes));
-    Renderer::get().getObjectRoot()->addChild(node);
+    scene.addNode(mId, node);
 
-    Renderer::get().setNode(mId, node);
-    if(numframes > 1)
-    {
-        // Animation speed is hardcoded? Might it be specified somewhere else?
-        Animated::get().allocate(mId, numframes, 1.0f/12.0f);
-    }
-    Placeable::get().setPoint(mId, pos);
+    size_t id = mId;
+    scene.defer([id, numframes, pos]() {
+        if(numframes > 1)
+        {
+            // Animation speed is hardcoded? Might it be specified somewhere else?
+            Animated::get().allocate(id, numframes, 1.0f/12.0f);
+        }
+        Placeable::get().setPoint(id, pos);
+    });
 }
 
 void FlatObject::print(std::ostream &stream) const
@@ -269,85 +322,110 @@ void FlatObject::print(std::ostream &stream) const
 
 
 DBlockHeader::DBlockHeader() { }
-DBlockHeader::~DBlockHeader()
+DBlockHeader::~DBlockHeader() { }
+
+void DBlockHeader::deallocate()
 {
     if(!mModels.empty())
     {
+        for(const std::unique_ptr<ModelObject> &model : mModels)
+            model->deallocate();
         Renderer::get().remove(&*mModels.getIdList(), mModels.size());
         Placeable::get().deallocate(&*mModels.getIdList(), mModels.size());
     }
     if(!mFlats.empty())
     {
+        for(const std::unique_ptr<FlatObject> &flat : mFlats)
+            flat->deallocate();
         Renderer::get().remove(&*mFlats.getIdList(), mFlats.size());
         Placeable::get().deallocate(&*mFlats.getIdList(), mFlats.size());
     }
 }
 
 
-void DBlockHeader::load(std::istream &stream, size_t blockid, float x, float z, size_t regnum, size_t locnum)
+void DBlockHeader::load(Misc::BinaryReader &reader, size_t blockid)
 {
-    mUnknown1 = VFS::read_le32(stream);
-    mWidth = VFS::read_le32(stream);
-    mHeight = VFS::read_le32(stream);
-    mObjectRootOffset = VFS::read_le32(stream);
-    mUnknown2 = VFS::read_le32(stream);
-    stream.read(mModelData[0].data(), sizeof(mModelData));
-    for(uint32_t &val : mUnknown3)
-        val = VFS::read_le32(stream);
-
-    mUnknownOffset = VFS::read_le32(stream);
-    mUnknown4 = VFS::read_le32(stream);
-    mUnknown5 = VFS::read_le32(stream);
-    mUnknown6 = VFS::read_le32(stream);
+    mUnknown1 = reader.read32();
+    mWidth = reader.read32();
+    mHeight = reader.read32();
+    mObjectRootOffset = reader.read32();
+    mUnknown2 = reader.read32();
+    reader.read(mModelData[0].data(), sizeof(mModelData));
+    reader.read32(mUnknown3.data(), mUnknown3.size());
+
+    mUnknownOffset = reader.read32();
+    mUnknown4 = reader.read32();
+    mUnknown5 = reader.read32();
+    mUnknown6 = reader.read32();
+
+    // The object lists are linked by offsets, so a bad block could loop
+    // back on itself. Remember where each list has been.
+    std::vector<bool> visited(reader.size());
+    auto visit = [&visited](int32_t offset)
+    {
+        if(size_t(offset) >= visited.size())
+            throw std::runtime_error("Object offset "+std::to_string(offset)+" out of range ("+
+                                     std::to_string(visited.size())+" bytes)");
+        if(visited[offset])
+            throw std::runtime_error("Object list loops back to offset "+std::to_string(offset));
+        visited[offset] = true;
+    };
 
     {
         // Seems to be one entry for each valid ModelData....
         int32_t offset = mUnknownOffset;
-        while(stream.good() && offset > 0)
+        while(offset > 0 && size_t(offset)+4 <= reader.size())
         {
-            stream.seekg(offset);
-            offset = VFS::read_le32(stream);
+            visit(offset);
+            reader.seek(offset);
+            offset = reader.read32();
             mUnknownList.push_back(offset);
         }
     }
 
-    stream.clear();
-    stream.seekg(mObjectRootOffset);
+    visited.assign(visited.size(), false);
+    // Check the root list fits before allocating it, so a bad size can't
+    // ask for gigabytes.
+    if(mObjectRootOffset > reader.size() ||
+       uint64_t(mWidth)*mHeight*4 > reader.size()-mObjectRootOffset)
+        throw std::runtime_error("Object roots out of range ("+std::to_string(mWidth)+"x"+
+                                 std::to_string(mHeight)+" at offset "+
+                                 std::to_string(mObjectRootOffset)+")");
+    reader.seek(mObjectRootOffset);
 
     std::vector<int32_t> rootoffsets(mWidth*mHeight);
-    for(int32_t &val : rootoffsets)
-        val = VFS::read_le32(stream);
+    reader.read32(reinterpret_cast<uint32_t*>(rootoffsets.data()), rootoffsets.size());
 
-    osg::Vec3 basepos(x, 0.0f, z);
     for(int32_t offset : rootoffsets)
     {
         while(offset > 0)
         {
-            stream.seekg(offset);
-            int32_t next = VFS::read_le32(stream);
-            /*int32_t prev =*/ VFS::read_le32(stream);
+            visit(offset);
+            reader.seek(offset);
+            int32_t next = reader.read32();
+            /*int32_t prev =*/ reader.read32();
 
-            int32_t x = VFS::read_le32(stream);
-            int32_t y = VFS::read_le32(stream);
-            int32_t z = VFS::read_le32(stream);
-            uint8_t type = stream.get();
-            uint32_t objoffset = VFS::read_le32(stream);
+            int32_t x = reader.read32();
+            int32_t y = reader.read32();
+            int32_t z = reader.read32();
+            uint8_t type = reader.read8();
+            uint32_t objoffset = reader.read32();
 
             if(type == ObjectType_Model)
             {
-                stream.seekg(objoffset);
+                reader.seek(objoffset);
                 ModelObject *model = mModels.insert(blockid|offset,
                     std::unique_ptr<ModelObject>(new ModelObject(blockid|offset, x, y, z))
                 ).first->get();
-                model->load(stream, mModelData, regnum, locnum, basepos);
+                model->load(reader, mModelData);
             }
             else if(type == ObjectType_Flat)
             {
-                stream.seekg(objoffset);
+                reader.seek(objoffset);
                 FlatObject *flat = mFlats.insert(blockid|offset,
                     std::unique_ptr<FlatObject>(new FlatObject(blockid|offset, x, y, z))
                 ).first->get();
-                flat->load(stream, basepos);
+                flat->load(reader);
             }
 
             offset = next;
@@ -355,6 +433,27 @@ void DBlockHeader::load(std::istream &stream, size_t blockid, float x, float z,
     }
 }
 
+void DBlockHeader::allocate(SceneStaging &scene, float x, float z, size_t regnum, size_t locnum) const
+{
+    osg::Vec3 basepos(x, 0.0f, z);
+    for(const std::unique_ptr<ModelObject> &model : mModels)
+        model->allocate(scene, regnum, locnum, basepos);
+    for(const std::unique_ptr<FlatObject> &flat : mFlats)
+        flat->allocate(scene, basepos);
+}
+
+void DBlockHeader::warmResources(std::vector<osg::ref_ptr<osg::Node>> &nodes) const
+{
+    for(const std::unique_ptr<ModelObject> &model : mModels)
+    {
+        size_t mdlidx = model->getMeshIndex();
+        if(mdlidx != ~static_cast<size_t>(0))
+            nodes.push_back(Resource::MeshManager::get().get(mdlidx));
+    }
+    for(const std::unique_ptr<FlatObject> &flat : mFlats)
+        nodes.push_back(Resource::MeshManager::get().loadFlat(flat->mTexture, true));
+}
+
 
 ObjectBase *DBlockHeader::getObject(size_t id)
 {
@@ -383,6 +482,13 @@ size_t DBlockHeader::getObjectByTexture(size_t texid) const
 }
 
 
+size_t DBlockHeader::getMemoryUsage() const
+{
+    return sizeof(*this) + mUnknownList.capacity()*sizeof(uint32_t) +
+           mModels.size()*(sizeof(ModelObject)+sizeof(std::unique_ptr<ModelObject>)+sizeof(size_t)) +
+           mFlats.size()*(sizeof(FlatObject)+sizeof(std::unique_ptr<FlatObject>)+sizeof(size_t));
+}
+
 void DBlockHeader::print(std::ostream &stream, int objtype) const
 {
     stream<< "Unknown: 0x"<<std::hex<<std::setw(8)<<mUnknown1<<std::dec<<std::setw(0)<<"\n";
@@ -6,6 +6,8 @@
 #include <vector>
 #include <array>
 
+#include <osg/ref_ptr>
+
 #include "misc/sparsearray.hpp"
 #include "referenceable.hpp"
 
@@ -13,6 +15,12 @@
 namespace osg
 {
     class Vec3f;
+    class Node;
+}
+
+namespace Misc
+{
+    class BinaryReader;
 }
 
 namespace DF
@@ -21,16 +29,36 @@ namespace DF
 struct ObjectBase;
 struct DBlockHeader;
 
+class SceneStaging;
+
+struct ObjectAction {
+    uint8_t mType;
+    std::array<uint8_t,5> mData;
+    int32_t mTarget;
+};
+
+/* Objects are decoded from a block as plain data first (load), and then
+ * placed into a scene (allocate), so decoding doesn't touch the scene graph
+ * or the object systems.
+ */
 struct ObjectBase {
     size_t mId;
     uint8_t mType;
 
     int32_t mXPos, mYPos, mZPos;
 
-    ObjectBase(size_t id, uint8_t type, int x, int y, int z) : mId(id), mType(type), mXPos(x), mYPos(y), mZPos(z) { }
+    bool mHasAction;
+    ObjectAction mAction;
+
+    ObjectBase(size_t id, uint8_t type, int x, int y, int z)
+      : mId(id), mType(type), mXPos(x), mYPos(y), mZPos(z), mHasAction(false)
+    { }
     virtual ~ObjectBase();
 
-    void loadAction(std::istream &stream, int32_t actionoffset, uint32_t actionflags, uint8_t soundid, const osg::Vec3f &pos, const osg::Vec3f &rot);
+    void deallocate();
+
+    void loadAction(Misc::BinaryReader &reader, int32_t actionoffset);
+    void allocateAction(SceneStaging &scene, uint32_t actionflags, uint8_t soundid, const osg::Vec3f &pos, const osg::Vec3f &rot) const;
 
     virtual void print(std::ostream &stream) const;
 };
@@ -64,8 +92,19 @@ struct DBlockHeader {
 
     DBlockHeader();
     ~DBlockHeader();
-
-    void load(std::istream &stream, size_t blockid, float x, float z, size_t regnum, size_t locnum);
+    /* Removes the block's objects from the object systems. Destroying the
+     * block doesn't, so one built but never swapped in can be dropped from
+     * any thread. */
+    void deallocate();
+
+    /* Reads the block's objects. Only decodes, so it's safe anywhere. */
+    void load(Misc::BinaryReader &reader, size_t blockid);
+    /* Builds the loaded block's scene into the given staging. */
+    void allocate(SceneStaging &scene, float x, float z, size_t regnum, size_t locnum) const;
+    /* Loads the meshes and flats the loaded block uses, adding them to nodes.
+     * The mesh manager only caches what's still referenced, so they stay
+     * cached for as long as nodes holds them. Safe from any thread. */
+    void warmResources(std::vector<osg::ref_ptr<osg::Node>> &nodes) const;
 
     ObjectBase *getObject(size_t id);
 
@@ -75,6 +114,9 @@ struct DBlockHeader {
      */
     size_t getObjectByTexture(size_t texid) const;
 
+    // Approximate heap and object size, in bytes.
+    size_t getMemoryUsage() const;
+
     void print(std::ostream &stream, int objtype=0) const;
 };
 
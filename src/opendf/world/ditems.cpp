@@ -3,58 +3,72 @@
 
 #include <iomanip>
 
-#include "components/vfs/manager.hpp"
+#include "misc/recordlayout.hpp"
 
 #include "log.hpp"
 
 
+namespace
+{
+
+/* Follows the location header, before the block list */
+constexpr auto gDungeonInteriorLayout = Misc::layout(
+    Misc::field(&DF::DungeonInterior::mNullValue, "Null"),
+    Misc::field(&DF::DungeonInterior::mUnknown1, "Unknown", Misc::Field_Hex),
+    Misc::field(&DF::DungeonInterior::mUnknown2, "Unknown", Misc::Field_Hex),
+    Misc::field(&DF::DungeonInterior::mBlockCount, "BlockCount"),
+    Misc::field(&DF::DungeonInterior::mUnknown3, "Unknown", Misc::Field_Hex)
+);
+static_assert(gDungeonInteriorLayout.size() == 17, "DungeonInterior must have 17 bytes before the blocks");
+
+constexpr auto gDungeonBlockLayout = Misc::layout(
+    Misc::field(&DF::DungeonBlock::mX, "X"),
+    Misc::field(&DF::DungeonBlock::mZ, "Z"),
+    Misc::field(&DF::DungeonBlock::mBlockNumberStartIndex, "BlockNumberStartIndex", Misc::Field_Hidden)
+);
+static_assert(gDungeonBlockLayout.size() == 4, "DungeonBlock must be 4 bytes");
+
+}
+
 namespace DF
 {
 
-void DungeonInterior::load(std::istream &stream)
+void DungeonInterior::load(Misc::BinaryReader &reader)
 {
-    LocationHeader::load(stream);
+    LocationHeader::load(reader);
 
-    mNullValue = VFS::read_le16(stream);
-    mUnknown1 = VFS::read_le32(stream);
-    mUnknown2 = VFS::read_le32(stream);
-    mBlockCount = VFS::read_le16(stream);
-    stream.read(reinterpret_cast<char*>(mUnknown3), sizeof(mUnknown3));
+    gDungeonInteriorLayout.read(reader, *this);
 
     mBlocks.resize(mBlockCount);
     for(DungeonBlock &block : mBlocks)
-    {
-        block.mX = stream.get();
-        block.mZ = stream.get();
-        block.mBlockNumberStartIndex = VFS::read_le16(stream);
-    }
+        gDungeonBlockLayout.read(reader, block);
+}
+
+void DungeonInterior::save(Misc::BinaryWriter &writer) const
+{
+    LocationHeader::save(writer);
+
+    gDungeonInteriorLayout.write(writer, *this);
+
+    for(const DungeonBlock &block : mBlocks)
+        gDungeonBlockLayout.write(writer, block);
 }
 
 LogStream& operator<<(LogStream &stream, const DungeonInterior &dgn)
 {
-    stream<< static_cast<const LocationHeader&>(dgn) <<"\n";
-    stream<<std::setfill('0');
-
-    stream<< "  Null: "<<dgn.mNullValue<<"\n";
-    stream<< "  Unknown: 0x"<<std::hex<<std::setw(8)<<dgn.mUnknown1<<std::setw(0)<<std::dec<<"\n";
-    stream<< "  Unknown: 0x"<<std::hex<<std::setw(8)<<dgn.mUnknown2<<std::setw(0)<<std::dec<<"\n";
-    stream<< "  BlockCount: "<<dgn.mBlockCount<<"\n";
-    stream<< "  Unknown:";//<<std::hex<<std::setw(2);
-    for(uint32_t unk : dgn.mUnknown3)
-        stream<< " 0x"<<std::hex<<std::setw(2)<<unk;
-    stream<<std::setw(0)<<std::dec<<"\n";
+    stream<< static_cast<const LocationHeader&>(dgn);
+    gDungeonInteriorLayout.print(stream, dgn, "  ");
 
     for(const DungeonBlock &block : dgn.mBlocks)
     {
         stream<< "  Block "<<std::distance(dgn.mBlocks.data(), &block)<<":\n";
-        stream<< "    X: "<<(int)block.mX<<"\n";
-        stream<< "    Z: "<<(int)block.mZ<<"\n";
+        gDungeonBlockLayout.print(stream, block, "    ");
+        // The block number is split into bitfields
         stream<< "    BlockIdx: "<<block.mBlockIdx<<"\n";
         stream<< "    StartBlock: "<<block.mStartBlock<<"\n";
         stream<< "    BlockPreIndex: "<<block.mBlockPreIndex<<"\n";
     }
 
-    stream<<std::setfill(' ');
     return stream;
 }
 
@@ -29,7 +29,8 @@ struct DungeonInterior : public LocationHeader {
 
     std::vector<DungeonBlock> mBlocks;
 
-    void load(std::istream &stream);
+    void load(Misc::BinaryReader &reader);
+    void save(Misc::BinaryWriter &writer) const;
 };
 LogStream& operator<<(LogStream &stream, const DungeonInterior &dgn);
 
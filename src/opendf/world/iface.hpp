@@ -2,6 +2,7 @@
 #define WORLD_IFACE_HPP
 
 #include <string>
+#include <vector>
 
 
 namespace osgViewer
@@ -18,19 +19,59 @@ namespace osg
 namespace DF
 {
 
+struct LocationMatch {
+    std::string mName;
+    size_t mRegion;
+    size_t mIndex;
+};
+
+struct LocationSummary {
+    std::string mName;
+    size_t mBlocks;
+    // The exterior's dungeon, if it has one (mDungeonBlocks is 0 if not).
+    std::string mDungeonName;
+    size_t mDungeonBlocks;
+};
+
 class WorldIface {
     static WorldIface &sInstance;
 
 public:
-    virtual void initialize(osgViewer::Viewer *viewer, osg::Group *sceneroot) = 0;
+    /* cachefile is where the parsed map data is kept between runs, or empty
+     * to always parse it from the game data. */
+    virtual void initialize(osgViewer::Viewer *viewer, osg::Group *sceneroot, const std::string &cachefile) = 0;
     virtual void deinitialize() = 0;
 
+    virtual void rebuildCache() = 0;
+
+    /* Finds an exterior by its full name, ignoring case. */
     virtual bool getExteriorByName(const std::string &name, size_t &regnum, size_t &mapnum) const = 0;
+    /* Finds exteriors with names starting with the given text, or containing
+     * it anywhere, ignoring case. Returns the total number found, storing up
+     * to limit of them. */
+    virtual size_t findExteriors(const std::string &text, bool anywhere, std::vector<LocationMatch> &matches, size_t limit) const = 0;
+    /* The number of regions, including unused ones (which have no
+     * exteriors). */
+    virtual size_t getRegionCount() const = 0;
+    /* Lists a region's exteriors by index, reading the region's locations if
+     * they aren't yet. */
+    virtual void getExteriors(size_t regnum, std::vector<LocationSummary> &exteriors) = 0;
+    /* Starts loading a location in the background. The current location stays
+     * until the new one is ready, and is swapped out by update(). */
     virtual void loadExterior(int regnum, int extid) = 0;
 
     virtual void loadDungeonByExterior(int regnum, int extid) = 0;
     virtual void loadCurrentExteriorDungeon() = 0;
 
+    /* Streams the world around the camera instead of loading one location at
+     * a time, starting from the current exterior. */
+    virtual void setStreaming(bool enable) = 0;
+    virtual bool isStreaming() const = 0;
+    /* Flies out from the current exterior with streaming on, at a fixed speed
+     * and frame step so runs are comparable, then reports frame times and
+     * hitches. */
+    virtual void startStreamBenchmark(float seconds) = 0;
+
     virtual void move(/*int objid,*/ float xrel, float yrel, float zrel) = 0;
     virtual void rotate(/*int objid,*/ float xrel, float yrel) = 0;
 
@@ -40,6 +81,8 @@ public:
 
     virtual void dumpArea() const = 0;
     virtual void dumpBlocks() const = 0;
+    // Reports region memory use and load times.
+    virtual void dumpStats() const = 0;
 
     static WorldIface &get() { return sInstance; }
 };
@@ -6,6 +6,12 @@
 #include <stdint.h>
 
 
+namespace Misc
+{
+    class BinaryReader;
+    class BinaryWriter;
+}
+
 namespace DF
 {
 
@@ -43,7 +49,8 @@ struct LocationHeader {
     char mLocationName[32];
     uint8_t mUnknown3[9];
 
-    void load(std::istream &stream);
+    void load(Misc::BinaryReader &reader);
+    void save(Misc::BinaryWriter &writer) const;
 };
 LogStream& operator<<(LogStream &stream, const LocationHeader &loc);
 
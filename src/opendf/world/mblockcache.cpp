@@ -0,0 +1,183 @@
+#include "mblockcache.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "misc/binaryreader.hpp"
+#include "components/vfs/manager.hpp"
+
+#include "mblocks.hpp"
+#include "cvars.hpp"
+
+
+namespace DF
+{
+
+// Memory for parsed RMB blocks, in KiB. Blocks in use are kept even if it
+// goes over.
+CVAR(CVarInt, world_blockcache, 16384, 0, 1048576);
+
+
+MBlockCache MBlockCache::sCache;
+
+MBlockCache::MBlockCache()
+  : mTotalSize(0), mHits(0), mMisses(0), mEvictions(0)
+{
+}
+
+MBlockCache::~MBlockCache()
+{
+}
+
+
+void MBlockCache::touch(Entry &entry)
+{
+    mLru.splice(mLru.begin(), mLru, entry.mLruPos);
+}
+
+void MBlockCache::trim()
+{
+    size_t budget = size_t(*world_blockcache) * 1024;
+    auto iter = mLru.end();
+    while(mTotalSize > budget && iter != mLru.begin())
+    {
+        --iter;
+        auto entry = mEntries.find(*iter);
+        // Still in use by a block somewhere.
+        if(entry->second.mData.use_count() > 1)
+            continue;
+
+        mTotalSize -= entry->second.mSize;
+        mEntries.erase(entry);
+        iter = mLru.erase(iter);
+        ++mEvictions;
+    }
+}
+
+
+std::shared_ptr<const MBlockData> MBlockCache::get(const std::string &name)
+{
+    return getBatch(std::vector<std::string>(1, name)).front();
+}
+
+std::vector<std::shared_ptr<const MBlockData>> MBlockCache::getBatch(const std::vector<std::string> &names)
+{
+    std::vector<std::shared_ptr<const MBlockData>> blocks(names.size());
+    std::vector<std::string> missing;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for(size_t i = 0;i < names.size();++i)
+        {
+            auto entry = mEntries.find(names[i]);
+            if(entry != mEntries.end())
+            {
+                touch(entry->second);
+                blocks[i] = entry->second.mData;
+                ++mHits;
+            }
+            else if(std::find(missing.begin(), missing.end(), names[i]) == missing.end())
+                missing.push_back(names[i]);
+        }
+    }
+    if(missing.empty())
+        return blocks;
+
+    // Parse outside of the lock, so other threads can get cached blocks in
+    // the mean time.
+    std::vector<VFS::DataPtr> data = VFS::Manager::get().readBatch(missing);
+    std::vector<std::shared_ptr<MBlockData>> parsed(missing.size());
+    for(size_t i = 0;i < missing.size();++i)
+    {
+        if(!data[i]) throw std::runtime_error("Failed to open "+missing[i]);
+        Misc::BinaryReader reader(*data[i]);
+        data[i] = nullptr;
+
+        parsed[i] = std::make_shared<MBlockData>();
+        parsed[i]->load(reader);
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    for(size_t i = 0;i < missing.size();++i)
+    {
+        // Another thread may have gotten to it first, in which case use that
+        // one so there's only one copy.
+        auto entry = mEntries.find(missing[i]);
+        if(entry == mEntries.end())
+        {
+            Entry newentry;
+            newentry.mData = std::move(parsed[i]);
+            newentry.mSize = newentry.mData->getMemoryUsage();
+            mLru.push_front(missing[i]);
+            newentry.mLruPos = mLru.begin();
+            mTotalSize += newentry.mSize;
+            entry = mEntries.insert(std::make_pair(missing[i], std::move(newentry))).first;
+        }
+        else
+            touch(entry->second);
+        ++mMisses;
+
+        for(size_t j = 0;j < names.size();++j)
+        {
+            if(!blocks[j] && names[j] == missing[i])
+                blocks[j] = entry->second.mData;
+        }
+    }
+    trim();
+
+    return blocks;
+}
+
+
+void MBlockCache::prefetch(const std::vector<std::string> &names)
+{
+    std::vector<std::string> missing;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for(const std::string &name : names)
+        {
+            if(mEntries.find(name) == mEntries.end())
+                missing.push_back(name);
+        }
+    }
+    if(!missing.empty())
+        VFS::Manager::get().prefetch(missing);
+}
+
+
+void MBlockCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    for(auto iter = mLru.begin();iter != mLru.end();)
+    {
+        auto entry = mEntries.find(*iter);
+        if(entry->second.mData.use_count() > 1)
+            ++iter;
+        else
+        {
+            mTotalSize -= entry->second.mSize;
+            mEntries.erase(entry);
+            iter = mLru.erase(iter);
+        }
+    }
+}
+
+MBlockCache::Stats MBlockCache::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Stats stats;
+    stats.mEntries = mEntries.size();
+    stats.mInUse = 0;
+    for(const auto &entry : mEntries)
+    {
+        if(entry.second.mData.use_count() > 1)
+            ++stats.mInUse;
+    }
+    stats.mMemoryUsage = mTotalSize;
+    stats.mBudget = size_t(*world_blockcache) * 1024;
+    stats.mHits = mHits;
+    stats.mMisses = mMisses;
+    stats.mEvictions = mEvictions;
+    return stats;
+}
+
+} // namespace DF
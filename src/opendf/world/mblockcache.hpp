@@ -0,0 +1,80 @@
+#ifndef WORLD_MBLOCKCACHE_HPP
+#define WORLD_MBLOCKCACHE_HPP
+
+#include <map>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <string>
+
+
+namespace DF
+{
+
+struct MBlockData;
+
+/* Parsed RMB blocks, by file name. The same blocks are used by many towns,
+ * sometimes more than once in the same one, so each is read and parsed once
+ * and shared while it's in use or recently used. Blocks still referenced are
+ * always kept; once the cache goes over its memory budget, unreferenced ones
+ * are dropped, least recently used first. Safe to use from any thread.
+ */
+class MBlockCache {
+    static MBlockCache sCache;
+
+    struct Entry {
+        std::shared_ptr<const MBlockData> mData;
+        size_t mSize;
+        std::list<std::string>::iterator mLruPos;
+    };
+
+    std::map<std::string,Entry> mEntries;
+    // Most recently used first.
+    std::list<std::string> mLru;
+    size_t mTotalSize;
+
+    size_t mHits;
+    size_t mMisses;
+    size_t mEvictions;
+
+    mutable std::mutex mMutex;
+
+    MBlockCache();
+    ~MBlockCache();
+
+    void touch(Entry &entry);
+    void trim();
+
+public:
+    struct Stats {
+        size_t mEntries;
+        size_t mInUse;
+        size_t mMemoryUsage;
+        size_t mBudget;
+        size_t mHits;
+        size_t mMisses;
+        size_t mEvictions;
+    };
+
+    /* Gets the parsed block, reading it if it's not cached. Throws if the
+     * file doesn't exist or is bad. */
+    std::shared_ptr<const MBlockData> get(const std::string &name);
+    /* As get, for a set of blocks, with the ones not cached read together. */
+    std::vector<std::shared_ptr<const MBlockData>> getBatch(const std::vector<std::string> &names);
+
+    /* Starts reading the blocks that aren't cached in the background, for a
+     * later get. */
+    void prefetch(const std::vector<std::string> &names);
+
+    /* Drops all blocks not in use. */
+    void clear();
+
+    Stats getStats() const;
+
+    static MBlockCache &get() { return sCache; }
+};
+
+} // namespace DF
+
+#endif /* WORLD_MBLOCKCACHE_HPP */
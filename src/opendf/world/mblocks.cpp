@@ -8,12 +8,13 @@
 #include <osg/MatrixTransform>
 #include <osg/Texture>
 
-#include "components/vfs/manager.hpp"
+#include "misc/recordlayout.hpp"
 #include "components/resource/meshmanager.hpp"
 #include "components/resource/texturemanager.hpp"
 
 #include "render/renderer.hpp"
 #include "class/animated.hpp"
+#include "scenestaging.hpp"
 #include "world.hpp"
 #include "log.hpp"
 
@@ -25,7 +26,7 @@ struct MSection3 : public MObjectBase {
     uint16_t mUnknown1;
     uint16_t mUnknown2;
 
-    void load(std::istream &stream);
+    void load(Misc::BinaryReader &reader);
 };
 
 struct MDoor : public MObjectBase {
@@ -34,7 +35,7 @@ struct MDoor : public MObjectBase {
     uint16_t mUnknown2;
     uint8_t mNullValue;
 
-    void load(std::istream &stream);
+    void load(Misc::BinaryReader &reader);
 };
 
 struct MFlat : public MObjectBase {
@@ -42,8 +43,8 @@ struct MFlat : public MObjectBase {
     uint16_t mUnknown;
     uint8_t mFlags;
 
-    void load(std::istream &stream);
-    void allocate(const osg::Vec3 &pos, const osg::Quat &ori);
+    void load(Misc::BinaryReader &reader);
+    void allocate(SceneStaging &scene, size_t blockid, const osg::Vec3 &pos, const osg::Quat &ori) const;
 
     virtual void print(std::ostream &stream) const;
 };
@@ -52,7 +53,7 @@ struct MPerson : public MObjectBase {
     uint16_t mTexture;
     uint16_t mFactionId;
 
-    void load(std::istream &stream);
+    void load(Misc::BinaryReader &reader);
 };
 
 struct MModel : public MObjectBase {
@@ -72,8 +73,8 @@ struct MModel : public MObjectBase {
     uint32_t mUnknown8;
     uint16_t mNullValue4;
 
-    void load(std::istream &stream);
-    void allocate(const osg::Vec3 &pos, const osg::Quat &ori);
+    void load(Misc::BinaryReader &reader);
+    void allocate(SceneStaging &scene, size_t blockid, const osg::Vec3 &pos, const osg::Quat &ori) const;
 
     virtual void print(std::ostream &stream) const;
 };
@@ -98,22 +99,66 @@ struct MBlock {
     std::vector<MPerson>   mNpcs;
     std::vector<MDoor>     mDoors;
 
-    ~MBlock() { deallocate(); }
+    void load(Misc::BinaryReader &reader, size_t blockid);
 
-    void load(std::istream &stream, size_t blockid);
+    void allocate(SceneStaging &scene, size_t blockid, const osg::Vec3 &pos, const osg::Quat &ori,
+                  std::vector<size_t> &ids) const;
 
-    void allocate(const osg::Vec3 &pos, const osg::Quat &ori);
-    void deallocate();
+    const MObjectBase *getObject(size_t id) const;
 
-    MObjectBase *getObject(size_t id);
+    size_t getMemoryUsage() const
+    {
+        return mModels.size()*(sizeof(MModel)+sizeof(size_t)) +
+               mFlats.size()*(sizeof(MFlat)+sizeof(size_t)) +
+               mSection3s.capacity()*sizeof(MSection3) +
+               mNpcs.capacity()*sizeof(MPerson) + mDoors.capacity()*sizeof(MDoor);
+    }
 };
 
 
-void MObjectBase::load(std::istream &stream)
+namespace
+{
+
+/* Follows the model index, a le16 hundreds value and a byte */
+constexpr auto gMModelLayout = Misc::layout(
+    Misc::field(&MModel::mUnknown1, "Unknown", Misc::Field_Hex),
+    Misc::field(&MModel::mUnknown2, "Unknown", Misc::Field_Hex),
+    Misc::field(&MModel::mUnknown3, "Unknown", Misc::Field_Hex),
+    Misc::field(&MModel::mUnknown4, "Unknown", Misc::Field_Hex),
+    Misc::field(&MModel::mNullValue1, "Null"),
+    Misc::field(&MModel::mNullValue2, "Null"),
+    Misc::field(&MModel::mUnknownX, "UnknownX"),
+    Misc::field(&MModel::mUnknownY, "UnknownY"),
+    Misc::field(&MModel::mUnknownZ, "UnknownZ"),
+    Misc::field(&MModel::mXPos, "X", Misc::Field_Hidden),
+    Misc::field(&MModel::mYPos, "Y", Misc::Field_Hidden),
+    Misc::field(&MModel::mZPos, "Z", Misc::Field_Hidden),
+    Misc::field(&MModel::mNullValue3, "Null"),
+    Misc::field(&MModel::mYRotation, "YRotation"),
+    Misc::field(&MModel::mUnknown5, "Unknown", Misc::Field_Hex),
+    Misc::field(&MModel::mUnknown6, "Unknown", Misc::Field_Hex),
+    Misc::field(&MModel::mUnknown8, "Unknown", Misc::Field_Hex),
+    Misc::field(&MModel::mNullValue4, "Null")
+);
+static_assert(gMModelLayout.size()+3 == 66, "MModel must be 66 bytes");
+
+constexpr auto gMBlockPositionLayout = Misc::layout(
+    Misc::field(&MBlockPosition::mUnknown1, "Unknown", Misc::Field_Hex),
+    Misc::field(&MBlockPosition::mUnknown2, "Unknown", Misc::Field_Hex),
+    Misc::field(&MBlockPosition::mX, "X"),
+    Misc::field(&MBlockPosition::mZ, "Z"),
+    Misc::field(&MBlockPosition::mYRot, "YRot")
+);
+static_assert(gMBlockPositionLayout.size() == 20, "MBlockPosition must be 20 bytes");
+
+} // namespace
+
+
+void MObjectBase::load(Misc::BinaryReader &reader)
 {
-    mXPos = VFS::read_le32(stream);
-    mYPos = VFS::read_le32(stream);
-    mZPos = VFS::read_le32(stream);
+    mXPos = reader.read32();
+    mYPos = reader.read32();
+    mZPos = reader.read32();
 }
 
 void MObjectBase::print(std::ostream &stream) const
@@ -121,44 +166,47 @@ void MObjectBase::print(std::ostream &stream) const
     stream<< "Pos: "<<mXPos<<" "<<mYPos<<" "<<mZPos<<"\n";
 }
 
-void MSection3::load(std::istream &stream)
+void MSection3::load(Misc::BinaryReader &reader)
 {
-    MObjectBase::load(stream);
-    mUnknown1 = VFS::read_le16(stream);
-    mUnknown2 = VFS::read_le16(stream);
+    MObjectBase::load(reader);
+    mUnknown1 = reader.read16();
+    mUnknown2 = reader.read16();
 }
 
-void MDoor::load(std::istream &stream)
+void MDoor::load(Misc::BinaryReader &reader)
 {
-    MObjectBase::load(stream);
-    mUnknown1 = VFS::read_le16(stream);
-    mRotation = VFS::read_le16(stream);
-    mUnknown2 = VFS::read_le16(stream);
-    mNullValue = stream.get();
+    MObjectBase::load(reader);
+    mUnknown1 = reader.read16();
+    mRotation = reader.read16();
+    mUnknown2 = reader.read16();
+    mNullValue = reader.read8();
 }
 
 
-void MFlat::load(std::istream &stream)
+void MFlat::load(Misc::BinaryReader &reader)
 {
-    MObjectBase::load(stream);
-    mTexture = VFS::read_le16(stream);
-    mUnknown = VFS::read_le16(stream);
-    mFlags = stream.get();
+    MObjectBase::load(reader);
+    mTexture = reader.read16();
+    mUnknown = reader.read16();
+    mFlags = reader.read8();
 }
 
-void MFlat::allocate(const osg::Vec3 &pos, const osg::Quat &ori)
+void MFlat::allocate(SceneStaging &scene, size_t blockid, const osg::Vec3 &pos, const osg::Quat &ori) const
 {
+    size_t id = blockid | mId;
     size_t numframes = 0;
     osg::ref_ptr<osg::MatrixTransform> node = new osg::MatrixTransform();
     node->setNodeMask(Renderer::Mask_Flat);
-    node->setUserData(new ObjectRef(mId));
+    node->setUserData(new ObjectRef(id));
     node->addChild(Resource::MeshManager::get().loadFlat(mTexture, false, &numframes));
-    Renderer::get().getObjectRoot()->addChild(node);
-
-    Renderer::get().setNode(mId, node);
-    if(numframes > 1)
-        Animated::get().allocate(mId, numframes, 1.0f/12.0f);
-    Placeable::get().setPoint(mId, (ori * osg::Vec3f(mXPos, mYPos, mZPos)) + pos);
+    scene.addNode(id, node);
+
+    osg::Vec3f pt = (ori * osg::Vec3f(mXPos, mYPos, mZPos)) + pos;
+    scene.defer([id, numframes, pt]() {
+        if(numframes > 1)
+            Animated::get().allocate(id, numframes, 1.0f/12.0f);
+        Placeable::get().setPoint(id, pt);
+    });
 }
 
 void MFlat::print(std::ostream &stream) const
@@ -170,175 +218,215 @@ void MFlat::print(std::ostream &stream) const
 }
 
 
-void MPerson::load(std::istream &stream)
+void MPerson::load(Misc::BinaryReader &reader)
 {
-    MObjectBase::load(stream);
-    mTexture = VFS::read_le16(stream);
-    mFactionId = VFS::read_le16(stream);
+    MObjectBase::load(reader);
+    mTexture = reader.read16();
+    mFactionId = reader.read16();
 }
 
 
-void MModel::load(std::istream &stream)
+void MModel::load(Misc::BinaryReader &reader)
 {
-    mModelIdx  = (int)VFS::read_le16(stream) * 100;
-    mModelIdx += stream.get();
-    mUnknown1 = stream.get();
-    mUnknown2 = VFS::read_le32(stream);
-    mUnknown3 = VFS::read_le32(stream);
-    mUnknown4 = VFS::read_le32(stream);
-    mNullValue1 = VFS::read_le32(stream);
-    mNullValue2 = VFS::read_le32(stream);
-    mUnknownX = VFS::read_le32(stream);
-    mUnknownY = VFS::read_le32(stream);
-    mUnknownZ = VFS::read_le32(stream);
-    mXPos = VFS::read_le32(stream);
-    mYPos = VFS::read_le32(stream);
-    mZPos = VFS::read_le32(stream);
-    mNullValue3 = VFS::read_le32(stream);
-    mYRotation = VFS::read_le16(stream);
-    mUnknown5 = VFS::read_le16(stream);
-    mUnknown6 = VFS::read_le32(stream);
-    mUnknown8 = VFS::read_le32(stream);
-    mNullValue4 = VFS::read_le16(stream);
+    mModelIdx  = (int)reader.read16() * 100;
+    mModelIdx += reader.read8();
+    gMModelLayout.read(reader, *this);
 }
 
-void MModel::allocate(const osg::Vec3 &pos, const osg::Quat &ori)
+void MModel::allocate(SceneStaging &scene, size_t blockid, const osg::Vec3 &pos, const osg::Quat &ori) const
 {
+    size_t id = blockid | mId;
     osg::ref_ptr<osg::MatrixTransform> node = new osg::MatrixTransform();
     node->setNodeMask(Renderer::Mask_Static);
-    node->setUserData(new ObjectRef(mId));
+    node->setUserData(new ObjectRef(id));
     node->addChild(Resource::MeshManager::get().get(mModelIdx));
-    Renderer::get().getObjectRoot()->addChild(node);
+    scene.addNode(id, node);
 
-    Renderer::get().setNode(mId, node);
-    Placeable::get().setPos(mId,
-        (ori * osg::Vec3f(mXPos, mYPos, mZPos)) + pos,
-        ori * osg::Quat(-mYRotation*3.14159f/1024.0f, osg::Vec3f(0.0f, 1.0f, 0.0f))
-    );
+    osg::Vec3f pt = (ori * osg::Vec3f(mXPos, mYPos, mZPos)) + pos;
+    osg::Quat rot = ori * osg::Quat(-mYRotation*3.14159f/1024.0f, osg::Vec3f(0.0f, 1.0f, 0.0f));
+    scene.defer([id, pt, rot]() { Placeable::get().setPos(id, pt, rot); });
 }
 
 void MModel::print(std::ostream &stream) const
 {
     DF::MObjectBase::print(stream);
     stream<< "ModelIdx: "<<mModelIdx<<"\n";
-    stream<< "Unknown: 0x"<<std::hex<<std::setw(2)<<(int)mUnknown1<<std::dec<<std::setw(0)<<"\n";
-    stream<< "Unknown: 0x"<<std::hex<<std::setw(8)<<mUnknown2<<std::dec<<std::setw(0)<<"\n";
-    stream<< "Unknown: 0x"<<std::hex<<std::setw(8)<<mUnknown3<<std::dec<<std::setw(0)<<"\n";
-    stream<< "Unknown: 0x"<<std::hex<<std::setw(8)<<mUnknown4<<std::dec<<std::setw(0)<<"\n";
-    stream<< "Null: "<<mNullValue1<<"\n";
-    stream<< "Null: "<<mNullValue2<<"\n";
-    stream<< "UnknownPos: "<<mUnknownX<<" "<<mUnknownY<<" "<<mUnknownZ<<"\n";
-    stream<< "Null: "<<mNullValue3<<"\n";
-    stream<< "YRotation: "<<mYRotation<<"\n";
-    stream<< "Unknown: 0x"<<std::hex<<std::setw(4)<<mUnknown5<<std::dec<<std::setw(0)<<"\n";
-    stream<< "Unknown: 0x"<<std::hex<<std::setw(8)<<mUnknown6<<std::dec<<std::setw(0)<<"\n";
-    stream<< "Unknown: 0x"<<std::hex<<std::setw(8)<<mUnknown8<<std::dec<<std::setw(0)<<"\n";
-    stream<< "Null: "<<mNullValue4<<"\n";
+    gMModelLayout.print(stream, *this, "");
 }
 
 
-void MBlock::load(std::istream &stream, size_t blockid)
+void MBlock::load(Misc::BinaryReader &reader, size_t blockid)
 {
-    mModelCount = stream.get();
-    mFlatCount = stream.get();
-    mSection3Count = stream.get();
-    mPersonCount = stream.get();
-    mDoorCount = stream.get();
-    mUnknown1 = VFS::read_le16(stream);
-    mUnknown2 = VFS::read_le16(stream);
-    mUnknown3 = VFS::read_le16(stream);
-    mUnknown4 = VFS::read_le16(stream);
-    mUnknown5 = VFS::read_le16(stream);
-    mUnknown6 = VFS::read_le16(stream);
+    mModelCount = reader.read8();
+    mFlatCount = reader.read8();
+    mSection3Count = reader.read8();
+    mPersonCount = reader.read8();
+    mDoorCount = reader.read8();
+    mUnknown1 = reader.read16();
+    mUnknown2 = reader.read16();
+    mUnknown3 = reader.read16();
+    mUnknown4 = reader.read16();
+    mUnknown5 = reader.read16();
+    mUnknown6 = reader.read16();
 
     mModels.reserve(mModelCount);
     for(size_t i = 0;i < mModelCount;++i)
     {
         MModel &model = mModels[blockid | i];
         model.mId = blockid | i;
-        model.load(stream);
+        model.load(reader);
     }
     mFlats.reserve(mFlatCount);
     for(size_t i = 0;i < mFlatCount;++i)
     {
         MFlat &flat = mFlats[blockid | (mModelCount+i)];
         flat.mId = blockid | (mModelCount+i);
-        flat.load(stream);
+        flat.load(reader);
     }
     mSection3s.resize(mSection3Count);
     for(MSection3 &sec3 : mSection3s)
-        sec3.load(stream);
+        sec3.load(reader);
     mNpcs.resize(mPersonCount);
     for(MPerson &npc : mNpcs)
-        npc.load(stream);
+        npc.load(reader);
     mDoors.resize(mDoorCount);
     for(MDoor &door : mDoors)
-        door.load(stream);
-}
-
-void MBlock::allocate(const osg::Vec3 &pos, const osg::Quat &ori)
-{
-    for(MModel &model : mModels)
-        model.allocate(pos, ori);
-    for(MFlat &flat : mFlats)
-        flat.allocate(pos, ori);
+        door.load(reader);
 }
 
-void MBlock::deallocate()
+void MBlock::allocate(SceneStaging &scene, size_t blockid, const osg::Vec3 &pos, const osg::Quat &ori,
+                      std::vector<size_t> &ids) const
 {
-    if(!mModels.empty())
+    for(const MModel &model : mModels)
     {
-        Renderer::get().remove(&*mModels.getIdList(), mModels.size());
-        Placeable::get().deallocate(&*mModels.getIdList(), mModels.size());
+        model.allocate(scene, blockid, pos, ori);
+        ids.push_back(blockid | model.mId);
     }
-    if(!mFlats.empty())
+    for(const MFlat &flat : mFlats)
     {
-        Renderer::get().remove(&*mFlats.getIdList(), mFlats.size());
-        Placeable::get().deallocate(&*mFlats.getIdList(), mFlats.size());
+        flat.allocate(scene, blockid, pos, ori);
+        ids.push_back(blockid | flat.mId);
     }
 }
 
 
-MObjectBase *MBlock::getObject(size_t id)
+const MObjectBase *MBlock::getObject(size_t id) const
 {
-    if(mModels.exists(id))
-        return &mModels[id];
-    return &mFlats[id];
+    auto model = mModels.find(id);
+    if(model != mModels.end())
+        return &*model;
+    auto flat = mFlats.find(id);
+    if(flat != mFlats.end())
+        return &*flat;
+    return nullptr;
 }
 
 
-void MBlockPosition::load(std::istream &stream)
+void MBlockPosition::load(Misc::BinaryReader &reader)
+{
+    gMBlockPositionLayout.read(reader, *this);
+}
+
+void MBlockPosition::print(std::ostream &stream, const char *indent) const
 {
-    mUnknown1 = VFS::read_le32(stream);
-    mUnknown2 = VFS::read_le32(stream);
-    mX = VFS::read_le32(stream);
-    mZ = VFS::read_le32(stream);
-    mYRot = VFS::read_le32(stream);
+    gMBlockPositionLayout.print(stream, *this, indent);
 }
 
 
-MBlockHeader::MBlockHeader() : mTerrainId(~static_cast<size_t>(0)) { }
-MBlockHeader::~MBlockHeader()
+MBlockData::MBlockData() { }
+MBlockData::~MBlockData() { }
+
+void MBlockData::load(Misc::BinaryReader &reader)
 {
-    deallocate();
+    mBlockCount = reader.read8();
+    mModelCount = reader.read8();
+    mFlatCount = reader.read8();
+
+    for(MBlockPosition &blockpos : mBlockPositions)
+        blockpos.load(reader);
+    for(ExteriorBuilding &building : mBuildings)
+        building.load(reader);
+    reader.read32(mUnknown1.data(), mUnknown1.size());
+    reader.read32(mBlockSizes.data(), mBlockSizes.size());
+
+    reader.read(mUnknown2.data(), mUnknown2.size());
+    reader.read(mGroundTexture.data(), mGroundTexture.size());
+    reader.read(mGroundScenery.data(), mGroundScenery.size());
+    reader.read(mAutomap.data(), mAutomap.size());
+
+    // Unused list? An array of 33 8.3 filenames are here...
+    reader.skip(429);
+
+    mExteriorBlocks.resize(mBlockCount);
+    mInteriorBlocks.resize(mBlockCount);
+    for(size_t i = 0;i < mBlockCount;++i)
+    {
+        size_t pos = reader.tell();
+        mExteriorBlocks[i].load(reader, (i<<17) | 0x00000);
+
+        mInteriorBlocks[i].load(reader, (i<<17) | 0x10000);
+        reader.seek(pos + mBlockSizes[i]);
+    }
+
+    mModels.reserve(mModelCount);
+    for(size_t i = 0;i < mModelCount;++i)
+    {
+        MModel &model = mModels[0x00ff0000 | i];
+        model.mId = 0x00ff0000 | i;
+        model.load(reader);
+    }
+    mFlats.reserve(mFlatCount);
+    for(size_t i = 0;i < mFlatCount;++i)
+    {
+        MFlat &flat = mFlats[0x00ff0000 | (mModelCount+i)];
+        flat.mId = 0x00ff0000 | (mModelCount+i);
+        flat.load(reader);
+    }
 }
 
-void MBlockHeader::deallocate()
+const MObjectBase *MBlockData::getObject(size_t id) const
 {
-    if(!mModels.empty())
+    if(((id>>16)&0xff) == 0xff)
     {
-        Renderer::get().remove(&*mModels.getIdList(), mModels.size());
-        Placeable::get().deallocate(&*mModels.getIdList(), mModels.size());
+        auto model = mModels.find(id);
+        if(model != mModels.end())
+            return &*model;
+        auto flat = mFlats.find(id);
+        if(flat != mFlats.end())
+            return &*flat;
+        return nullptr;
     }
-    if(!mFlats.empty())
+    if(!(id&0x10000))
+        return mExteriorBlocks.at((id>>17)&0x7f).getObject(id);
+    else
+        return mInteriorBlocks.at((id>>17)&0x7f).getObject(id);
+}
+
+size_t MBlockData::getMemoryUsage() const
+{
+    size_t total = sizeof(*this);
+    for(const std::vector<MBlock> *blocks : { &mExteriorBlocks, &mInteriorBlocks })
     {
-        Renderer::get().remove(&*mFlats.getIdList(), mFlats.size());
-        Placeable::get().deallocate(&*mFlats.getIdList(), mFlats.size());
+        total += blocks->capacity() * sizeof(MBlock);
+        for(const MBlock &block : *blocks)
+            total += block.getMemoryUsage();
     }
-    if(!mScenery.empty())
+    total += mModels.size() * (sizeof(MModel)+sizeof(size_t));
+    total += mFlats.size() * (sizeof(MFlat)+sizeof(size_t));
+    return total;
+}
+
+
+MBlockHeader::MBlockHeader() : mBlockId(0), mTerrainId(~static_cast<size_t>(0)) { }
+MBlockHeader::~MBlockHeader() { }
+
+void MBlockHeader::deallocate()
+{
+    if(!mObjectIds.empty())
     {
-        Renderer::get().remove(&*mScenery.getIdList(), mScenery.size());
-        Placeable::get().deallocate(&*mScenery.getIdList(), mScenery.size());
+        Renderer::get().remove(mObjectIds.data(), mObjectIds.size());
+        Placeable::get().deallocate(mObjectIds.data(), mObjectIds.size());
+        mObjectIds.clear();
     }
     if(mTerrainId != ~static_cast<size_t>(0))
     {
@@ -349,8 +437,12 @@ void MBlockHeader::deallocate()
 }
 
 
-void MBlockHeader::load(std::istream &stream, uint8_t climate, size_t blockid, float x, float z)
+void MBlockHeader::allocate(std::shared_ptr<const MBlockData> data, SceneStaging &scene, uint8_t climate, size_t blockid, float x, float z)
 {
+    mData = std::move(data);
+    mBlockId = blockid;
+    const MBlockData &block = *mData;
+
     size_t texfile = 0;
     if(climate == 223) texfile = 502<<7;
     else if(climate == 224) texfile = 503<<7;
@@ -363,93 +455,52 @@ void MBlockHeader::load(std::istream &stream, uint8_t climate, size_t blockid, f
     else if(climate == 231) texfile = 508<<7;
     else if(climate == 232) texfile = 508<<7;
 
-    mBlockCount = stream.get();
-    mModelCount = stream.get();
-    mFlatCount = stream.get();
-
-    for(MBlockPosition &blockpos : mBlockPositions)
-        blockpos.load(stream);
-    for(ExteriorBuilding &building : mBuildings)
+    for(size_t i = 0;i < block.mGroundScenery.size();++i)
     {
-        building.mNameSeed = VFS::read_le16(stream);
-        building.mNullValue1 = VFS::read_le32(stream);
-        building.mNullValue2 = VFS::read_le32(stream);
-        building.mNullValue3 = VFS::read_le32(stream);
-        building.mNullValue4 = VFS::read_le32(stream);
-        building.mFactionId = VFS::read_le16(stream);
-        building.mSector = VFS::read_le16(stream);
-        building.mLocationId = VFS::read_le16(stream);
-        building.mBuildingType = stream.get();
-        building.mQuality = stream.get();
-    }
-    for(uint32_t &unknown : mUnknown1)
-        unknown = VFS::read_le32(stream);
-    for(uint32_t &size : mBlockSizes)
-        size = VFS::read_le32(stream);
-
-    stream.read(reinterpret_cast<char*>(mUnknown2.data()), mUnknown2.size());
-    stream.read(reinterpret_cast<char*>(mGroundTexture.data()), mGroundTexture.size());
-    stream.read(reinterpret_cast<char*>(mGroundScenery.data()), mGroundScenery.size());
-    stream.read(reinterpret_cast<char*>(mAutomap.data()), mAutomap.size());
-
-    // Unused list? An array of 33 8.3 filenames are here...
-    stream.ignore(429);
-
-    mExteriorBlocks.resize(mBlockCount);
-    mInteriorBlocks.resize(mBlockCount);
-    for(size_t i = 0;i < mBlockCount;++i)
-    {
-        size_t pos = stream.tellg();
-        mExteriorBlocks[i].load(stream, blockid | (i<<17) | 0x00000);
-
-        mInteriorBlocks[i].load(stream, blockid | (i<<17) | 0x10000);
-        stream.seekg(pos + mBlockSizes[i]);
-    }
-
-    mModels.reserve(mModelCount);
-    for(size_t i = 0;i < mModelCount;++i)
-    {
-        MModel &model = mModels[blockid | 0x00ff0000 | i];
-        model.mId = blockid | 0x00ff0000 | i;
-        model.load(stream);
-    }
-    mFlats.reserve(mFlatCount);
-    for(size_t i = 0;i < mFlatCount;++i)
-    {
-        MFlat &flat = mFlats[blockid | 0x00ff0000 | (mModelCount+i)];
-        flat.mId = blockid | 0x00ff0000 | (mModelCount+i);
-        flat.load(stream);
-    }
-    for(size_t i = 0;i < mGroundScenery.size();++i)
-    {
-        if(mGroundScenery[i] == 0xff)
+        if(block.mGroundScenery[i] == 0xff)
             continue;
 
-        MFlat &flat = mScenery[blockid | 0x00ff0000 | (mModelCount+mFlatCount+i)];
-        flat.mId = blockid | 0x00ff0000 | (mModelCount+mFlatCount+i);
+        size_t id = blockid | 0x00ff0000 | (block.mModelCount+block.mFlatCount+i);
+        MFlat &flat = mScenery[id];
+        flat.mId = id;
         flat.mXPos = (i%16) * 256.0f;
         flat.mYPos = 0.0f;
         flat.mZPos = (i/16) * -256.0f;
-        flat.mTexture = texfile | (mGroundScenery[i]>>2);
+        flat.mTexture = texfile | (block.mGroundScenery[i]>>2);
         flat.mUnknown = 0;
         flat.mFlags = 0;
     }
 
     osg::Vec3f basepos(x, 0.0f, z);
-    for(size_t i = 0;i < mBlockCount;++i)
-        mExteriorBlocks[i].allocate(
-            basepos + osg::Vec3(mBlockPositions[i].mX, 0.0f, -mBlockPositions[i].mZ),
-            osg::Quat(-mBlockPositions[i].mYRot*3.14159f/1024.0f, osg::Vec3f(0.0f, 1.0f, 0.0f))
+    for(size_t i = 0;i < block.mBlockCount;++i)
+        block.mExteriorBlocks[i].allocate(scene, blockid,
+            basepos + osg::Vec3(block.mBlockPositions[i].mX, 0.0f, -block.mBlockPositions[i].mZ),
+            osg::Quat(-block.mBlockPositions[i].mYRot*3.14159f/1024.0f, osg::Vec3f(0.0f, 1.0f, 0.0f)),
+            mObjectIds
         );
-    for(MModel &model : mModels)
-        model.allocate(basepos, osg::Quat());
-    for(MFlat &flat : mFlats)
-        flat.allocate(basepos, osg::Quat());
-    for(MFlat &flat : mScenery)
-        flat.allocate(basepos, osg::Quat());
-
-    // Load up terrain...
-    texfile = 2;
+    for(const MModel &model : block.mModels)
+    {
+        model.allocate(scene, blockid, basepos, osg::Quat());
+        mObjectIds.push_back(blockid | model.mId);
+    }
+    for(const MFlat &flat : block.mFlats)
+    {
+        flat.allocate(scene, blockid, basepos, osg::Quat());
+        mObjectIds.push_back(blockid | flat.mId);
+    }
+    for(const MFlat &flat : mScenery)
+    {
+        flat.allocate(scene, 0, basepos, osg::Quat());
+        mObjectIds.push_back(flat.mId);
+    }
+
+    mTerrainId = blockid | 0x00ffffff;
+    allocateTerrain(scene, mTerrainId, climate, block.mGroundTexture.data(), x, z);
+}
+
+void MBlockHeader::allocateTerrain(SceneStaging &scene, size_t id, uint8_t climate, const uint8_t *groundtex, float x, float z)
+{
+    size_t texfile = 2;
     if(climate == 223) texfile = 402<<7;
     else if(climate == 224) texfile = 002<<7;
     else if(climate == 225) texfile = 002<<7;
@@ -461,73 +512,68 @@ void MBlockHeader::load(std::istream &stream, uint8_t climate, size_t blockid, f
     else if(climate == 231) texfile = 302<<7;
     else if(climate == 232) texfile = 302<<7;
 
-    mTerrainId = blockid | 0x00ffffff;
     osg::ref_ptr<osg::MatrixTransform> terrainbase(new osg::MatrixTransform());
     terrainbase->setNodeMask(Renderer::Mask_Static);
-    //terrainbase->setUserData(new ObjectRef(mTerrainId));
+    //terrainbase->setUserData(new ObjectRef(id));
     terrainbase->addChild(Resource::MeshManager::get().getTerrain(16));
     {
         osg::StateSet *ss = terrainbase->getOrCreateStateSet();
         ss->setTextureAttribute(0, Resource::TextureManager::get().getTerrainTileset(texfile));
-        ss->setTextureAttribute(1, Resource::TextureManager::get().createTerrainMap(mGroundTexture.data(), 16));
+        ss->setTextureAttribute(1, Resource::TextureManager::get().createTerrainMap(groundtex, 16));
     }
-    Renderer::get().getObjectRoot()->addChild(terrainbase);
+    scene.addNode(id, terrainbase);
 
-    Renderer::get().setNode(mTerrainId, terrainbase);
     // Slight Y offset because some planes lay exactly on Y=0 and would Z-fight horribly.
-    Placeable::get().setPoint(mTerrainId, basepos + osg::Vec3(0.0f, 0.125f, 0.0f));
+    osg::Vec3f terrainpos(x, 0.125f, z);
+    scene.defer([id, terrainpos]() { Placeable::get().setPoint(id, terrainpos); });
+}
+
+size_t MBlockHeader::getMemoryUsage() const
+{
+    return sizeof(*this) + mScenery.size()*(sizeof(MFlat)+sizeof(size_t)) +
+           mObjectIds.capacity()*sizeof(size_t);
 }
 
 
-MObjectBase *MBlockHeader::getObject(size_t id)
+const MObjectBase *MBlockHeader::getObject(size_t id) const
 {
-    if(((id>>16)&0xff) == 0xff)
-    {
-        auto model = mModels.find(id);
-        if(model != mModels.end())
-            return &*model;
-        auto flat = mFlats.find(id);
-        if(flat != mFlats.end())
-            return &*flat;
-        return &mScenery.at(id);
-    }
-    if(!(id&0x10000))
-        return mExteriorBlocks.at((id>>17)&0x7f).getObject(id);
-    else
-        return mInteriorBlocks.at((id>>17)&0x7f).getObject(id);
+    auto scenery = mScenery.find(id);
+    if(scenery != mScenery.end())
+        return &*scenery;
+    return mData->getObject(id & 0x00ffffff);
 }
 
 size_t MBlockHeader::getObjectByTexture(size_t texid) const
 {
-    for(const MFlat &flat : mFlats)
+    for(const MFlat &flat : mData->mFlats)
     {
         if(flat.mTexture == texid)
-            return flat.mId;
+            return mBlockId | flat.mId;
     }
     Log::get().stream(Log::Level_Error)<< "Failed to find Flat with texture 0x"<<std::setfill('0')<<std::setw(4)<<std::hex<<texid;
     return ~static_cast<size_t>(0);
 }
 
 
-void MBlockHeader::print(std::ostream& stream) const
+void MBlockHeader::print(std::ostream &stream) const
+{
+    mData->print(stream);
+}
+
+void MBlockData::print(std::ostream &stream) const
 {
     stream<< "BlockCount: "<<(int)mBlockCount <<std::endl;
     stream<< "ModelCount: "<<(int)mModelCount <<std::endl;
     stream<< "FlatCount: "<<(int)mFlatCount <<std::endl;
-    //std::array<MBlockPosition,32> mBlockPositions;
+    for(size_t i = 0;i < mBlockCount && i < mBlockPositions.size();++i)
+    {
+        stream<< "*** Block position "<<i <<std::endl;
+        mBlockPositions[i].print(stream, "");
+    }
     for(const ExteriorBuilding &building : mBuildings)
     {
         stream<< "*** Building "<<std::distance(mBuildings.data(), &building) <<std::endl;
-        stream<< "NameSeed: 0x"<<std::hex<<std::setw(4)<<building.mNameSeed<<std::dec<<std::setw(0) <<std::endl;
-        /*mNullValue1;
-        mNullValue2;
-        mNullValue3;
-        mNullValue4;*/
-        stream<< "FactionId: 0x"<<std::hex<<std::setw(4)<<building.mFactionId<<std::dec<<std::setw(0) <<std::endl;
-        stream<< "Sector: 0x"<<std::hex<<std::setw(4)<<building.mSector<<std::dec<<std::setw(0) <<std::endl;
-        stream<< "LocationID: 0x"<<std::hex<<std::setw(4)<<building.mLocationId<<std::dec<<std::setw(0) <<std::endl;
-        stream<< "BuildingType: 0x"<<std::hex<<std::setw(4)<<(int)building.mBuildingType<<std::dec<<std::setw(0) <<std::endl;
-        stream<< "Quality: "<<(int)building.mQuality <<std::endl;
+        building.print(stream, "");
     }
     stream<< "Unknown:";
     for(uint32_t unk : mUnknown1)
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <vector>
 #include <array>
+#include <memory>
 
 #include "misc/sparsearray.hpp"
 
@@ -18,7 +19,7 @@ struct MObjectBase {
 
     int32_t mXPos, mYPos, mZPos;
 
-    void load(std::istream &stream);
+    void load(Misc::BinaryReader &reader);
 
     virtual void print(std::ostream &stream) const;
 };
@@ -30,6 +31,8 @@ struct MDoor;
 
 struct MBlock;
 
+class SceneStaging;
+
 
 struct MBlockPosition {
     uint32_t mUnknown1;
@@ -38,10 +41,16 @@ struct MBlockPosition {
     int32_t mZ;
     int32_t mYRot;
 
-    void load(std::istream &stream);
+    void load(Misc::BinaryReader &reader);
+    void print(std::ostream &stream, const char *indent) const;
 };
 
-struct MBlockHeader {
+/* The parsed contents of an RMB file. It doesn't change once loaded, so one
+ * is shared by every block using the file (see MBlockCache). Object IDs are
+ * relative to the block, with the upper 8 bits clear, and a block instance
+ * puts its own block ID in them.
+ */
+struct MBlockData {
     uint8_t mBlockCount;
     uint8_t mModelCount;
     uint8_t mFlatCount;
@@ -69,16 +78,54 @@ struct MBlockHeader {
 
     Misc::SparseArray<MModel> mModels;
     Misc::SparseArray<MFlat> mFlats;
+
+    MBlockData();
+    ~MBlockData();
+
+    /* Only decodes, without touching the scene graph or object systems, so
+     * it's safe anywhere. */
+    void load(Misc::BinaryReader &reader);
+
+    const MObjectBase *getObject(size_t id) const;
+
+    // Approximate heap and object size, in bytes.
+    size_t getMemoryUsage() const;
+
+    void print(std::ostream &stream) const;
+};
+
+/* An exterior block placed in the world, using shared parsed data. */
+struct MBlockHeader {
+    std::shared_ptr<const MBlockData> mData;
+    size_t mBlockId;
+
+    // Ground scenery, which depends on the climate.
     Misc::SparseArray<MFlat> mScenery;
+    // Everything registered with the object systems, other than the terrain.
+    std::vector<size_t> mObjectIds;
     size_t mTerrainId;
 
     MBlockHeader();
     ~MBlockHeader();
+    /* Removes the block's objects from the object systems. Destroying the
+     * block doesn't, so one built but never swapped in can be dropped from
+     * any thread. */
     void deallocate();
 
-    void load(std::istream &stream, uint8_t climate, size_t blockid, float x, float z);
+    /* Builds the block's scene from the parsed data into the given
+     * staging. */
+    void allocate(std::shared_ptr<const MBlockData> data, SceneStaging &scene, uint8_t climate, size_t blockid, float x, float z);
+
+    /* Builds a block-sized terrain patch with the given object ID, using the
+     * climate's tileset and 16x16 ground texture bytes (see mGroundTexture).
+     * Used for blocks and for the wilderness between locations. */
+    static void allocateTerrain(SceneStaging &scene, size_t id, uint8_t climate, const uint8_t *groundtex, float x, float z);
+
+    // Approximate heap and object size, in bytes, not counting the shared
+    // data.
+    size_t getMemoryUsage() const;
 
-    MObjectBase *getObject(size_t id);
+    const MObjectBase *getObject(size_t id) const;
 
     /* Object types are (apparently) identified by what Texture ID they use.
      * For instance, 0x638A (the 10th entry of TEXTURE.199) is the "Start"
@@ -5,7 +5,7 @@
 #include <iomanip>
 #include <array>
 
-#include "components/vfs/manager.hpp"
+#include "misc/recordlayout.hpp"
 
 #include "log.hpp"
 
@@ -61,51 +61,93 @@ static const std::array<std::array<char,5>,45> gBuildingLabel{{
     {"WITC"}
 }};
 
+constexpr auto gExteriorBuildingLayout = Misc::layout(
+    Misc::field(&DF::ExteriorBuilding::mNameSeed, "NameSeed", Misc::Field_Hex),
+    Misc::field(&DF::ExteriorBuilding::mNullValue1, "Null", Misc::Field_Hidden),
+    Misc::field(&DF::ExteriorBuilding::mNullValue2, "Null", Misc::Field_Hidden),
+    Misc::field(&DF::ExteriorBuilding::mNullValue3, "Null", Misc::Field_Hidden),
+    Misc::field(&DF::ExteriorBuilding::mNullValue4, "Null", Misc::Field_Hidden),
+    Misc::field(&DF::ExteriorBuilding::mFactionId, "FactionId", Misc::Field_Hex),
+    Misc::field(&DF::ExteriorBuilding::mSector, "Sector", Misc::Field_Hex),
+    Misc::field(&DF::ExteriorBuilding::mLocationId, "LocationId", Misc::Field_Hex),
+    Misc::field(&DF::ExteriorBuilding::mBuildingType, "BuildingType", Misc::Field_Hex),
+    Misc::field(&DF::ExteriorBuilding::mQuality, "Quality", Misc::Field_Hex)
+);
+static_assert(gExteriorBuildingLayout.size() == 26, "ExteriorBuilding must be 26 bytes");
+
+/* Follows the location header, before the building list */
+constexpr auto gExteriorLocationLayout1 = Misc::layout(
+    Misc::field(&DF::ExteriorLocation::mBuildingCount, "BuildingCount"),
+    Misc::field(&DF::ExteriorLocation::mUnknown1, "Unknown", Misc::Field_Hex)
+);
+static_assert(gExteriorLocationLayout1.size() == 7, "ExteriorLocation must have 7 bytes before the buildings");
+
+/* Follows the building list */
+constexpr auto gExteriorLocationLayout2 = Misc::layout(
+    Misc::field(&DF::ExteriorLocation::mName, "Name", Misc::Field_String),
+    Misc::field(&DF::ExteriorLocation::mMapId, "MapId", Misc::Field_Hex),
+    Misc::field(&DF::ExteriorLocation::mUnknown2, "Unknown", Misc::Field_Hex),
+    Misc::field(&DF::ExteriorLocation::mWidth, "Width"),
+    Misc::field(&DF::ExteriorLocation::mHeight, "Height"),
+    Misc::field(&DF::ExteriorLocation::mUnknown3, "Unknown", Misc::Field_Hex),
+    Misc::field(&DF::ExteriorLocation::mBlockIndex, "BlockIndex", Misc::Field_Hidden),
+    Misc::field(&DF::ExteriorLocation::mBlockNumber, "BlockNumber", Misc::Field_Hidden),
+    Misc::field(&DF::ExteriorLocation::mBlockCharacter, "BlockCharacter", Misc::Field_Hidden),
+    Misc::field(&DF::ExteriorLocation::mName2, "Name2", Misc::Field_String),
+    Misc::field(&DF::ExteriorLocation::mUnknown4, "Unknown", Misc::Field_Hex),
+    Misc::field(&DF::ExteriorLocation::mUnknownCount, "UnknownCount"),
+    Misc::field(&DF::ExteriorLocation::mNullValue1, "Null", Misc::Field_Hidden),
+    Misc::field(&DF::ExteriorLocation::mNullValue2, "Null", Misc::Field_Hidden),
+    Misc::field(&DF::ExteriorLocation::mNullValue3, "Null", Misc::Field_Hidden),
+    Misc::field(&DF::ExteriorLocation::mUnknown5, "Unknown", Misc::Field_Hex),
+    Misc::field(&DF::ExteriorLocation::mUnknown6, "Unknown", Misc::Field_Hex)
+);
+static_assert(gExteriorLocationLayout2.size() == 416, "ExteriorLocation must have 416 bytes after the buildings");
+
 }
 
 namespace DF
 {
 
-void ExteriorLocation::load(std::istream& stream)
+void ExteriorBuilding::load(Misc::BinaryReader &reader)
+{
+    gExteriorBuildingLayout.read(reader, *this);
+}
+
+void ExteriorBuilding::save(Misc::BinaryWriter &writer) const
+{
+    gExteriorBuildingLayout.write(writer, *this);
+}
+
+void ExteriorBuilding::print(std::ostream &stream, const char *indent) const
+{
+    gExteriorBuildingLayout.print(stream, *this, indent);
+}
+
+
+void ExteriorLocation::load(Misc::BinaryReader &reader)
 {
-    LocationHeader::load(stream);
+    LocationHeader::load(reader);
 
-    uint16_t mBuildingCount = VFS::read_le16(stream);
-    stream.read(reinterpret_cast<char*>(mUnknown1), sizeof(mUnknown1));
+    gExteriorLocationLayout1.read(reader, *this);
 
     mBuildings.resize(mBuildingCount);
     for(ExteriorBuilding &building : mBuildings)
-    {
-        building.mNameSeed = VFS::read_le16(stream);
-        building.mNullValue1 = VFS::read_le32(stream);
-        building.mNullValue2 = VFS::read_le32(stream);
-        building.mNullValue3 = VFS::read_le32(stream);
-        building.mNullValue4 = VFS::read_le32(stream);
-        building.mFactionId = VFS::read_le16(stream);
-        building.mSector = VFS::read_le16(stream);
-        building.mLocationId = VFS::read_le16(stream);
-        building.mBuildingType = stream.get();
-        building.mQuality = stream.get();
-    }
+        building.load(reader);
+
+    gExteriorLocationLayout2.read(reader, *this);
+}
+
+void ExteriorLocation::save(Misc::BinaryWriter &writer) const
+{
+    LocationHeader::save(writer);
+
+    gExteriorLocationLayout1.write(writer, *this);
+
+    for(const ExteriorBuilding &building : mBuildings)
+        building.save(writer);
 
-    stream.read(mName, sizeof(mName));
-    mMapId = VFS::read_le32(stream);
-    mUnknown2 = VFS::read_le32(stream);
-    mWidth = stream.get();
-    mHeight = stream.get();
-    stream.read(reinterpret_cast<char*>(mUnknown3), sizeof(mUnknown3));
-    stream.read(reinterpret_cast<char*>(mBlockIndex), sizeof(mBlockIndex));
-    stream.read(reinterpret_cast<char*>(mBlockNumber), sizeof(mBlockNumber));
-    stream.read(reinterpret_cast<char*>(mBlockCharacter), sizeof(mBlockCharacter));
-    stream.read(mName2, sizeof(mName2));
-    mUnknown4 = stream.get();
-    mUnknownCount = stream.get();
-    mNullValue1 = VFS::read_le32(stream);
-    mNullValue2 = VFS::read_le32(stream);
-    mNullValue3 = stream.get();
-    for(uint32_t &val : mUnknown5)
-        val = VFS::read_le32(stream);
-    mUnknown6 = VFS::read_le32(stream);
+    gExteriorLocationLayout2.write(writer, *this);
 }
 
 std::string ExteriorLocation::getMapBlockName(size_t idx, size_t regnum) const
@@ -158,53 +200,15 @@ std::string ExteriorLocation::getMapBlockName(size_t idx, size_t regnum) const
 
 LogStream& operator<<(LogStream &stream, const ExteriorLocation &ext)
 {
-    stream<< static_cast<const LocationHeader&>(ext) <<"\n";
-    stream<<std::setfill('0');
-
-    stream<< "  BuildingCount: "<<ext.mBuildingCount<<"\n";
-    stream<< "  Unknown:";//<<std::hex<<std::setw(2);
-    for(uint32_t unk : ext.mUnknown1)
-        stream<< " 0x"<<std::hex<<std::setw(2)<<unk;
-    stream<<std::setw(0)<<std::dec<<"\n";
-
-    for(size_t i = 0;i < ext.mBuildingCount;++i)
+    stream<< static_cast<const LocationHeader&>(ext);
+    gExteriorLocationLayout1.print(stream, ext, "  ");
+    for(const ExteriorBuilding &building : ext.mBuildings)
     {
-        const ExteriorBuilding &building = ext.mBuildings[i];
-        stream<< "  Building "<<i<<"\n";
-        stream<< "    NameSeed: 0x"<<std::hex<<std::setw(4)<<building.mNameSeed<<std::setw(0)<<std::dec<<"\n";
-        stream<< "    FactionId: 0x"<<std::hex<<std::setw(4)<<building.mFactionId<<std::setw(0)<<std::dec<<"\n";
-        stream<< "    Sector: 0x"<<std::hex<<std::setw(4)<<building.mSector<<std::setw(0)<<std::dec<<"\n";
-        stream<< "    LocationId: 0x"<<std::hex<<std::setw(4)<<building.mLocationId<<std::setw(0)<<std::dec<<"\n";
-        stream<< "    BuildingType: 0x"<<std::hex<<std::setw(2)<<(int)building.mBuildingType<<std::setw(0)<<std::dec<<"\n";
-        stream<< "    Quality: 0x"<<std::hex<<std::setw(2)<<(int)building.mQuality<<std::setw(0)<<std::dec<<"\n";
+        stream<< "  Building "<<std::distance(ext.mBuildings.data(), &building)<<"\n";
+        gExteriorBuildingLayout.print(stream, building, "    ");
     }
+    gExteriorLocationLayout2.print(stream, ext, "  ");
 
-    stream<< "  Name: \""<<ext.mName<<"\"\n";
-    stream<< "  MapId: 0x"<<std::hex<<std::setw(8)<<ext.mMapId<<std::setw(0)<<std::dec<<"\n";
-    stream<< "  Unknown: 0x"<<std::hex<<std::setw(8)<<ext.mUnknown2<<std::setw(0)<<std::dec<<"\n";
-    stream<< "  Width: "<<(int)ext.mWidth<<"\n";
-    stream<< "  Height: "<<(int)ext.mHeight<<"\n";
-    stream<< "  Unknown:";
-    for(uint32_t unk : ext.mUnknown3)
-        stream<< " 0x"<<std::hex<<std::setw(2)<<unk;
-    stream<<std::setw(0)<<std::dec<<"\n";
-    /*uint8_t  mBlockIndex[64];
-    uint8_t  mBlockNumber[64];
-    uint8_t  mBlockCharacter[64];*/
-    stream<< "  Name2: \""<<ext.mName2<<"\"\n";
-    stream<< "  Unknown: 0x"<<std::hex<<std::setw(2)<<(int)ext.mUnknown4<<std::setw(0)<<std::dec<<"\n";
-    stream<< "  UnknownCount: "<<(int)ext.mUnknownCount<<"\n";
-    /*uint32_t mNullValue1;
-    uint32_t mNullValue2;
-    uint8_t  mNullValue3;*/
-    stream<< "  Unknown:";
-    for(uint32_t unk : ext.mUnknown5)
-        stream<< " 0x"<<std::hex<<std::setw(8)<<unk;
-    stream<<std::setw(0)<<std::dec<<"\n";
-    /*uint8_t  mNullValue4[40];*/
-    stream<< "  Unknown: 0x"<<std::hex<<std::setw(8)<<ext.mUnknown6<<std::setw(0)<<std::dec<<"\n";
-
-    stream<<std::setfill(' ');
     return stream;
 }
 
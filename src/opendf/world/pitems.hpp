@@ -20,6 +20,10 @@ struct ExteriorBuilding {
     uint16_t mLocationId;
     uint8_t  mBuildingType;
     uint8_t  mQuality;
+
+    void load(Misc::BinaryReader &reader);
+    void save(Misc::BinaryWriter &writer) const;
+    void print(std::ostream &stream, const char *indent) const;
 };
 
 struct ExteriorLocation : public LocationHeader {
@@ -46,7 +50,8 @@ struct ExteriorLocation : public LocationHeader {
     uint32_t mUnknown5[32];
     uint32_t mUnknown6;
 
-    void load(std::istream &stream);
+    void load(Misc::BinaryReader &reader);
+    void save(Misc::BinaryWriter &writer) const;
 
     std::string getMapBlockName(size_t idx, size_t regnum) const;
 };
@@ -0,0 +1,44 @@
+#include "scenestaging.hpp"
+
+#include <osg/MatrixTransform>
+
+#include "render/renderer.hpp"
+
+
+namespace DF
+{
+
+SceneStaging::SceneStaging()
+  : mRoot(new osg::Group()), mNextDeferred(0)
+{
+}
+
+SceneStaging::~SceneStaging()
+{
+}
+
+
+void SceneStaging::addNode(size_t idx, osg::MatrixTransform *node)
+{
+    mRoot->addChild(node);
+
+    osg::ref_ptr<osg::MatrixTransform> base(node);
+    mDeferred.push_back([idx, base]() { Renderer::get().setNode(idx, base); });
+}
+
+size_t SceneStaging::commit(size_t count)
+{
+    while(count > 0 && mNextDeferred < mDeferred.size())
+    {
+        mDeferred[mNextDeferred++]();
+        --count;
+    }
+    if(mNextDeferred == mDeferred.size())
+    {
+        mDeferred.clear();
+        mNextDeferred = 0;
+    }
+    return getPendingCount();
+}
+
+} // namespace DF
@@ -0,0 +1,57 @@
+#ifndef WORLD_SCENESTAGING_HPP
+#define WORLD_SCENESTAGING_HPP
+
+#include <vector>
+#include <functional>
+
+#include <osg/ref_ptr>
+#include <osg/Group>
+
+
+namespace osg
+{
+    class MatrixTransform;
+}
+
+namespace DF
+{
+
+/* Collects the scene nodes and object registrations of a location while it's
+ * being built, so building can happen away from the main thread. Nodes go
+ * under a root that isn't part of the scene yet, and anything touching the
+ * object systems (Renderer, Placeable, Activator, etc, which are only safe to
+ * use on the main thread) is deferred until commit().
+ */
+class SceneStaging {
+    osg::ref_ptr<osg::Group> mRoot;
+    std::vector<std::function<void()>> mDeferred;
+    size_t mNextDeferred;
+
+    SceneStaging(const SceneStaging&) = delete;
+    SceneStaging& operator=(const SceneStaging&) = delete;
+
+public:
+    SceneStaging();
+    ~SceneStaging();
+
+    osg::Group *getRoot() const { return mRoot; }
+
+    /* Adds an object's base node under the root, to be registered with the
+     * Renderer on commit. */
+    void addNode(size_t idx, osg::MatrixTransform *node);
+
+    void defer(std::function<void()>&& func) { mDeferred.push_back(std::move(func)); }
+
+    /* Runs the deferred registrations, in the order they were made. Must be
+     * called from the main thread. */
+    void commit() { commit(~static_cast<size_t>(0)); }
+    /* Runs up to count of the remaining deferred registrations, so committing
+     * can be spread over several frames. Returns how many are left. */
+    size_t commit(size_t count);
+
+    size_t getPendingCount() const { return mDeferred.size() - mNextDeferred; }
+};
+
+} // namespace DF
+
+#endif /* WORLD_SCENESTAGING_HPP */
@@ -0,0 +1,500 @@
+#include "streamer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <array>
+#include <cmath>
+
+#include <osg/Vec2f>
+
+#include "render/renderer.hpp"
+#include "class/placeable.hpp"
+#include "components/vfs/manager.hpp"
+#include "mblocks.hpp"
+#include "mblockcache.hpp"
+#include "scenestaging.hpp"
+#include "cvars.hpp"
+#include "log.hpp"
+
+
+namespace
+{
+
+static const size_t InvalidSlot = ~static_cast<size_t>(0);
+// Slots go in the upper 8 bits of object IDs, leaving 255 unused so no ID
+// is all ones.
+static const size_t MaxSlots = 255;
+// Deferred registrations run between checks of the frame budget.
+static const size_t CommitChunk = 32;
+
+typedef std::chrono::steady_clock Clock;
+
+double millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double,std::milli>(Clock::now() - start).count();
+}
+
+// Ground texture for wilderness tiles, all procedural.
+std::array<uint8_t,256> gWildernessGround = []() {
+    std::array<uint8_t,256> ground;
+    ground.fill(0xff);
+    return ground;
+}();
+
+} // namespace
+
+
+namespace DF
+{
+
+// Tiles to stream in around the camera's tile, in each direction.
+CVAR(CVarInt, world_stream_radius, 3, 1, 7);
+// Most location blocks to keep resident.
+CVAR(CVarInt, world_stream_maxblocks, 96, 1, 254);
+// Milliseconds per frame for registering built tiles.
+CVAR(CVarInt, world_stream_budget, 2, 1, 50);
+// Most tiles being built at once.
+CVAR(CVarInt, world_stream_builds, 4, 1, 32);
+
+
+struct WorldStreamer::Tile {
+    enum State {
+        State_Building,
+        State_Committing,
+        State_Resident
+    };
+
+    int mX, mZ;
+    size_t mSlot;
+    StreamTileInfo mInfo;
+    osg::Vec3f mBasePos;
+    State mState;
+
+    std::unique_ptr<MBlockHeader> mBlock;
+    // The terrain of a wilderness tile.
+    size_t mTerrainId;
+    SceneStaging mScene;
+
+    std::future<void> mTask;
+    std::atomic<bool> mCancelled;
+
+    Tile() : mX(0), mZ(0), mSlot(InvalidSlot), mState(State_Building)
+           , mTerrainId(~static_cast<size_t>(0)), mCancelled(false)
+    { }
+};
+
+
+WorldStreamer::WorldStreamer(Misc::ThreadPool &workers)
+  : mWorkers(workers), mActive(false), mOriginX(0), mOriginZ(0)
+  , mSlots(MaxSlots), mNextSlot(0), mBuilding(0), mBlocks(0)
+{
+    resetStats();
+}
+
+WorldStreamer::~WorldStreamer()
+{
+}
+
+
+void WorldStreamer::start(osg::Group *parent, int originx, int originz)
+{
+    stop();
+
+    mRoot = new osg::Group();
+    parent->addChild(mRoot);
+    mOriginX = originx;
+    mOriginZ = originz;
+    mActive = true;
+}
+
+void WorldStreamer::stop()
+{
+    if(!mActive)
+        return;
+
+    for(size_t i = 0;i < mSlots.size();++i)
+    {
+        if(mSlots[i])
+            unloadTile(i);
+    }
+    mTileSlots.clear();
+
+    // Anything read ahead for tiles that never got built.
+    VFS::Manager::get().cancelPrefetch();
+
+    while(mRoot->getNumParents() > 0)
+        mRoot->getParent(0)->removeChild(mRoot);
+    mRoot = nullptr;
+    mActive = false;
+}
+
+
+void WorldStreamer::getTile(const osg::Vec3f &pos, int &x, int &z) const
+{
+    // A block covers 0...4096 on X, and -4096...0 on Z from its position.
+    x = mOriginX + int(std::floor(pos.x() / 4096.0f));
+    z = mOriginZ + int(std::floor(pos.z() / 4096.0f)) + 1;
+}
+
+osg::Vec3f WorldStreamer::getTilePos(int x, int z) const
+{
+    return osg::Vec3f((x-mOriginX)*4096.0f, 0.0f, (z-mOriginZ)*4096.0f);
+}
+
+int WorldStreamer::getRing(const Tile &tile, int x, int z) const
+{
+    return std::max(std::abs(tile.mX - x), std::abs(tile.mZ - z));
+}
+
+
+size_t WorldStreamer::findFreeSlot() const
+{
+    // Hand out slots round-robin, so a new tile's IDs are usually the
+    // highest in the object systems and get appended.
+    for(size_t i = 0;i < mSlots.size();++i)
+    {
+        size_t slot = (mNextSlot+i) % mSlots.size();
+        if(!mSlots[slot]) return slot;
+    }
+    return InvalidSlot;
+}
+
+size_t WorldStreamer::findEvictable(int x, int z, int ring, bool blocksonly) const
+{
+    size_t found = InvalidSlot;
+    for(size_t i = 0;i < mSlots.size();++i)
+    {
+        const Tile *tile = mSlots[i].get();
+        if(!tile || (blocksonly && tile->mInfo.mBlockName.empty()))
+            continue;
+
+        int dist = getRing(*tile, x, z);
+        if(dist > ring)
+        {
+            ring = dist;
+            found = i;
+        }
+    }
+    return found;
+}
+
+
+void WorldStreamer::buildTile(Tile &tile)
+{
+    if(tile.mCancelled)
+        return;
+
+    size_t blockid = tile.mSlot << 24;
+    if(tile.mInfo.mBlockName.empty())
+    {
+        tile.mTerrainId = blockid | 0x00ffffff;
+        MBlockHeader::allocateTerrain(tile.mScene, tile.mTerrainId, tile.mInfo.mClimate,
+                                      gWildernessGround.data(), tile.mBasePos.x(), tile.mBasePos.z());
+        return;
+    }
+
+    std::unique_ptr<MBlockHeader> block(new MBlockHeader());
+    block->allocate(MBlockCache::get().get(tile.mInfo.mBlockName), tile.mScene, tile.mInfo.mClimate, blockid, tile.mBasePos.x(), tile.mBasePos.z());
+    tile.mBlock = std::move(block);
+}
+
+void WorldStreamer::requestTile(int x, int z, StreamTileInfo&& info, size_t slot)
+{
+    std::shared_ptr<Tile> tile(new Tile());
+    tile->mX = x;
+    tile->mZ = z;
+    tile->mSlot = slot;
+    tile->mInfo = std::move(info);
+    tile->mBasePos = getTilePos(x, z);
+
+    if(!tile->mInfo.mBlockName.empty())
+    {
+        ++mBlocks;
+        mPeakBlocks = std::max(mPeakBlocks, mBlocks);
+    }
+    ++mBuilding;
+
+    // The task keeps its own reference, so a cancelled tile can be dropped
+    // here while it finishes up.
+    tile->mTask = mWorkers.submit([tile]() { buildTile(*tile); });
+
+    mSlots[slot] = std::move(tile);
+    mTileSlots[getTileKey(x, z)] = slot;
+    mNextSlot = (slot+1) % mSlots.size();
+}
+
+void WorldStreamer::unloadTile(size_t slot)
+{
+    std::shared_ptr<Tile> tile = std::move(mSlots[slot]);
+    mTileSlots.erase(getTileKey(tile->mX, tile->mZ));
+    if(!tile->mInfo.mBlockName.empty())
+        --mBlocks;
+
+    if(tile->mState == Tile::State_Building)
+    {
+        // Nothing's been registered yet, so the build can just be dropped.
+        // It still counts against the builds until the worker is done with
+        // it, so dropped tiles can't pile up on the workers.
+        tile->mCancelled = true;
+        mDraining.push_back(std::move(tile));
+        return;
+    }
+
+    // Finish registering, so everything the tile has is removed below.
+    tile->mScene.commit();
+    if(tile->mState == Tile::State_Resident)
+    {
+        osg::Group *root = tile->mScene.getRoot();
+        mRoot->removeChild(root);
+        root->removeChildren(0, root->getNumChildren());
+    }
+
+    if(tile->mBlock)
+        tile->mBlock->deallocate();
+    if(tile->mTerrainId != ~static_cast<size_t>(0))
+    {
+        Renderer::get().remove(&tile->mTerrainId, 1);
+        Placeable::get().deallocate(&tile->mTerrainId, 1);
+    }
+    ++mTilesUnloaded;
+}
+
+
+void WorldStreamer::update(const osg::Vec3f &eye, const osg::Vec3f &forward)
+{
+    if(!mActive)
+        return;
+
+    auto start = Clock::now();
+    const int radius = *world_stream_radius;
+    int cx, cz;
+    getTile(eye, cx, cz);
+
+    // Drop tiles that are well out of range. The extra ring keeps tiles on
+    // the edge from being dropped and rebuilt as the camera moves back and
+    // forth.
+    for(size_t i = 0;i < mSlots.size();++i)
+    {
+        if(mSlots[i] && getRing(*mSlots[i], cx, cz) > radius+1)
+            unloadTile(i);
+    }
+    for(auto iter = mTileSlots.begin();iter != mTileSlots.end();)
+    {
+        size_t key = mTileSlots.getKey(iter);
+        int x = int(key%65536), z = int(key/65536);
+        if(*iter == InvalidSlot && std::max(std::abs(x-cx), std::abs(z-cz)) > radius+1)
+            iter = mTileSlots.erase(iter);
+        else
+            ++iter;
+    }
+
+    // Collect finished builds.
+    for(auto iter = mDraining.begin();iter != mDraining.end();)
+    {
+        if((*iter)->mTask.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            ++iter;
+        else
+        {
+            --mBuilding;
+            iter = mDraining.erase(iter);
+        }
+    }
+    std::vector<Tile*> committing;
+    for(size_t i = 0;i < mSlots.size();++i)
+    {
+        Tile *tile = mSlots[i].get();
+        if(!tile) continue;
+
+        if(tile->mState == Tile::State_Building)
+        {
+            if(tile->mTask.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                continue;
+            --mBuilding;
+            try {
+                tile->mTask.get();
+            }
+            catch(std::exception &e) {
+                Log::get().stream(Log::Level_Error)<< "Failed to stream "<<tile->mInfo.mBlockName<<": "<<e.what();
+                size_t key = getTileKey(tile->mX, tile->mZ);
+                if(!tile->mInfo.mBlockName.empty())
+                    --mBlocks;
+                mSlots[i] = nullptr;
+                mTileSlots[key] = InvalidSlot;
+                ++mFailures;
+                continue;
+            }
+            tile->mState = Tile::State_Committing;
+        }
+        if(tile->mState == Tile::State_Committing)
+            committing.push_back(tile);
+    }
+
+    // Register built tiles, nearest first, until the frame's budget is used
+    // up. At least one chunk is done each frame so loading always progresses.
+    std::sort(committing.begin(), committing.end(),
+        [this, cx, cz](const Tile *lhs, const Tile *rhs) -> bool
+        { return getRing(*lhs, cx, cz) < getRing(*rhs, cx, cz); }
+    );
+    const double budget = *world_stream_budget;
+    bool first = true;
+    for(Tile *tile : committing)
+    {
+        while(first || millisecondsSince(start) < budget)
+        {
+            first = false;
+            if(tile->mScene.commit(CommitChunk) == 0)
+                break;
+        }
+        if(tile->mScene.getPendingCount() > 0)
+            break;
+
+        // Only attach it once everything is placed.
+        mRoot->addChild(tile->mScene.getRoot());
+        tile->mState = Tile::State_Resident;
+        ++mTilesLoaded;
+    }
+
+    // Request missing tiles in range, ring by ring from the camera, and those
+    // in front of the camera first within a ring.
+    if(mBuilding < size_t(*world_stream_builds))
+    {
+        struct Candidate {
+            int mX, mZ;
+            int mRing;
+            float mFacing;
+
+            bool operator<(const Candidate &rhs) const
+            {
+                if(mRing != rhs.mRing)
+                    return mRing < rhs.mRing;
+                return mFacing > rhs.mFacing;
+            }
+        };
+
+        osg::Vec2f dir(forward.x(), forward.z());
+        dir.normalize();
+
+        std::vector<Candidate> candidates;
+        for(int z = cz-radius;z <= cz+radius;++z)
+        {
+            for(int x = cx-radius;x <= cx+radius;++x)
+            {
+                if(x < 0 || z < 0 || x >= 65536 || z >= 65536)
+                    continue;
+                if(mTileSlots.exists(getTileKey(x, z)))
+                    continue;
+
+                osg::Vec3f pos = getTilePos(x, z) + osg::Vec3f(2048.0f, 0.0f, -2048.0f);
+                osg::Vec2f todir(pos.x()-eye.x(), pos.z()-eye.z());
+                todir.normalize();
+
+                Candidate cand;
+                cand.mX = x;
+                cand.mZ = z;
+                cand.mRing = std::max(std::abs(x-cx), std::abs(z-cz));
+                cand.mFacing = todir * dir;
+                candidates.push_back(cand);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        // Once out of builds, the location blocks of the next few tiles are
+        // read ahead on the I/O threads, so they're in memory by the time
+        // those tiles get built.
+        std::vector<std::string> prefetch;
+        size_t lookahead = 0;
+        for(const Candidate &cand : candidates)
+        {
+            if(mBuilding >= size_t(*world_stream_builds))
+            {
+                if(lookahead++ >= size_t(*world_stream_builds))
+                    break;
+                StreamTileInfo info;
+                if(mResolve && mResolve(cand.mX, cand.mZ, info) && !info.mBlockName.empty())
+                    prefetch.push_back(std::move(info.mBlockName));
+                continue;
+            }
+
+            StreamTileInfo info;
+            if(!mResolve || !mResolve(cand.mX, cand.mZ, info))
+            {
+                mTileSlots[getTileKey(cand.mX, cand.mZ)] = InvalidSlot;
+                continue;
+            }
+
+            // Make room for a location block by dropping a further one, or
+            // leave it until something gets dropped.
+            if(!info.mBlockName.empty() && mBlocks >= size_t(*world_stream_maxblocks))
+            {
+                size_t slot = findEvictable(cx, cz, cand.mRing, true);
+                if(slot == InvalidSlot)
+                    continue;
+                unloadTile(slot);
+            }
+
+            size_t slot = findFreeSlot();
+            if(slot == InvalidSlot)
+            {
+                slot = findEvictable(cx, cz, cand.mRing, false);
+                if(slot == InvalidSlot)
+                    break;
+                unloadTile(slot);
+            }
+            requestTile(cand.mX, cand.mZ, std::move(info), slot);
+        }
+        if(!prefetch.empty())
+            MBlockCache::get().prefetch(prefetch);
+    }
+
+    mLastUpdateTime = millisecondsSince(start);
+    mMaxUpdateTime = std::max(mMaxUpdateTime, mLastUpdateTime);
+}
+
+
+MBlockHeader *WorldStreamer::getBlock(size_t slot) const
+{
+    if(slot >= mSlots.size() || !mSlots[slot] || mSlots[slot]->mState != Tile::State_Resident)
+        return nullptr;
+    return mSlots[slot]->mBlock.get();
+}
+
+
+WorldStreamer::Stats WorldStreamer::getStats() const
+{
+    Stats stats;
+    stats.mResident = 0;
+    stats.mBuilding = mBuilding;
+    stats.mBlocks = mBlocks;
+    stats.mPeakBlocks = mPeakBlocks;
+    stats.mTilesLoaded = mTilesLoaded;
+    stats.mTilesUnloaded = mTilesUnloaded;
+    stats.mFailures = mFailures;
+    stats.mMemoryUsage = sizeof(*this) + mTileSlots.size()*sizeof(size_t)*2;
+    stats.mLastUpdateTime = mLastUpdateTime;
+    stats.mMaxUpdateTime = mMaxUpdateTime;
+    for(const std::shared_ptr<Tile> &tile : mSlots)
+    {
+        if(!tile) continue;
+        if(tile->mState == Tile::State_Resident)
+            ++stats.mResident;
+        stats.mMemoryUsage += sizeof(Tile);
+        if(tile->mState != Tile::State_Building && tile->mBlock)
+            stats.mMemoryUsage += tile->mBlock->getMemoryUsage();
+    }
+    stats.mMemoryUsage += mDraining.size() * sizeof(Tile);
+    return stats;
+}
+
+void WorldStreamer::resetStats()
+{
+    mPeakBlocks = mBlocks;
+    mTilesLoaded = 0;
+    mTilesUnloaded = 0;
+    mFailures = 0;
+    mLastUpdateTime = 0.0;
+    mMaxUpdateTime = 0.0;
+}
+
+} // namespace DF
@@ -0,0 +1,142 @@
+#ifndef WORLD_STREAMER_HPP
+#define WORLD_STREAMER_HPP
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+
+#include <osg/ref_ptr>
+#include <osg/Group>
+#include <osg/Vec3f>
+
+#include "misc/sparsearray.hpp"
+#include "misc/threadpool.hpp"
+
+
+namespace DF
+{
+
+struct MBlockHeader;
+
+/* What's at a world tile: the climate, and the location block covering it,
+ * if any. */
+struct StreamTileInfo {
+    uint8_t mClimate;
+    // Empty for the wilderness between locations.
+    std::string mBlockName;
+
+    StreamTileInfo() : mClimate(0) { }
+};
+
+/* Streams the exterior world around the camera. The world is split into
+ * tiles the size of an exterior block (4096 units), eight to a side for each
+ * world map cell, which are built on the worker threads in rings around the
+ * camera (nearest first, then the ones it's facing), and dropped again once
+ * far enough away.
+ *
+ * A tile's objects use the exterior block ID scheme, with a slot number in
+ * the upper 8 bits, so there are at most 255 tiles resident. Each frame only
+ * gets a time budget for registering built tiles with the object systems,
+ * and the number of location blocks resident is capped, to keep hitches and
+ * memory use bounded.
+ */
+class WorldStreamer {
+public:
+    /* Fills in what's at the given tile, returning false if it's outside the
+     * world. Called on the main thread. */
+    typedef std::function<bool(int x, int z, StreamTileInfo &info)> ResolveFunc;
+
+    struct Stats {
+        size_t mResident;
+        size_t mBuilding;
+        size_t mBlocks;
+        size_t mPeakBlocks;
+        size_t mTilesLoaded;
+        size_t mTilesUnloaded;
+        size_t mFailures;
+        size_t mMemoryUsage;
+        double mLastUpdateTime;
+        double mMaxUpdateTime;
+    };
+
+private:
+    struct Tile;
+
+    Misc::ThreadPool &mWorkers;
+    ResolveFunc mResolve;
+
+    osg::ref_ptr<osg::Group> mRoot;
+    bool mActive;
+    // The tile at the object space origin.
+    int mOriginX, mOriginZ;
+
+    // Tiles by slot, and slots by tile key. Tiles that failed to build stay
+    // in the key map with an invalid slot, so they aren't retried.
+    std::vector<std::shared_ptr<Tile>> mSlots;
+    Misc::SparseArray<size_t> mTileSlots;
+    size_t mNextSlot;
+    // Tiles dropped while building, until their tasks finish.
+    std::vector<std::shared_ptr<Tile>> mDraining;
+
+    // Tiles being built, including dropped ones still on a worker.
+    size_t mBuilding;
+    size_t mBlocks;
+    size_t mPeakBlocks;
+    size_t mTilesLoaded;
+    size_t mTilesUnloaded;
+    size_t mFailures;
+    double mLastUpdateTime;
+    double mMaxUpdateTime;
+
+    WorldStreamer(const WorldStreamer&) = delete;
+    WorldStreamer& operator=(const WorldStreamer&) = delete;
+
+    static size_t getTileKey(int x, int z) { return size_t(z)*65536 + size_t(x); }
+
+    int getRing(const Tile &tile, int x, int z) const;
+    size_t findFreeSlot() const;
+    /* Finds the resident or building tile furthest from x,z, and further than
+     * the given ring, optionally only those with a location block. */
+    size_t findEvictable(int x, int z, int ring, bool blocksonly) const;
+
+    void requestTile(int x, int z, StreamTileInfo&& info, size_t slot);
+    void unloadTile(size_t slot);
+    /* Reads and builds a tile's scene. Safe to run on a worker thread. */
+    static void buildTile(Tile &tile);
+
+public:
+    WorldStreamer(Misc::ThreadPool &workers);
+    ~WorldStreamer();
+
+    void setResolver(ResolveFunc&& func) { mResolve = std::move(func); }
+
+    /* Starts streaming with the given tile at the origin, under the given
+     * scene node. Anything already streamed in is dropped. */
+    void start(osg::Group *parent, int originx, int originz);
+    /* Drops all tiles, and stops streaming. */
+    void stop();
+    bool isActive() const { return mActive; }
+
+    /* Gets the tile the given object space position is over. */
+    void getTile(const osg::Vec3f &pos, int &x, int &z) const;
+    /* Gets the object space position of a tile's corner, as the position of
+     * an exterior block placed there. */
+    osg::Vec3f getTilePos(int x, int z) const;
+
+    /* Drops far tiles, registers built ones, and requests new ones around
+     * the given eye position and view direction (in object space). */
+    void update(const osg::Vec3f &eye, const osg::Vec3f &forward);
+
+    /* Gets the location block in the given slot, or null if it isn't
+     * resident or is wilderness. */
+    MBlockHeader *getBlock(size_t slot) const;
+
+    Stats getStats() const;
+    void resetStats();
+};
+
+} // namespace DF
+
+#endif /* WORLD_STREAMER_HPP */
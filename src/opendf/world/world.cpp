@@ -2,13 +2,26 @@
 #include "world.hpp"
 
 #include <sstream>
+#include <algorithm>
 #include <iomanip>
 #include <array>
+#include <future>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <fstream>
+#include <atomic>
+#include <cstring>
+#include <cstdio>
 
 #include <osgViewer/Viewer>
 #include <osg/Light>
 #include <osg/Quat>
 
+#include "misc/recordlayout.hpp"
+#include "misc/binarywriter.hpp"
+
+#include "components/archives/mappedfile.hpp"
 #include "components/vfs/manager.hpp"
 
 #include "render/renderer.hpp"
@@ -23,7 +36,9 @@
 #include "actions/unknown.hpp"
 #include "gui/iface.hpp"
 #include "mblocks.hpp"
+#include "mblockcache.hpp"
 #include "dblocks.hpp"
+#include "scenestaging.hpp"
 #include "cvars.hpp"
 #include "log.hpp"
 
@@ -33,8 +48,24 @@ namespace
 
 static const size_t InvalidHandle = ~static_cast<size_t>(0);
 
+typedef std::chrono::steady_clock Clock;
+
+double millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double,std::milli>(Clock::now() - start).count();
+}
+
 static const std::array<char,6> gBlockIndexLabel{{ 'N', 'W', 'L', 'S', 'B', 'M' }};
 
+std::string getDungeonBlockName(const DF::DungeonBlock &block)
+{
+    std::stringstream sstr;
+    sstr<< std::setfill('0')<<std::setw(8)<< block.mBlockIdx<<".RDB";
+    std::string name = sstr.str();
+    name.front() = gBlockIndexLabel.at(block.mBlockPreIndex);
+    return name;
+}
+
 /* This is only stored temporarily */
 struct DungeonHeader {
     struct Offset {
@@ -46,99 +77,222 @@ struct DungeonHeader {
     uint32_t mDungeonCount;
     std::vector<Offset> mOffsets;
 
-    void load(std::istream &stream)
+    void load(Misc::BinaryReader &reader)
     {
-        mDungeonCount = VFS::read_le32(stream);
+        mDungeonCount = reader.read32();
 
         mOffsets.resize(mDungeonCount);
         for(Offset &offset : mOffsets)
         {
-            offset.mOffset = VFS::read_le32(stream);
-            offset.mIsDungeon = VFS::read_le16(stream);
-            offset.mExteriorLocationId = VFS::read_le16(stream);
+            offset.mOffset = reader.read32();
+            offset.mIsDungeon = reader.read16();
+            offset.mExteriorLocationId = reader.read16();
         }
     }
 };
 
+constexpr auto gLocationDoorLayout = Misc::layout(
+    Misc::field(&DF::LocationDoor::mBuildingDataIndex, "BuildingDataIndex"),
+    Misc::field(&DF::LocationDoor::mNullValue, "Null"),
+    Misc::field(&DF::LocationDoor::mUnknownMask, "UnknownMask", Misc::Field_Hex),
+    Misc::field(&DF::LocationDoor::mUnknown1, "Unknown", Misc::Field_Hex),
+    Misc::field(&DF::LocationDoor::mUnknown2, "Unknown", Misc::Field_Hex)
+);
+static_assert(gLocationDoorLayout.size() == 6, "LocationDoor must be 6 bytes");
+
+/* Follows the door list */
+constexpr auto gLocationHeaderLayout = Misc::layout(
+    Misc::field(&DF::LocationHeader::mAlwaysOne1, "Always one"),
+    Misc::field(&DF::LocationHeader::mNullValue1, "Null"),
+    Misc::field(&DF::LocationHeader::mNullValue2, "Null"),
+    Misc::field(&DF::LocationHeader::mX, "X"),
+    Misc::field(&DF::LocationHeader::mNullValue3, "Null"),
+    Misc::field(&DF::LocationHeader::mY, "Y"),
+    Misc::field(&DF::LocationHeader::mIsExterior, "IsExterior"),
+    Misc::field(&DF::LocationHeader::mNullValue4, "Null"),
+    Misc::field(&DF::LocationHeader::mUnknown1, "Unknown", Misc::Field_Hex),
+    Misc::field(&DF::LocationHeader::mUnknown2, "Unknown", Misc::Field_Hex),
+    Misc::field(&DF::LocationHeader::mAlwaysOne2, "Always one"),
+    Misc::field(&DF::LocationHeader::mLocationId, "LocationID"),
+    Misc::field(&DF::LocationHeader::mNullValue5, "Null"),
+    Misc::field(&DF::LocationHeader::mIsInterior, "IsInterior"),
+    Misc::field(&DF::LocationHeader::mExteriorLocationId, "ExteriorLocationID"),
+    Misc::field(&DF::LocationHeader::mNullValue6, "Null", Misc::Field_Hidden),
+    Misc::field(&DF::LocationHeader::mLocationName, "LocationName", Misc::Field_String),
+    Misc::field(&DF::LocationHeader::mUnknown3, "Unknown", Misc::Field_Hex)
+);
+static_assert(gLocationHeaderLayout.size() == 112, "LocationHeader must be 112 bytes after the doors");
+
+constexpr auto gMapTableLayout = Misc::layout(
+    Misc::field(&DF::MapTable::mMapId, "MapID"),
+    Misc::field(&DF::MapTable::mUnknown1, "Unknown", Misc::Field_Hex),
+    Misc::field(&DF::MapTable::mLongitudeType, "LongitudeType", Misc::Field_Hex),
+    Misc::field(&DF::MapTable::mLatitude, "Latitude"),
+    Misc::field(&DF::MapTable::mUnknown2, "Unknown", Misc::Field_Hex),
+    Misc::field(&DF::MapTable::mUnknown3, "Unknown", Misc::Field_Hex)
+);
+static_assert(gMapTableLayout.size() == 17, "MapTable must be 17 bytes");
+
+
+/* The world cache holds the parsed map data, so it doesn't need to be found
+ * and parsed from the MAP* files every run. All values are little-endian:
+ *
+ * char[8] magic, uint32 version
+ * uint32 source count, then for each: string name, string path, uint64 size,
+ *   int64 modification time
+ * Climate and politic maps: uint32 width, uint32 height, then the cells
+ * uint32 region count, then for each: string file suffix, uint32 name count,
+ *   the names, the map table records, uint32 item size, then the items
+ *   (uint32 exterior count and exteriors, uint32 dungeon count and dungeons)
+ *
+ * Strings are a uint16 length followed by the characters. Records are stored
+ * in the same format as the game data, so they're read with the same code.
+ * The items are only read when their region is first used.
+ */
+const std::array<char,8> gCacheMagic{{ 'D', 'F', 'W', 'O', 'R', 'L', 'D', '\x1a' }};
+// Increase when the format, or how any stored record is read, changes.
+const uint32_t gCacheVersion = 2;
+
+typedef std::vector<std::pair<std::string,VFS::SourceInfo>> SourceList;
+
+/* Gets where all the files making up the map data are stored. Returns false
+ * if any are missing. */
+bool getMapSources(SourceList &sources)
+{
+    std::vector<std::string> names{ "CLIMATE.PAK", "POLITIC.PAK" };
+    for(const std::string &name : VFS::Manager::get().list("MAPNAMES.[0-9]*"))
+    {
+        std::string regstr = name.substr(name.rfind('.')+1);
+        names.push_back(name);
+        names.push_back("MAPTABLE."+regstr);
+        names.push_back("MAPPITEM."+regstr);
+        names.push_back("MAPDITEM."+regstr);
+    }
+
+    sources.clear();
+    for(const std::string &name : names)
+    {
+        VFS::SourceInfo info;
+        if(!VFS::Manager::get().getSource(name.c_str(), info))
+            return false;
+        sources.push_back(std::make_pair(name, info));
+    }
+    return true;
+}
+
+void writeString(Misc::BinaryWriter &writer, const std::string &str)
+{
+    writer.write16(str.size());
+    writer.write(str.data(), str.size());
+}
+
+std::string readString(Misc::BinaryReader &reader)
+{
+    size_t len = reader.read16();
+    const unsigned char *str = reader.take(len);
+    return std::string(reinterpret_cast<const char*>(str), len);
+}
+
+/* Reads an element count, failing early if it can't possibly fit. */
+uint32_t readCount(Misc::BinaryReader &reader)
+{
+    uint32_t count = reader.read32();
+    if(count > reader.remaining())
+        throw std::runtime_error("Invalid count "+std::to_string(count)+" at offset "+
+                                 std::to_string(reader.tell()-4));
+    return count;
+}
+
+void writeWorldMap(Misc::BinaryWriter &writer, const DF::WorldMap &map)
+{
+    writer.write32(map.getWidth());
+    writer.write32(map.getHeight());
+    for(size_t row = 0;row < map.getHeight();++row)
+        writer.write(map.getRow(row), map.getWidth());
+}
+
+void readWorldMap(Misc::BinaryReader &reader, DF::WorldMap &map)
+{
+    uint32_t width = reader.read32();
+    uint32_t height = reader.read32();
+    if(height > 0 && width > reader.remaining()/height)
+        throw std::runtime_error("Invalid map size "+std::to_string(width)+"x"+std::to_string(height));
+
+    std::vector<uint8_t> cells(size_t(width)*height);
+    reader.read(cells.data(), cells.size());
+    map.assign(width, height, cells);
+}
+
+
+void printMatches(const std::string &text, size_t count, const std::vector<DF::LocationMatch> &matches)
+{
+    DF::LogStream stream(DF::Log::get().stream());
+    stream<< count<<" exteriors match \""<<text<<"\":";
+    for(const DF::LocationMatch &match : matches)
+        stream<< "\n  "<<match.mName<<" (region "<<match.mRegion<<", location "<<match.mIndex<<")";
+    if(count > matches.size())
+        stream<< "\n  ...and "<<(count-matches.size())<<" more";
+}
+
 }
 
 namespace DF
 {
 
-void LocationHeader::load(std::istream &stream)
+void LocationHeader::load(Misc::BinaryReader &reader)
 {
-    mDoorCount = VFS::read_le32(stream);
+    mDoorCount = reader.read32();
 
     mDoors.resize(mDoorCount);
-    for(auto &door : mDoors)
-    {
-        door.mBuildingDataIndex = VFS::read_le16(stream);
-        door.mNullValue = stream.get();
-        door.mUnknownMask = stream.get();
-        door.mUnknown1 = stream.get();
-        door.mUnknown2 = stream.get();
-    }
-
-    mAlwaysOne1 = VFS::read_le32(stream);
-    mNullValue1 = VFS::read_le16(stream);
-    mNullValue2 = stream.get();
-    mX = VFS::read_le32(stream);
-    mNullValue3 = VFS::read_le32(stream);
-    mY = VFS::read_le32(stream);
-    mIsExterior = VFS::read_le16(stream);
-    mNullValue4 = VFS::read_le16(stream);
-    mUnknown1 = VFS::read_le32(stream);
-    mUnknown2 = VFS::read_le32(stream);
-    mAlwaysOne2 = VFS::read_le16(stream);
-    mLocationId = VFS::read_le16(stream);
-    mNullValue5 = VFS::read_le32(stream);
-    mIsInterior = VFS::read_le16(stream);
-    mExteriorLocationId = VFS::read_le32(stream);
-    stream.read(reinterpret_cast<char*>(mNullValue6), sizeof(mNullValue6));
-    stream.read(mLocationName, sizeof(mLocationName));
-    stream.read(reinterpret_cast<char*>(mUnknown3), sizeof(mUnknown3));
+    for(LocationDoor &door : mDoors)
+        gLocationDoorLayout.read(reader, door);
+
+    gLocationHeaderLayout.read(reader, *this);
+}
+
+void LocationHeader::save(Misc::BinaryWriter &writer) const
+{
+    writer.write32(mDoors.size());
+
+    for(const LocationDoor &door : mDoors)
+        gLocationDoorLayout.write(writer, door);
+
+    gLocationHeaderLayout.write(writer, *this);
 }
 
 LogStream& operator<<(LogStream &stream, const LocationHeader &loc)
 {
-    stream<<std::setfill('0');
     stream<< "  Door count: "<<loc.mDoorCount<<"\n";
     for(const LocationDoor &door : loc.mDoors)
     {
         stream<< "  Door "<<std::distance(loc.mDoors.data(), &door)<<":\n";
-        stream<< "    BuildingDataIndex: "<<door.mBuildingDataIndex<<"\n";
-        stream<< "    Null: "<<(int)door.mNullValue<<"\n";
-        stream<< "    UnknownMask: 0x"<<std::hex<<std::setw(2)<<(int)door.mUnknownMask<<std::setw(0)<<std::dec<<"\n";
-        stream<< "    Unknown: 0x"<<std::hex<<std::setw(2)<<(int)door.mUnknown1<<std::setw(0)<<std::dec<<"\n";
-        stream<< "    Unknown: 0x"<<std::hex<<std::setw(2)<<(int)door.mUnknown2<<std::setw(0)<<std::dec<<"\n";
-    }
-
-    stream<< "  Always one: "<<loc.mAlwaysOne1<<"\n";
-    stream<< "  Null: "<<loc.mNullValue1<<"\n";
-    stream<< "  Null: "<<(int)loc.mNullValue2<<"\n";
-    stream<< "  X: "<<loc.mX<<"\n";
-    stream<< "  Null: "<<loc.mNullValue3<<"\n";
-    stream<< "  Y: "<<loc.mY<<"\n";
-    stream<< "  IsExterior: "<<loc.mIsExterior<<"\n";
-    stream<< "  Null: "<<loc.mNullValue4<<"\n";
-    stream<< "  Unknown: 0x"<<std::hex<<std::setw(8)<<loc.mUnknown1<<std::setw(0)<<std::dec<<"\n";
-    stream<< "  Unknown: 0x"<<std::hex<<std::setw(8)<<loc.mUnknown2<<std::setw(0)<<std::dec<<"\n";
-    stream<< "  Always one: "<<loc.mAlwaysOne2<<"\n";
-    stream<< "  LocationID: "<<loc.mLocationId<<"\n";
-    stream<< "  Null: "<<loc.mNullValue5<<"\n";
-    stream<< "  IsInterior: "<<loc.mIsInterior<<"\n";
-    stream<< "  ExteriorLocationID: "<<loc.mExteriorLocationId<<"\n";
-    //uint8_t mNullValue6[26];
-    stream<< "  LocationName: \""<<loc.mLocationName<<"\"\n";
-    stream<< "  Unknown:";//<<std::hex<<std::setw(2);
-    for(uint32_t unk : loc.mUnknown3)
-        stream<< " 0x"<<std::hex<<std::setw(2)<<unk;
-    stream<<std::setw(0)<<std::dec<<std::setfill(' ');
+        gLocationDoorLayout.print(stream, door, "    ");
+    }
+    gLocationHeaderLayout.print(stream, loc, "  ");
 
     return stream;
 }
 
 
+size_t MapRegion::getMemoryUsage() const
+{
+    size_t total = sizeof(*this);
+    total += mNames.capacity() * sizeof(std::string);
+    for(const std::string &name : mNames)
+        total += name.capacity();
+    total += mTable.capacity() * sizeof(MapTable);
+    total += mExteriors.capacity() * sizeof(ExteriorLocation);
+    for(const ExteriorLocation &ext : mExteriors)
+        total += ext.mDoors.capacity()*sizeof(LocationDoor) +
+                 ext.mBuildings.capacity()*sizeof(ExteriorBuilding);
+    total += mDungeons.capacity() * sizeof(DungeonInterior);
+    for(const DungeonInterior &dgn : mDungeons)
+        total += dgn.mDoors.capacity()*sizeof(LocationDoor) +
+                 dgn.mBlocks.capacity()*sizeof(DungeonBlock);
+    return total;
+}
+
+
 CCMD(dumparea)
 {
     WorldIface::get().dumpArea();
@@ -149,12 +303,46 @@ CCMD(dumpblocks)
     WorldIface::get().dumpBlocks();
 }
 
+CCMD(worldstats)
+{
+    WorldIface::get().dumpStats();
+}
+
+CCMD(rebuildworldcache)
+{
+    try {
+        WorldIface::get().rebuildCache();
+    }
+    catch(std::exception &e) {
+        Log::get().stream(Log::Level_Error)<< "Exception: "<<e.what();
+    }
+}
+
+
+CCMD(findloc)
+{
+    if(params.empty())
+    {
+        Log::get().stream(Log::Level_Error)<< "Usage: findloc <name>";
+        return;
+    }
+
+    // Prefer names starting with the text, then any containing it.
+    std::vector<LocationMatch> matches;
+    size_t count = WorldIface::get().findExteriors(params, false, matches, 50);
+    if(count == 0)
+        count = WorldIface::get().findExteriors(params, true, matches, 50);
+    if(count == 0)
+        Log::get().stream()<< "No exteriors match \""<<params<<"\"";
+    else
+        printMatches(params, count, matches);
+}
 
 CCMD(warp)
 {
     if(params.empty())
     {
-        Log::get().stream(Log::Level_Error)<< "Usage: warp <region index> <location index>";
+        Log::get().stream(Log::Level_Error)<< "Usage: warp <region index> <location index> | warp <name>";
         return;
     }
 
@@ -177,13 +365,24 @@ CCMD(warp)
             return;
         }
     }
-    else
+    else if(!WorldIface::get().getExteriorByName(params, regnum, mapnum))
     {
-        if(!WorldIface::get().getExteriorByName(params, regnum, mapnum))
+        // Not a full name, so go to the only exterior starting with it.
+        std::vector<LocationMatch> matches;
+        size_t count = WorldIface::get().findExteriors(params, false, matches, 20);
+        if(count == 0)
         {
             Log::get().stream(Log::Level_Error)<< "Failed to find exterior \""<<params<<"\"";
             return;
         }
+        if(count > 1)
+        {
+            printMatches(params, count, matches);
+            return;
+        }
+        Log::get().stream()<< "Warping to "<<matches[0].mName;
+        regnum = matches[0].mRegion;
+        mapnum = matches[0].mIndex;
     }
 
     try {
@@ -226,8 +425,199 @@ CCMD(dwarp)
     }
 }
 
+CCMD(stream)
+{
+    WorldIface::get().setStreaming(!WorldIface::get().isStreaming());
+}
+
+CCMD(streambench)
+{
+    float seconds = 30.0f;
+    if(!params.empty())
+    {
+        char *next = nullptr;
+        seconds = strtof(params.c_str(), &next);
+        if((next && *next != '\0') || !(seconds > 0.0f))
+        {
+            Log::get().stream(Log::Level_Error)<< "Usage: streambench [seconds]";
+            return;
+        }
+    }
+
+    try {
+        WorldIface::get().startStreamBenchmark(seconds);
+    }
+    catch(std::exception &e) {
+        Log::get().stream(Log::Level_Error)<< "Exception: "<<e.what();
+    }
+}
+
 
 CVAR(CVarBool, g_introspect, false);
+// Worker threads for world loading, or 0 for one per hardware thread.
+CVAR(CVarInt, world_threads, 0, 0, 64);
+// Parse a region's locations when first used, rather than all at startup.
+CVAR(CVarBool, world_lazyregions, true);
+// Keep the parsed map data in a cache file between runs.
+CVAR(CVarBool, world_cache, true);
+// Build locations on a worker thread, keeping the current one until done.
+CVAR(CVarBool, world_asyncload, true);
+// Decode the current exterior's dungeon in the background, ready for going in.
+CVAR(CVarBool, world_prefetch, true);
+// Locations kept loaded after leaving them, for going straight back.
+CVAR(CVarInt, world_loccache, 4, 0, 32);
+// Memory for the kept locations, in KiB. Once it's over, the ones left
+// longest ago are dropped.
+CVAR(CVarInt, world_loccache_mem, 65536, 0, 1048576);
+
+
+/* The current exterior's dungeon, read and decoded ahead of time at low
+ * priority, with the meshes and flats it uses loaded. The blocks may only be
+ * taken once it's ready.
+ */
+struct DungeonPrefetch {
+    enum State {
+        State_Loading,
+        State_Ready,
+        State_Failed
+    };
+
+    const DungeonInterior *mDungeon;
+    std::string mName;
+    std::vector<std::string> mBlockNames;
+
+    std::vector<std::unique_ptr<DBlockHeader>> mBlocks;
+    // Keeps the dungeon's meshes and flats in the mesh manager's cache.
+    std::vector<osg::ref_ptr<osg::Node>> mResources;
+
+    std::atomic<int> mState;
+    std::atomic<bool> mCancelled;
+    // Set before the state changes from loading.
+    std::string mError;
+    double mTime;
+    Clock::time_point mStartTime;
+
+    DungeonPrefetch()
+      : mDungeon(nullptr), mState(State_Loading), mCancelled(false), mTime(0.0)
+    { }
+};
+
+
+/* A location being loaded. What to read is worked out on the main thread,
+ * then the blocks are read and their scene built on a worker.
+ */
+struct PendingLocation {
+    const MapRegion *mRegion;
+    const ExteriorLocation *mExterior;
+    const DungeonInterior *mDungeon;
+    size_t mRegionNum;
+    size_t mLocationNum;
+    uint8_t mClimate;
+    std::string mName;
+
+    std::vector<std::string> mBlockNames;
+    std::vector<osg::Vec3f> mBlockOffsets;
+
+    std::vector<std::unique_ptr<MBlockHeader>> mExteriorBlocks;
+    std::vector<std::unique_ptr<DBlockHeader>> mDungeonBlocks;
+    // The dungeon decoded ahead of time, if it was.
+    std::shared_ptr<DungeonPrefetch> mPrefetch;
+    SceneStaging mScene;
+
+    std::atomic<size_t> mBlocksDone;
+    std::atomic<bool> mCancelled;
+    Clock::time_point mStartTime;
+
+    PendingLocation()
+      : mRegion(nullptr), mExterior(nullptr), mDungeon(nullptr)
+      , mRegionNum(0), mLocationNum(0), mClimate(0)
+      , mBlocksDone(0), mCancelled(false)
+    { }
+};
+
+/* The object system state of a location that's been left, taken out of the
+ * systems so the next location can use them.
+ */
+struct SuspendedObjects {
+    Renderer mRenderer;
+    Placeable mPlaceable;
+    Activator mActivator;
+    Animated mAnimated;
+    Linker mLinker;
+    Mover mMover;
+    Door mDoor;
+    ExitDoor mExitDoor;
+    UnknownAction mUnknown;
+
+    /* Exchanges the state held here with what's in the systems. */
+    void swap()
+    {
+        Renderer::get().swapObjects(mRenderer);
+        Placeable::get().swapObjects(mPlaceable);
+        Activator::get().swapObjects(mActivator);
+        Animated::get().swapObjects(mAnimated);
+        Linker::get().swapObjects(mLinker);
+        Mover::get().swapObjects(mMover);
+        Door::get().swapObjects(mDoor);
+        ExitDoor::get().swapObjects(mExitDoor);
+        UnknownAction::get().swapObjects(mUnknown);
+    }
+};
+
+/* A location that's been left but is still loaded, with its scene detached
+ * and its objects suspended, so going back only needs them put back.
+ */
+struct CachedLocation {
+    const MapRegion *mRegion;
+    const ExteriorLocation *mExterior;
+    const DungeonInterior *mDungeon;
+    std::string mName;
+
+    std::vector<std::unique_ptr<MBlockHeader>> mExteriorBlocks;
+    std::vector<std::unique_ptr<DBlockHeader>> mDungeonBlocks;
+    osg::ref_ptr<osg::Group> mRoot;
+    SuspendedObjects mObjects;
+
+    CachedLocation() : mRegion(nullptr), mExterior(nullptr), mDungeon(nullptr) { }
+
+    // Approximate size in bytes, not counting the meshes, textures and RMB
+    // data it shares with other locations.
+    size_t getMemoryUsage() const
+    {
+        // An object's base node, user data and object system entries, on
+        // top of what's in its block.
+        static const size_t ObjectOverhead = sizeof(osg::MatrixTransform) + sizeof(ObjectRef) +
+                                             sizeof(Position) + 4*sizeof(size_t);
+        size_t total = sizeof(*this);
+        size_t objects = 0;
+        for(const std::unique_ptr<MBlockHeader> &block : mExteriorBlocks)
+        {
+            total += block->getMemoryUsage();
+            objects += block->mObjectIds.size() + 1;
+        }
+        for(const std::unique_ptr<DBlockHeader> &block : mDungeonBlocks)
+        {
+            total += block->getMemoryUsage();
+            objects += block->mModels.size() + block->mFlats.size();
+        }
+        return total + objects*ObjectOverhead;
+    }
+};
+
+/* A fly-through of the streamed world, moving a fixed distance each frame so
+ * every run covers the same ground regardless of frame rate.
+ */
+struct StreamBenchmark {
+    size_t mFramesLeft;
+    float mStep;
+
+    std::vector<double> mFrameTimes;
+    std::vector<double> mStreamTimes;
+    Clock::time_point mLastFrame;
+    bool mStarted;
+
+    StreamBenchmark() : mFramesLeft(0), mStep(0.0f), mStarted(false) { }
+};
 
 
 World World::sWorld;
@@ -239,6 +629,11 @@ World::World()
   , mCurrentDungeon(nullptr)
   , mCurrentSelection(InvalidHandle)
   , mFirstStart(true)
+  , mStreamer(mWorkers)
+  , mInitTime(0.0)
+  , mLazyLoadTime(0.0)
+  , mLastLoadTime(0.0)
+  , mCacheCancel(false)
 {
 }
 
@@ -247,341 +642,1120 @@ World::~World()
 }
 
 
-void World::initialize(osgViewer::Viewer *viewer, osg::Group *sceneroot)
+MapRegion World::loadRegion(const std::string &name, const std::string &regstr, bool loaditems)
 {
-    std::set<std::string> names = VFS::Manager::get().list("MAPNAMES.[0-9]*");
-    if(names.empty()) throw std::runtime_error("Failed to find any regions");
+    MapRegion region;
+    region.mFileSuffix = regstr;
 
-    VFS::IStreamPtr stream;
-    for(const std::string &name : names)
+    /* Get names */
+    VFS::DataPtr data = VFS::Manager::get().read(name);
+    if(!data) throw std::runtime_error("Failed to open "+name);
+    Misc::BinaryReader reader(*data);
+
+    uint32_t mapcount = reader.read32();
+    if(mapcount == 0) return region;
+
+    region.mNames.resize(mapcount);
+    for(std::string &mapname : region.mNames)
     {
-        size_t pos = name.rfind('.');
-        if(pos == std::string::npos)
-            continue;
-        std::string regstr = name.substr(pos+1);
-        unsigned long regnum = std::stoul(regstr, nullptr, 10);
+        char mname[32];
+        reader.read(mname, sizeof(mname));
+        mapname.assign(mname, sizeof(mname));
+        size_t end = mapname.find('\0');
+        if(end != std::string::npos)
+            mapname.resize(end);
+    }
 
-        /* Get names */
-        stream = VFS::Manager::get().open(name.c_str());
-        if(!stream) throw std::runtime_error("Failed to open "+name);
+    /* Get table data */
+    std::string fname = "MAPTABLE."+regstr;
+    data = VFS::Manager::get().read(fname);
+    if(!data) throw std::runtime_error("Failed to open "+fname);
+    reader = Misc::BinaryReader(*data);
 
-        uint32_t mapcount = VFS::read_le32(*stream);
-        if(mapcount == 0) continue;
+    region.mTable.resize(region.mNames.size());
+    for(MapTable &maptable : region.mTable)
+        gMapTableLayout.read(reader, maptable);
 
-        MapRegion region;
-        region.mNames.resize(mapcount);
-        for(std::string &mapname : region.mNames)
-        {
-            char mname[32];
-            if(!stream->read(mname, sizeof(mname)) || stream->gcount() != sizeof(mname))
-                throw std::runtime_error("Failed to read map names from "+name);
-            mapname.assign(mname, sizeof(mname));
-            size_t end = mapname.find('\0');
-            if(end != std::string::npos)
-                mapname.resize(end);
-        }
-        stream = nullptr;
-
-        /* Get table data */
-        std::string fname = "MAPTABLE."+regstr;
-        stream = VFS::Manager::get().open(fname.c_str());
-        if(!stream) throw std::runtime_error("Failed to open "+fname);
-
-        region.mTable.resize(region.mNames.size());
-        for(MapTable &maptable : region.mTable)
-        {
-            maptable.mMapId = VFS::read_le32(*stream);
-            maptable.mUnknown1 = stream->get();
-            maptable.mLongitudeType = VFS::read_le32(*stream);
-            maptable.mLatitude = VFS::read_le16(*stream);
-            maptable.mUnknown2 = VFS::read_le16(*stream);
-            maptable.mUnknown3 = VFS::read_le32(*stream);
-        }
-        stream = nullptr;
-
-        /* Get exterior data */
-        fname = "MAPPITEM."+regstr;
-        stream = VFS::Manager::get().open(fname.c_str());
-        if(!stream) throw std::runtime_error("Failed to open "+fname);
-
-        std::vector<uint32_t> extoffsets(region.mNames.size());
-        for(uint32_t &offset : extoffsets)
-            offset = VFS::read_le32(*stream);
-        std::streamoff extbase_offset = stream->tellg();
-
-        uint32_t *extoffset = extoffsets.data();
-        region.mExteriors.resize(extoffsets.size());
-        for(ExteriorLocation &extinfo : region.mExteriors)
-        {
-            stream->seekg(extbase_offset + *extoffset);
-            extinfo.load(*stream);
-            ++extoffset;
-        }
-        stream = nullptr;
+    if(loaditems)
+        loadRegionItems(region);
+    return region;
+}
 
-        /* Get dungeon data */
-        fname = "MAPDITEM."+regstr;
-        stream = VFS::Manager::get().open(fname.c_str());
-        if(!stream) throw std::runtime_error("Failed to open "+fname);
+void World::loadRegionItems(MapRegion &region)
+{
+    // An empty or missing region has nothing more to load.
+    if(region.mNames.empty())
+    {
+        region.mItemsLoaded = true;
+        return;
+    }
 
-        DungeonHeader dheader;
-        dheader.load(*stream);
-        std::streamoff dbase_offset = stream->tellg();
+    /* Get exterior data */
+    std::string fname = "MAPPITEM."+region.mFileSuffix;
+    VFS::DataPtr data = VFS::Manager::get().read(fname);
+    if(!data) throw std::runtime_error("Failed to open "+fname);
+    Misc::BinaryReader reader(*data);
 
-        DungeonHeader::Offset *doffset = dheader.mOffsets.data();
-        region.mDungeons.resize(dheader.mDungeonCount);
-        for(DungeonInterior &dinfo : region.mDungeons)
-        {
-            stream->seekg(dbase_offset + doffset->mOffset);
-            dinfo.load(*stream);
-            if(dinfo.mExteriorLocationId != doffset->mExteriorLocationId)
-                throw std::runtime_error("Dungeon exterior location id mismatch for "+std::string(dinfo.mLocationName)+": "+
-                    std::to_string(dinfo.mExteriorLocationId)+" / "+std::to_string(doffset->mExteriorLocationId));
-            ++doffset;
-        }
-        stream = nullptr;
+    std::vector<uint32_t> extoffsets(region.mNames.size());
+    reader.read32(extoffsets.data(), extoffsets.size());
+    size_t extbase_offset = reader.tell();
 
-        if(regnum >= mRegions.size()) mRegions.resize(regnum+1);
-        mRegions[regnum] = std::move(region);
+    // Parse into temporaries, so a failure leaves the region unloaded.
+    std::vector<ExteriorLocation> exteriors(extoffsets.size());
+    uint32_t *extoffset = extoffsets.data();
+    for(ExteriorLocation &extinfo : exteriors)
+    {
+        reader.seek(extbase_offset + *extoffset);
+        extinfo.load(reader);
+        ++extoffset;
     }
 
-    loadPakList("CLIMATE.PAK", mClimates);
-    loadPakList("POLITIC.PAK", mPolitics);
+    /* Get dungeon data */
+    fname = "MAPDITEM."+region.mFileSuffix;
+    data = VFS::Manager::get().read(fname);
+    if(!data) throw std::runtime_error("Failed to open "+fname);
+    reader = Misc::BinaryReader(*data);
 
-    mViewer = viewer;
-    Renderer::get().setObjectRoot(sceneroot);
+    DungeonHeader dheader;
+    dheader.load(reader);
+    size_t dbase_offset = reader.tell();
+
+    std::vector<DungeonInterior> dungeons(dheader.mDungeonCount);
+    DungeonHeader::Offset *doffset = dheader.mOffsets.data();
+    for(DungeonInterior &dinfo : dungeons)
+    {
+        reader.seek(dbase_offset + doffset->mOffset);
+        dinfo.load(reader);
+        if(dinfo.mExteriorLocationId != doffset->mExteriorLocationId)
+            throw std::runtime_error("Dungeon exterior location id mismatch for "+std::string(dinfo.mLocationName)+": "+
+                std::to_string(dinfo.mExteriorLocationId)+" / "+std::to_string(doffset->mExteriorLocationId));
+        ++doffset;
+    }
+
+    region.mExteriors = std::move(exteriors);
+    region.mDungeons = std::move(dungeons);
+    region.mItemsLoaded = true;
 }
 
-void World::deinitialize()
+void World::loadCachedItems(MapRegion &region) const
 {
-    mExterior.clear();
-    mDungeon.clear();
-    Renderer::get().setObjectRoot(nullptr);
-    mViewer = nullptr;
-}
+    Misc::BinaryReader reader(mCacheData->data(), mCacheData->size());
+    reader.seek(region.mCacheOffset);
+
+    std::vector<ExteriorLocation> exteriors(readCount(reader));
+    for(ExteriorLocation &extinfo : exteriors)
+        extinfo.load(reader);
+
+    std::vector<DungeonInterior> dungeons(readCount(reader));
+    for(DungeonInterior &dinfo : dungeons)
+        dinfo.load(reader);
 
+    region.mExteriors = std::move(exteriors);
+    region.mDungeons = std::move(dungeons);
+    region.mItemsLoaded = true;
+}
 
-void World::loadPakList(std::string&& fname, std::vector<PakArray> &paklist)
+void World::loadItems(MapRegion &region) const
 {
-    VFS::IStreamPtr stream = VFS::Manager::get().open(fname.c_str());
-    if(!stream) throw std::runtime_error("Failed to open "+fname);
+    if(region.mCacheOffset != 0 && mCacheData)
+        loadCachedItems(region);
+    else
+        loadRegionItems(region);
+}
 
-    size_t rownum = 0;
-    std::map<size_t,size_t> offsets_rows;
-    offsets_rows[VFS::read_le32(*stream)] = rownum++;
-    while((size_t)stream->tellg() < offsets_rows.begin()->first)
-        offsets_rows[VFS::read_le32(*stream)] = rownum++;
+void World::loadAllItems()
+{
+    std::lock_guard<std::mutex> lock(mRegionMutex);
 
-    auto iter = offsets_rows.begin();
-    while(iter != offsets_rows.end())
+    std::vector<MapRegion*> pending;
+    for(MapRegion &region : mRegions)
     {
-        auto next = std::next(iter);
+        if(!region.mItemsLoaded)
+            pending.push_back(&region);
+    }
 
-        PakArray pak;
-        while((next != offsets_rows.end() && (size_t)stream->tellg() < next->first) ||
-              (next == offsets_rows.end() && stream->peek() != std::istream::traits_type::eof()))
-        {
-            uint16_t count = VFS::read_le16(*stream);
-            uint8_t val = stream->get();
-            pak.push_back(std::make_pair(count, val));
-        }
-
-        if(iter->second >= paklist.size())
-            paklist.resize(iter->second+1);
-        paklist[iter->second] = std::move(pak);
-
-        iter = next;
-    }
-}
-
-uint8_t World::getPakListValue(const std::vector<PakArray> &paklist, size_t x, size_t y)
-{
-    /* As mentioned on UESP: http://uesp.net/wiki/Daggerfall:WOODS.WLD_format
-     *
-     * "the valid domain for each axis is defined as:
-     * Dom(X) = (51200, 32389120)
-     * Dom(Y) = (-80, 1228)
-     * Dom(Z) = (40961, 16332801)"
-     *
-     * However, there appears to be a mistake in that the Dom(X) and Dom(Z)
-     * values correspond to the ExteriorLocation's X and Y values, where those
-     * are the region map's Longitude and Latitude value*256 + n (where n is
-     * 0...255). Additionally, the latitude increases while going north. Thus,
-     * the correct domain for the longitude/latitude is:
-     *
-     * Dom(X) = [200, 126520]
-     * Dom(Z) = [63800, 160]
-     *
-     * However, I'm not sure if this range correctly maps to the world/climate/
-     * etc map extents.
+    /* This thread takes regions too, so it can't wait on workers that are
+     * themselves waiting for the lock, like the cache writer.
      */
-    if(x <= 200) x = 0;
-    else x = size_t(uint64_t(x-200) * 1000 / (126520-200));
+    mWorkers.parallelFor(pending.size(), [this, &pending](size_t i) { loadItems(*pending[i]); });
+}
 
-    if(y <= 160) y = 499;
-    else y = 499 - size_t(uint64_t(y-160) * 499 / (63800-160));
+const MapRegion &World::getRegion(size_t regnum)
+{
+    MapRegion &region = mRegions.at(regnum);
 
-    uint8_t value = 0;
-    const PakArray &pak = paklist[std::min(y, paklist.size()-1)];
-    for(const auto &entry : pak)
+    std::lock_guard<std::mutex> lock(mRegionMutex);
+    if(!region.mItemsLoaded)
     {
-        value = entry.second;
-        if(x < entry.first)
-            break;
-        x -= entry.first;
+        auto start = Clock::now();
+        loadItems(region);
+        double elapsed = millisecondsSince(start);
+
+        mLazyLoadTime += elapsed;
+        Log::get().stream()<< "Loaded region "<<regnum<<" locations in "<<elapsed<<" ms";
     }
-    return value;
+    return region;
 }
 
-
-bool World::getExteriorByName(const std::string &name, size_t &regnum, size_t &mapnum) const
+void World::parseMapData(bool loaditems)
 {
-    for(const MapRegion &region : mRegions)
+    auto start = Clock::now();
+
+    std::set<std::string> names = VFS::Manager::get().list("MAPNAMES.[0-9]*");
+    if(names.empty()) throw std::runtime_error("Failed to find any regions");
+
+    /* Regions are independent of each other, so each is parsed by its own
+     * task, along with the climate and politic maps. The results are merged
+     * as they're collected. With lazy loading, only the names and map table
+     * are read here, and the locations are parsed when first used.
+     */
+    std::vector<double> tasktimes(names.size()+2, 0.0);
+    std::vector<std::pair<unsigned long,std::future<MapRegion>>> regions;
+    regions.reserve(names.size());
+    for(const std::string &name : names)
     {
-        auto iter = std::find(region.mNames.begin(), region.mNames.end(), name);
-        if(iter != region.mNames.end())
-        {
-            regnum = std::distance(mRegions.data(), &region);
-            mapnum = std::distance(region.mNames.begin(), iter);
-            return true;
+        size_t pos = name.rfind('.');
+        if(pos == std::string::npos)
+            continue;
+        std::string regstr = name.substr(pos+1);
+        unsigned long regnum = std::stoul(regstr, nullptr, 10);
+
+        double *tasktime = &tasktimes[regions.size()];
+        regions.push_back(std::make_pair(regnum, mWorkers.submit(
+            [name, regstr, tasktime, loaditems]() -> MapRegion
+            {
+                auto taskstart = Clock::now();
+                MapRegion region = loadRegion(name, regstr, loaditems);
+                *tasktime = millisecondsSince(taskstart);
+                return region;
+            }
+        )));
+    }
+    auto loadpak = [](const char *fname, double *tasktime) -> WorldMap
+    {
+        auto taskstart = Clock::now();
+        WorldMap map = loadWorldMap(fname);
+        *tasktime = millisecondsSince(taskstart);
+        return map;
+    };
+    std::future<WorldMap> climates = mWorkers.submit(
+        std::bind(loadpak, "CLIMATE.PAK", &tasktimes[names.size()])
+    );
+    std::future<WorldMap> politics = mWorkers.submit(
+        std::bind(loadpak, "POLITIC.PAK", &tasktimes[names.size()+1])
+    );
+    Log::get().stream()<< "Queued "<<regions.size()<<" regions in "<<millisecondsSince(start)<<" ms";
+
+    // Wait on every task before throwing, since they write to tasktimes.
+    std::exception_ptr error;
+    for(auto &region : regions)
+    {
+        try {
+            MapRegion result = region.second.get();
+            if(result.mNames.empty()) continue;
+
+            if(region.first >= mRegions.size()) mRegions.resize(region.first+1);
+            mRegions[region.first] = std::move(result);
+        }
+        catch(...) {
+            if(!error) error = std::current_exception();
         }
     }
-    return false;
+    double regiontime = millisecondsSince(start);
+    try {
+        mClimate = climates.get();
+    }
+    catch(...) {
+        if(!error) error = std::current_exception();
+    }
+    try {
+        mPolitics = politics.get();
+    }
+    catch(...) {
+        if(!error) error = std::current_exception();
+    }
+    if(error) std::rethrow_exception(error);
+
+    double worktime = 0.0;
+    for(size_t i = 0;i < regions.size();++i)
+        worktime += tasktimes[i];
+    Log::get().stream()<< "Parsed "<<regions.size()<<(loaditems ? " regions" : " region name tables")
+                       <<" after "<<regiontime<<" ms ("<<worktime<<" ms of work across "
+                       <<mWorkers.getThreadCount()<<" threads)";
+    Log::get().stream()<< "Loaded CLIMATE.PAK in "<<tasktimes[names.size()]<<" ms, POLITIC.PAK in "
+                       <<tasktimes[names.size()+1]<<" ms";
 }
 
-void World::loadExterior(int regnum, int extid)
+bool World::readCache()
 {
-    const MapRegion &region = mRegions.at(regnum);
-    const ExteriorLocation &extloc = region.mExteriors.at(extid);
-
-    mExterior.clear();
-    mDungeon.clear();
-    mCurrentRegion = &region;
-    mCurrentExterior = &extloc;
-    mCurrentDungeon = nullptr;
-    mCurrentSelection = InvalidHandle;
+    auto start = Clock::now();
 
-    uint8_t climate = getClimateValue(extloc.mX/256, extloc.mY/256);
-    Log::get().stream()<< "Climate "<<(int)climate;
+    std::shared_ptr<Archives::MappedFile> file = Archives::MappedFile::open(mCacheFile);
+    if(!file)
+    {
+        mCacheStatus = "not found";
+        Log::get().stream()<< "No world cache at "<<mCacheFile;
+        return false;
+    }
 
-    Log::get().stream()<< "Entering "<<extloc.mLocationName;
-    size_t count = extloc.mWidth * extloc.mHeight;
-    size_t startobj = InvalidHandle;
+    std::vector<MapRegion> regions;
+    WorldMap climates, politics;
+    try {
+        Misc::BinaryReader reader(file->data(), file->size());
 
-    mExterior.reserve(count);
-    for(size_t i = 0;i < count;++i)
-    {
-        std::string name = extloc.getMapBlockName(i, regnum);
-        if(!VFS::Manager::get().exists(name.c_str()))
+        std::array<char,8> magic;
+        reader.read(magic.data(), magic.size());
+        uint32_t version = reader.read32();
+        if(magic != gCacheMagic || version != gCacheVersion)
         {
-            Log::get().stream()<< name<<" does not exist";
-            name.erase(4);
-            name[4] = '*';
-            std::set<std::string> list = VFS::Manager::get().list(name.c_str());
-            if(list.empty()) name.clear();
-            else name = *list.begin();
+            mCacheStatus = "outdated format";
+            Log::get().stream()<< "World cache "<<mCacheFile<<" has an unknown format";
+            return false;
         }
 
-        VFS::IStreamPtr stream = VFS::Manager::get().open(name.c_str());
-        if(!stream) throw std::runtime_error("Failed to open "+name);
+        // The cache is stale if any source file moved or changed.
+        std::string changed;
+        if(readCount(reader) != mCacheSources.size())
+            changed = "the region list";
+        else for(const std::pair<std::string,VFS::SourceInfo> &source : mCacheSources)
+        {
+            std::string name = readString(reader);
+            std::string path = readString(reader);
+            uint64_t size = reader.read64();
+            int64_t modtime = reader.read64();
+            if(changed.empty() && (name != source.first || path != source.second.mPath ||
+                                   size != source.second.mSize || modtime != source.second.mModTime))
+                changed = source.first;
+        }
+        if(!changed.empty())
+        {
+            mCacheStatus = "stale";
+            Log::get().stream()<< "World cache "<<mCacheFile<<" is stale ("<<changed<<" changed)";
+            return false;
+        }
 
-        int x = i%extloc.mWidth;
-        int y = i/extloc.mWidth;
+        readWorldMap(reader, climates);
+        readWorldMap(reader, politics);
 
-        mExterior.push_back(std::unique_ptr<MBlockHeader>(new MBlockHeader()));
-        mExterior.back()->load(*stream, climate, i<<24, x*4096.0f, y*4096.0f);
+        regions.resize(readCount(reader));
+        for(MapRegion &region : regions)
+        {
+            region.mFileSuffix = readString(reader);
 
-        if(startobj != InvalidHandle)
-            continue;
+            region.mNames.resize(readCount(reader));
+            for(std::string &name : region.mNames)
+                name = readString(reader);
 
-        startobj = mExterior.back()->getObjectByTexture(Marker_EnterID);
-        if(startobj == InvalidHandle)
-            startobj = mExterior.back()->getObjectByTexture(Marker_StartID);
+            region.mTable.resize(region.mNames.size());
+            for(MapTable &maptable : region.mTable)
+                gMapTableLayout.read(reader, maptable);
 
-        if(startobj != InvalidHandle)
-        {
-            Position pos = Placeable::get().getPos(startobj);
-            mCameraPos = osg::componentMultiply(
-                -pos.mPoint, osg::Vec3f(1.0f, -1.0f, -1.0f)
-            );
+            uint32_t itemsize = reader.read32();
+            region.mCacheOffset = reader.tell();
+            reader.skip(itemsize);
         }
     }
-    if(startobj == InvalidHandle)
-    {
-        Log::get().message("Failed to find enter or start markers", Log::Level_Error);
-        mCameraPos = osg::Vec3f(-2048.0f, 0.0f, -2048.0f);
+    catch(std::exception &e) {
+        mCacheStatus = "invalid";
+        Log::get().stream(Log::Level_Error)<< "Failed to read world cache "<<mCacheFile<<": "<<e.what();
+        return false;
     }
-    mCameraRot = osg::Vec3f(0.0f, 1024.0f, 0.0f);
+
+    mRegions = std::move(regions);
+    mClimate = std::move(climates);
+    mPolitics = std::move(politics);
+    mCacheData = std::move(file);
+    mCacheStatus = "loaded";
+
+    Log::get().stream()<< "Loaded world cache "<<mCacheFile<<" ("<<(mCacheData->size()+1023)/1024
+                       <<" KiB) in "<<millisecondsSince(start)<<" ms";
+    return true;
 }
 
-void World::loadDungeonByExterior(int regnum, int extid)
+size_t World::writeCache()
 {
-    const MapRegion &region = mRegions.at(regnum);
-    const ExteriorLocation &extloc = region.mExteriors.at(extid);
-    for(const DungeonInterior &dinfo : region.mDungeons)
+    /* Regions that weren't loaded yet come from the game data, rather than
+     * an old cache that may be about to be replaced. They're loaded one at a
+     * time, so the main thread waits on at most one if it needs another.
+     */
+    for(MapRegion &region : mRegions)
     {
-        if(extloc.mLocationId != dinfo.mExteriorLocationId)
-            continue;
+        if(mCacheCancel)
+            return 0;
+        std::lock_guard<std::mutex> lock(mRegionMutex);
+        if(!region.mItemsLoaded)
+            loadRegionItems(region);
+    }
+
+    /* Once every region is loaded, the old cache isn't needed, and nothing
+     * changes the regions anymore, so they're written out without the lock.
+     */
+    {
+        std::lock_guard<std::mutex> lock(mRegionMutex);
+        mCacheData = nullptr;
+        for(MapRegion &region : mRegions)
+            region.mCacheOffset = 0;
+    }
 
-        mExterior.clear();
-        mDungeon.clear();
-        mCurrentRegion = &region;
-        mCurrentExterior = &extloc;
-        mCurrentDungeon = &dinfo;
-        mCurrentSelection = InvalidHandle;
+    std::vector<char> data;
+    Misc::BinaryWriter writer(data);
 
-        uint8_t climate = getClimateValue(extloc.mX/256, extloc.mY/256);
-        Log::get().stream()<< "Climate "<<(int)climate;
+    writer.write(gCacheMagic.data(), gCacheMagic.size());
+    writer.write32(gCacheVersion);
 
-        Log::get().stream()<< "Entering "<<dinfo.mLocationName;
-        mDungeon.reserve(dinfo.mBlocks.size());
-        for(const DungeonBlock &block : dinfo.mBlocks)
-        {
-            std::stringstream sstr;
-            sstr<< std::setfill('0')<<std::setw(8)<< block.mBlockIdx<<".RDB";
-            std::string name = sstr.str();
-            name.front() = gBlockIndexLabel.at(block.mBlockPreIndex);
+    writer.write32(mCacheSources.size());
+    for(const std::pair<std::string,VFS::SourceInfo> &source : mCacheSources)
+    {
+        writeString(writer, source.first);
+        writeString(writer, source.second.mPath);
+        writer.write64(source.second.mSize);
+        writer.write64(source.second.mModTime);
+    }
 
-            VFS::IStreamPtr stream = VFS::Manager::get().open(name.c_str());
-            if(!stream) throw std::runtime_error("Failed to open "+name);
+    writeWorldMap(writer, mClimate);
+    writeWorldMap(writer, mPolitics);
 
-            mDungeon.push_back(std::unique_ptr<DBlockHeader>(new DBlockHeader()));
-            mDungeon.back()->load(*stream, std::distance(dinfo.mBlocks.data(), &block)<<24,
-                                  block.mX*2048.0f, block.mZ*2048.0f, regnum, extid);
+    writer.write32(mRegions.size());
+    for(const MapRegion &region : mRegions)
+    {
+        writeString(writer, region.mFileSuffix);
+
+        writer.write32(region.mNames.size());
+        for(const std::string &name : region.mNames)
+            writeString(writer, name);
+        for(const MapTable &maptable : region.mTable)
+            gMapTableLayout.write(writer, maptable);
+
+        size_t sizepos = writer.tell();
+        writer.write32(0);
+        writer.write32(region.mExteriors.size());
+        for(const ExteriorLocation &extinfo : region.mExteriors)
+            extinfo.save(writer);
+        writer.write32(region.mDungeons.size());
+        for(const DungeonInterior &dinfo : region.mDungeons)
+            dinfo.save(writer);
+        writer.patch32(sizepos, writer.tell() - sizepos - 4);
+    }
 
-            if(block.mStartBlock)
-            {
-                size_t startobj = InvalidHandle;
-                if(mFirstStart)
-                {
-                    mFirstStart = false;
-                    startobj = mDungeon.back()->getObjectByTexture(Marker_EnterID);
-                }
-                if(startobj == InvalidHandle)
-                    startobj = mDungeon.back()->getObjectByTexture(Marker_StartID);
-
-                if(startobj == InvalidHandle)
-                    mCameraPos = osg::Vec3f(0.0f, 0.0f, 0.0f);
-                else
-                {
-                    Position pos = Placeable::get().getPos(startobj);
-                    mCameraPos = osg::componentMultiply(
-                        -(pos.mPoint + osg::Vec3f(block.mX*2048.0f, 0.0f, block.mZ*2048.0f)),
-                        osg::Vec3f(1.0f, -1.0f, -1.0f)
-                    );
-                }
-                mCameraRot = osg::Vec3f(0.0f, 1024.0f, 0.0f);
-            }
-        }
-        break;
+    /* Written to a temporary that replaces the cache when complete, so a
+     * failed write can't leave a partial cache behind.
+     */
+    std::string tmpname = mCacheFile+".tmp";
+    std::ofstream ofile(tmpname, std::ios_base::binary | std::ios_base::trunc);
+    ofile.write(data.data(), data.size());
+    ofile.close();
+    if(!ofile.fail())
+    {
+#ifdef _WIN32
+        std::remove(mCacheFile.c_str());
+#endif
+        if(std::rename(tmpname.c_str(), mCacheFile.c_str()) == 0)
+            return data.size();
     }
+    std::remove(tmpname.c_str());
+
+    throw std::runtime_error("Failed to write "+tmpname);
 }
 
-void World::loadCurrentExteriorDungeon()
+void World::startCacheWrite()
 {
-    if(mCurrentDungeon)
-        Log::get().message("Already in a dungeon");
-    else if(!mCurrentRegion)
+    if(mCacheTask.valid())
+    {
+        Log::get().message("The world cache is already being written");
+        return;
+    }
+
+    mCacheStatus = "writing";
+    mCacheCancel = false;
+    mCacheWriteStart = Clock::now();
+    mCacheTask = mWorkers.submit([this]() -> size_t { return writeCache(); },
+                                 Misc::TaskPriority_Low);
+}
+
+void World::updateCacheWrite()
+{
+    if(!mCacheTask.valid() || mCacheTask.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return;
+
+    try {
+        size_t size = mCacheTask.get();
+        if(size == 0)
+        {
+            mCacheStatus = "cancelled";
+            return;
+        }
+        mCacheStatus = "written";
+        Log::get().stream()<< "Wrote world cache "<<mCacheFile<<" ("<<(size+1023)/1024
+                           <<" KiB) after "<<millisecondsSince(mCacheWriteStart)<<" ms";
+    }
+    catch(std::exception &e) {
+        mCacheStatus = "failed to write";
+        Log::get().stream(Log::Level_Error)<< "Failed to write world cache "<<mCacheFile<<": "<<e.what();
+    }
+}
+
+void World::buildNameIndex()
+{
+    auto start = Clock::now();
+
+    mExteriorNames.clear();
+    for(size_t regnum = 0;regnum < mRegions.size();++regnum)
+    {
+        const std::vector<std::string> &names = mRegions[regnum].mNames;
+        if(regnum > 0xffff || names.size() > 0x10000)
+            throw std::runtime_error("Too many regions or locations to index");
+        for(size_t mapnum = 0;mapnum < names.size();++mapnum)
+            mExteriorNames.add(names[mapnum], (regnum<<16) | mapnum);
+    }
+    mExteriorNames.build();
+
+    Log::get().stream()<< "Indexed "<<mExteriorNames.size()<<" exterior names in "
+                       <<millisecondsSince(start)<<" ms";
+}
+
+void World::rebuildCache()
+{
+    if(mCacheFile.empty())
+    {
+        Log::get().stream(Log::Level_Error)<< "No world cache file is set";
+        return;
+    }
+    startCacheWrite();
+}
+
+
+void World::initialize(osgViewer::Viewer *viewer, osg::Group *sceneroot, const std::string &cachefile)
+{
+    auto start = Clock::now();
+    mWorkers.start(*world_threads);
+
+    mCacheFile = (*world_cache ? cachefile : std::string());
+    if(!mCacheFile.empty() && !getMapSources(mCacheSources))
+        mCacheFile.clear();
+
+    if(mCacheFile.empty())
+    {
+        mCacheStatus = "disabled";
+        parseMapData(!*world_lazyregions);
+    }
+    else if(readCache())
+    {
+        if(!*world_lazyregions)
+            loadAllItems();
+    }
+    else
+        parseMapData(false);
+
+    buildNameIndex();
+
+    mInitTime = millisecondsSince(start);
+    mLazyLoadTime = 0.0;
+    Log::get().stream()<< "World initialized in "<<mInitTime<<" ms";
+
+    // Without a usable cache, one is written in the background for next time.
+    if(!mCacheFile.empty() && !mCacheData)
+        startCacheWrite();
+
+    mViewer = viewer;
+    Renderer::get().setObjectRoot(sceneroot);
+    mStreamer.setResolver([this](int x, int z, StreamTileInfo &info) -> bool
+                          { return resolveTile(x, z, info); });
+}
+
+void World::deinitialize()
+{
+    cancelLoad();
+    cancelPrefetch();
+    mCacheCancel = true;
+    mBenchmark = nullptr;
+    mStreamer.stop();
+    unloadLocation();
+    mLocationCache.clear();
+    Renderer::get().setObjectRoot(nullptr);
+    mViewer = nullptr;
+    mWorkers.stop();
+    mCacheTask = std::future<size_t>();
+    MBlockCache::get().clear();
+}
+
+
+WorldMap World::loadWorldMap(const std::string &fname)
+{
+    VFS::DataPtr data = VFS::Manager::get().read(fname);
+    if(!data) throw std::runtime_error("Failed to open "+fname);
+    Misc::BinaryReader reader(*data);
+
+    WorldMap map;
+    map.load(reader);
+    return map;
+}
+
+
+bool World::getExteriorByName(const std::string &name, size_t &regnum, size_t &mapnum) const
+{
+    Misc::NameIndex::range found = mExteriorNames.find(name);
+    if(found.first == found.second)
+        return false;
+
+    regnum = found.first->mValue >> 16;
+    mapnum = found.first->mValue & 0xffff;
+    return true;
+}
+
+size_t World::findExteriors(const std::string &text, bool anywhere, std::vector<LocationMatch> &matches, size_t limit) const
+{
+    std::vector<Misc::NameIndex::iterator> found;
+    size_t count;
+    if(anywhere)
+        count = mExteriorNames.findSubstring(text, found, limit);
+    else
+    {
+        Misc::NameIndex::range range = mExteriorNames.findPrefix(text);
+        count = std::distance(range.first, range.second);
+        for(auto iter = range.first;iter != range.second && found.size() < limit;++iter)
+            found.push_back(iter);
+    }
+
+    for(Misc::NameIndex::iterator iter : found)
+    {
+        LocationMatch match;
+        match.mName = iter->mName;
+        match.mRegion = iter->mValue >> 16;
+        match.mIndex = iter->mValue & 0xffff;
+        matches.push_back(std::move(match));
+    }
+    return count;
+}
+
+size_t World::getRegionCount() const
+{
+    return mRegions.size();
+}
+
+void World::getExteriors(size_t regnum, std::vector<LocationSummary> &exteriors)
+{
+    const MapRegion &region = getRegion(regnum);
+    exteriors.reserve(exteriors.size() + region.mExteriors.size());
+    for(const ExteriorLocation &extloc : region.mExteriors)
+    {
+        LocationSummary summary;
+        summary.mName.assign(extloc.mLocationName, strnlen(extloc.mLocationName, sizeof(extloc.mLocationName)));
+        summary.mBlocks = extloc.mWidth * extloc.mHeight;
+        summary.mDungeonBlocks = 0;
+        for(const DungeonInterior &dinfo : region.mDungeons)
+        {
+            if(extloc.mLocationId != dinfo.mExteriorLocationId)
+                continue;
+            summary.mDungeonName.assign(dinfo.mLocationName, strnlen(dinfo.mLocationName, sizeof(dinfo.mLocationName)));
+            summary.mDungeonBlocks = dinfo.mBlocks.size();
+            break;
+        }
+        exteriors.push_back(std::move(summary));
+    }
+}
+
+std::string World::getBlockName(const ExteriorLocation &extloc, size_t idx, size_t regnum, bool &missing)
+{
+    std::string name = extloc.getMapBlockName(idx, regnum);
+    missing = !VFS::Manager::get().exists(name.c_str());
+    if(missing)
+    {
+        name.erase(4);
+        name += '*';
+        std::set<std::string> list = VFS::Manager::get().list(name.c_str());
+        if(list.empty()) name.clear();
+        else name = *list.begin();
+    }
+    return name;
+}
+
+void World::loadExterior(int regnum, int extid)
+{
+    const MapRegion &region = getRegion(regnum);
+    const ExteriorLocation &extloc = region.mExteriors.at(extid);
+
+    if(mStreamer.isActive())
+    {
+        // Move the streamed area over, rather than loading the location.
+        startStreaming(regnum, extid);
+        mCameraPos = osg::Vec3f(-2048.0f, 0.0f, -2048.0f);
+        mCameraRot = osg::Vec3f(0.0f, 1024.0f, 0.0f);
+        return;
+    }
+
+    std::shared_ptr<PendingLocation> location(new PendingLocation());
+    location->mRegion = &region;
+    location->mExterior = &extloc;
+    location->mRegionNum = regnum;
+    location->mLocationNum = extid;
+    location->mName.assign(extloc.mLocationName, strnlen(extloc.mLocationName, sizeof(extloc.mLocationName)));
+
+    location->mClimate = mClimate.getValue(extloc.mX/256, extloc.mY/256);
+    Log::get().stream()<< "Climate "<<(int)location->mClimate;
+
+    size_t count = extloc.mWidth * extloc.mHeight;
+    location->mBlockNames.resize(count);
+    location->mBlockOffsets.resize(count);
+    for(size_t i = 0;i < count;++i)
+    {
+        bool missing;
+        location->mBlockNames[i] = getBlockName(extloc, i, regnum, missing);
+        if(missing)
+            Log::get().stream()<< extloc.getMapBlockName(i, regnum)<<" does not exist";
+
+        int x = i%extloc.mWidth;
+        int y = i/extloc.mWidth;
+        location->mBlockOffsets[i] = osg::Vec3f(x*4096.0f, 0.0f, y*4096.0f);
+    }
+
+    startLoad(std::move(location));
+}
+
+void World::loadDungeonByExterior(int regnum, int extid)
+{
+    const MapRegion &region = getRegion(regnum);
+    const ExteriorLocation &extloc = region.mExteriors.at(extid);
+    for(const DungeonInterior &dinfo : region.mDungeons)
+    {
+        if(extloc.mLocationId != dinfo.mExteriorLocationId)
+            continue;
+
+        std::shared_ptr<PendingLocation> location(new PendingLocation());
+        location->mRegion = &region;
+        location->mExterior = &extloc;
+        location->mDungeon = &dinfo;
+        location->mRegionNum = regnum;
+        location->mLocationNum = extid;
+        location->mName.assign(dinfo.mLocationName, strnlen(dinfo.mLocationName, sizeof(dinfo.mLocationName)));
+
+        location->mClimate = mClimate.getValue(extloc.mX/256, extloc.mY/256);
+        Log::get().stream()<< "Climate "<<(int)location->mClimate;
+
+        location->mBlockNames.reserve(dinfo.mBlocks.size());
+        location->mBlockOffsets.reserve(dinfo.mBlocks.size());
+        for(const DungeonBlock &block : dinfo.mBlocks)
+        {
+            location->mBlockNames.push_back(getDungeonBlockName(block));
+            location->mBlockOffsets.push_back(osg::Vec3f(block.mX*2048.0f, 0.0f, block.mZ*2048.0f));
+        }
+
+        if(mPrefetch && mPrefetch->mDungeon == &dinfo)
+            location->mPrefetch = std::move(mPrefetch);
+
+        startLoad(std::move(location));
+        break;
+    }
+}
+
+void World::startLoad(std::shared_ptr<PendingLocation> location)
+{
+    // Already on its way.
+    if(mPendingLoad && mPendingLoad->mExterior == location->mExterior &&
+       mPendingLoad->mDungeon == location->mDungeon)
+        return;
+    // Left recently enough that it's still loaded.
+    if(resumeLocation(location->mExterior, location->mDungeon))
+        return;
+    cancelLoad();
+
+    Log::get().stream()<< "Loading "<<location->mName;
+    location->mStartTime = Clock::now();
+    if(!*world_asyncload)
+    {
+        buildLocation(*location, mWorkers);
+        swapLocation(*location);
+        return;
+    }
+
+    // The task keeps its own reference, so a cancelled location can be
+    // dropped here while it finishes up.
+    Misc::ThreadPool *workers = &mWorkers;
+    mPendingTask = mWorkers.submit([location, workers]() { buildLocation(*location, *workers); },
+                                   Misc::TaskPriority_High);
+    mPendingLoad = std::move(location);
+}
+
+void World::cancelLoad()
+{
+    if(!mPendingLoad)
+        return;
+
+    mPendingLoad->mCancelled = true;
+    mPendingLoad = nullptr;
+    mPendingTask = std::future<void>();
+    GuiIface::get().updateLoadProgress(std::string(), 0.0f);
+}
+
+void World::buildLocation(PendingLocation &location, Misc::ThreadPool &workers)
+{
+    if(!location.mDungeon)
+    {
+        // Parsed blocks are shared with other locations, so only the ones
+        // not already cached are read (together) and parsed.
+        std::vector<std::shared_ptr<const MBlockData>> blocks = MBlockCache::get().getBatch(location.mBlockNames);
+
+        for(size_t i = 0;i < blocks.size() && !location.mCancelled;++i)
+        {
+            const osg::Vec3f &offset = location.mBlockOffsets[i];
+            location.mExteriorBlocks.push_back(std::unique_ptr<MBlockHeader>(new MBlockHeader()));
+            location.mExteriorBlocks.back()->allocate(std::move(blocks[i]), location.mScene, location.mClimate,
+                                                  i<<24, offset.x(), offset.z());
+            ++location.mBlocksDone;
+        }
+        return;
+    }
+
+    // A prefetched dungeon only needs its scene built. One still going is
+    // stopped rather than waited on, since it may be queued behind other low
+    // priority work; its meshes stay cached while it's held here.
+    std::shared_ptr<DungeonPrefetch> prefetch = std::move(location.mPrefetch);
+    if(prefetch && prefetch->mState == DungeonPrefetch::State_Ready)
+        location.mDungeonBlocks = std::move(prefetch->mBlocks);
+    else
+    {
+        if(prefetch)
+            prefetch->mCancelled = true;
+        decodeDungeon(location.mBlockNames, location.mDungeonBlocks, location.mCancelled,
+                      workers, Misc::TaskPriority_High);
+    }
+
+    for(size_t i = 0;i < location.mDungeonBlocks.size() && !location.mCancelled;++i)
+    {
+        const osg::Vec3f &offset = location.mBlockOffsets[i];
+        location.mDungeonBlocks[i]->allocate(location.mScene, offset.x(), offset.z(),
+                                             location.mRegionNum, location.mLocationNum);
+        ++location.mBlocksDone;
+    }
+}
+
+void World::decodeDungeon(const std::vector<std::string> &names, std::vector<std::unique_ptr<DBlockHeader>> &dblocks,
+                          const std::atomic<bool> &cancelled, Misc::ThreadPool &workers, Misc::TaskPriority priority)
+{
+    // Read all the blocks up front, so the reads can be issued together,
+    // then decode them in parallel. Only building the scene has to be done
+    // one block at a time.
+    std::vector<VFS::DataPtr> blocks = VFS::Manager::get().readBatch(names);
+    dblocks.resize(blocks.size());
+    workers.parallelFor(blocks.size(), [&names, &dblocks, &blocks, &cancelled](size_t i)
+    {
+        if(cancelled)
+            return;
+        if(!blocks[i]) throw std::runtime_error("Failed to open "+names[i]);
+        Misc::BinaryReader reader(*blocks[i]);
+
+        std::unique_ptr<DBlockHeader> block(new DBlockHeader());
+        try {
+            block->load(reader, i<<24);
+        }
+        catch(std::exception &e) {
+            throw std::runtime_error(names[i]+": "+e.what());
+        }
+        blocks[i] = nullptr;
+        dblocks[i] = std::move(block);
+    }, priority);
+}
+
+
+void World::startPrefetch()
+{
+    if(!*world_prefetch || !mCurrentExterior || mCurrentDungeon)
+    {
+        cancelPrefetch();
+        return;
+    }
+
+    const DungeonInterior *dungeon = nullptr;
+    for(const DungeonInterior &dinfo : mCurrentRegion->mDungeons)
+    {
+        if(mCurrentExterior->mLocationId == dinfo.mExteriorLocationId)
+        {
+            dungeon = &dinfo;
+            break;
+        }
+    }
+    // Nothing to do for one that's still loaded.
+    if(dungeon && findCachedLocation(mCurrentExterior, dungeon) != mLocationCache.end())
+        dungeon = nullptr;
+    if(mPrefetch && mPrefetch->mDungeon == dungeon)
+        return;
+    cancelPrefetch();
+    if(!dungeon)
+        return;
+
+    std::shared_ptr<DungeonPrefetch> prefetch(new DungeonPrefetch());
+    prefetch->mDungeon = dungeon;
+    prefetch->mName.assign(dungeon->mLocationName, strnlen(dungeon->mLocationName, sizeof(dungeon->mLocationName)));
+    prefetch->mBlockNames.reserve(dungeon->mBlocks.size());
+    for(const DungeonBlock &block : dungeon->mBlocks)
+        prefetch->mBlockNames.push_back(getDungeonBlockName(block));
+    prefetch->mStartTime = Clock::now();
+
+    // Errors are kept with the prefetch, for the stats; going in will decode
+    // again and report them properly.
+    Misc::ThreadPool *workers = &mWorkers;
+    mWorkers.submit([prefetch, workers]() { prefetchDungeon(*prefetch, *workers); },
+                    Misc::TaskPriority_Low);
+    mPrefetch = std::move(prefetch);
+}
+
+void World::cancelPrefetch()
+{
+    if(!mPrefetch)
+        return;
+
+    mPrefetch->mCancelled = true;
+    mPrefetch = nullptr;
+}
+
+void World::prefetchDungeon(DungeonPrefetch &prefetch, Misc::ThreadPool &workers)
+{
+    try {
+        std::vector<std::unique_ptr<DBlockHeader>> blocks;
+        decodeDungeon(prefetch.mBlockNames, blocks, prefetch.mCancelled, workers, Misc::TaskPriority_Low);
+        for(const std::unique_ptr<DBlockHeader> &block : blocks)
+        {
+            if(prefetch.mCancelled)
+                return;
+            block->warmResources(prefetch.mResources);
+        }
+        prefetch.mBlocks = std::move(blocks);
+        prefetch.mTime = millisecondsSince(prefetch.mStartTime);
+        prefetch.mState = DungeonPrefetch::State_Ready;
+    }
+    catch(std::exception &e) {
+        prefetch.mError = e.what();
+        prefetch.mState = DungeonPrefetch::State_Failed;
+    }
+}
+
+void World::updateLoad()
+{
+    if(!mPendingLoad)
+        return;
+
+    if(mPendingTask.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+        size_t total = std::max<size_t>(mPendingLoad->mBlockNames.size(), 1);
+        GuiIface::get().updateLoadProgress(mPendingLoad->mName, float(mPendingLoad->mBlocksDone) / float(total));
+        return;
+    }
+
+    std::shared_ptr<PendingLocation> location = std::move(mPendingLoad);
+    GuiIface::get().updateLoadProgress(std::string(), 1.0f);
+    try {
+        mPendingTask.get();
+    }
+    catch(std::exception &e) {
+        Log::get().stream(Log::Level_Error)<< "Failed to load "<<location->mName<<": "<<e.what();
+        return;
+    }
+    swapLocation(*location);
+}
+
+void World::swapLocation(PendingLocation &location)
+{
+    stopStreaming();
+    leaveLocation();
+    // A fresh copy replaces any kept from before.
+    auto cached = findCachedLocation(location.mExterior, location.mDungeon);
+    if(cached != mLocationCache.end())
+        mLocationCache.erase(cached);
+
+    mCurrentRegion = location.mRegion;
+    mCurrentExterior = location.mExterior;
+    mCurrentDungeon = location.mDungeon;
+    mCurrentSelection = InvalidHandle;
+    mExterior = std::move(location.mExteriorBlocks);
+    mDungeon = std::move(location.mDungeonBlocks);
+    startPrefetch();
+
+    location.mScene.commit();
+    mLocationRoot = location.mScene.getRoot();
+    Renderer::get().getObjectRoot()->addChild(mLocationRoot);
+
+    mLastLoadTime = millisecondsSince(location.mStartTime);
+    Log::get().stream()<< "Entering "<<location.mName<<" (loaded in "<<mLastLoadTime<<" ms)";
+
+    placeCamera();
+}
+
+bool World::resumeLocation(const ExteriorLocation *exterior, const DungeonInterior *dungeon)
+{
+    auto iter = findCachedLocation(exterior, dungeon);
+    if(iter == mLocationCache.end())
+        return false;
+
+    auto start = Clock::now();
+    std::unique_ptr<CachedLocation> cached = std::move(*iter);
+    mLocationCache.erase(iter);
+
+    cancelLoad();
+    stopStreaming();
+    leaveLocation();
+
+    mCurrentRegion = cached->mRegion;
+    mCurrentExterior = cached->mExterior;
+    mCurrentDungeon = cached->mDungeon;
+    mCurrentSelection = InvalidHandle;
+    mExterior = std::move(cached->mExteriorBlocks);
+    mDungeon = std::move(cached->mDungeonBlocks);
+    cached->mObjects.swap();
+    mLocationRoot = cached->mRoot;
+    Renderer::get().getObjectRoot()->addChild(mLocationRoot);
+    startPrefetch();
+
+    mLastLoadTime = millisecondsSince(start);
+    Log::get().stream()<< "Returning to "<<cached->mName<<" (in "<<mLastLoadTime<<" ms)";
+
+    placeCamera();
+    return true;
+}
+
+void World::placeCamera()
+{
+    if(mCurrentDungeon)
+    {
+        for(size_t i = 0;i < mCurrentDungeon->mBlocks.size();++i)
+        {
+            const DungeonBlock &block = mCurrentDungeon->mBlocks[i];
+            if(!block.mStartBlock)
+                continue;
+
+            size_t startobj = InvalidHandle;
+            if(mFirstStart)
+            {
+                mFirstStart = false;
+                startobj = mDungeon.at(i)->getObjectByTexture(Marker_EnterID);
+            }
+            if(startobj == InvalidHandle)
+                startobj = mDungeon.at(i)->getObjectByTexture(Marker_StartID);
+
+            if(startobj == InvalidHandle)
+                mCameraPos = osg::Vec3f(0.0f, 0.0f, 0.0f);
+            else
+            {
+                Position pos = Placeable::get().getPos(startobj);
+                mCameraPos = osg::componentMultiply(
+                    -(pos.mPoint + osg::Vec3f(block.mX*2048.0f, 0.0f, block.mZ*2048.0f)),
+                    osg::Vec3f(1.0f, -1.0f, -1.0f)
+                );
+            }
+            mCameraRot = osg::Vec3f(0.0f, 1024.0f, 0.0f);
+        }
+        return;
+    }
+
+    size_t startobj = InvalidHandle;
+    for(const std::unique_ptr<MBlockHeader> &block : mExterior)
+    {
+        startobj = block->getObjectByTexture(Marker_EnterID);
+        if(startobj == InvalidHandle)
+            startobj = block->getObjectByTexture(Marker_StartID);
+        if(startobj != InvalidHandle)
+            break;
+    }
+    if(startobj != InvalidHandle)
+    {
+        Position pos = Placeable::get().getPos(startobj);
+        mCameraPos = osg::componentMultiply(
+            -pos.mPoint, osg::Vec3f(1.0f, -1.0f, -1.0f)
+        );
+    }
+    else
+    {
+        Log::get().message("Failed to find enter or start markers", Log::Level_Error);
+        mCameraPos = osg::Vec3f(-2048.0f, 0.0f, -2048.0f);
+    }
+    mCameraRot = osg::Vec3f(0.0f, 1024.0f, 0.0f);
+}
+
+void World::leaveLocation()
+{
+    if(!mLocationRoot || *world_loccache <= 0)
+    {
+        unloadLocation();
+        trimLocationCache();
+        return;
+    }
+
+    std::unique_ptr<CachedLocation> cached(new CachedLocation());
+    cached->mRegion = mCurrentRegion;
+    cached->mExterior = mCurrentExterior;
+    cached->mDungeon = mCurrentDungeon;
+    const LocationHeader &header = mCurrentDungeon ? static_cast<const LocationHeader&>(*mCurrentDungeon) :
+                                                     static_cast<const LocationHeader&>(*mCurrentExterior);
+    cached->mName.assign(header.mLocationName, strnlen(header.mLocationName, sizeof(header.mLocationName)));
+
+    Renderer::get().getObjectRoot()->removeChild(mLocationRoot);
+    cached->mRoot = mLocationRoot;
+    mLocationRoot = nullptr;
+    cached->mExteriorBlocks = std::move(mExterior);
+    cached->mDungeonBlocks = std::move(mDungeon);
+    mExterior.clear();
+    mDungeon.clear();
+    cached->mObjects.swap();
+    mCurrentSelection = InvalidHandle;
+
+    mLocationCache.push_front(std::move(cached));
+    trimLocationCache();
+}
+
+void World::trimLocationCache()
+{
+    size_t budget = size_t(*world_loccache_mem) * 1024;
+    size_t total = 0;
+    for(const std::unique_ptr<CachedLocation> &cached : mLocationCache)
+        total += cached->getMemoryUsage();
+
+    while(!mLocationCache.empty() && (mLocationCache.size() > size_t(*world_loccache) || total > budget))
+    {
+        total -= mLocationCache.back()->getMemoryUsage();
+        mLocationCache.pop_back();
+    }
+}
+
+std::list<std::unique_ptr<CachedLocation>>::iterator World::findCachedLocation(const ExteriorLocation *exterior, const DungeonInterior *dungeon)
+{
+    return std::find_if(mLocationCache.begin(), mLocationCache.end(),
+        [exterior, dungeon](const std::unique_ptr<CachedLocation> &cached) -> bool
+        { return cached->mExterior == exterior && cached->mDungeon == dungeon; }
+    );
+}
+
+void World::stopStreaming()
+{
+    if(!mStreamer.isActive())
+        return;
+
+    mBenchmark = nullptr;
+    mStreamer.stop();
+    Log::get().message("Streaming off");
+}
+
+void World::unloadLocation()
+{
+    // Detach the whole scene at once, so each object's node isn't removed
+    // from it one at a time.
+    if(mLocationRoot)
+    {
+        Renderer::get().getObjectRoot()->removeChild(mLocationRoot);
+        mLocationRoot->removeChildren(0, mLocationRoot->getNumChildren());
+        mLocationRoot = nullptr;
+    }
+
+    for(std::unique_ptr<MBlockHeader> &block : mExterior)
+        block->deallocate();
+    for(std::unique_ptr<DBlockHeader> &block : mDungeon)
+        block->deallocate();
+    mExterior.clear();
+    mDungeon.clear();
+}
+
+void World::loadCurrentExteriorDungeon()
+{
+    if(mCurrentDungeon)
+        Log::get().message("Already in a dungeon");
+    else if(!mCurrentRegion)
         Log::get().message("Not currently in a region");
     else if(!mCurrentExterior)
         Log::get().message("Not currently in an exterior");
@@ -591,6 +1765,234 @@ void World::loadCurrentExteriorDungeon()
 }
 
 
+void World::buildExteriorCells()
+{
+    auto start = Clock::now();
+    loadAllItems();
+
+    mExteriorCells.clear();
+    size_t width = mClimate.getWidth();
+    for(size_t regnum = 0;regnum < mRegions.size();++regnum)
+    {
+        const std::vector<ExteriorLocation> &exteriors = mRegions[regnum].mExteriors;
+        for(size_t extid = 0;extid < exteriors.size();++extid)
+        {
+            const ExteriorLocation &extloc = exteriors[extid];
+            size_t key = WorldMap::toRow(extloc.mY/256)*width + WorldMap::toColumn(extloc.mX/256);
+
+            // Where locations share a cell, keep the biggest.
+            auto iter = mExteriorCells.find(key);
+            if(iter != mExteriorCells.end())
+            {
+                const ExteriorLocation &other = mRegions[*iter>>16].mExteriors[*iter&0xffff];
+                if(other.mWidth*other.mHeight >= extloc.mWidth*extloc.mHeight)
+                    continue;
+            }
+            mExteriorCells[key] = (regnum<<16) | extid;
+        }
+    }
+    Log::get().stream()<< "Indexed "<<mExteriorCells.size()<<" exterior cells in "<<millisecondsSince(start)<<" ms";
+}
+
+void World::getExteriorTile(const ExteriorLocation &extloc, int &x, int &z) const
+{
+    int width = std::min<int>(extloc.mWidth, 8);
+    int height = std::min<int>(extloc.mHeight, 8);
+    x = int(WorldMap::toColumn(extloc.mX/256))*8 + (8-width)/2;
+    z = int(WorldMap::toRow(extloc.mY/256))*8 + (8-height)/2;
+}
+
+bool World::resolveTile(int x, int z, StreamTileInfo &info) const
+{
+    if(x < 0 || z < 0)
+        return false;
+    size_t col = x/8, row = z/8;
+    if(col >= mClimate.getWidth() || row >= mClimate.getHeight())
+        return false;
+    info.mClimate = mClimate.getCell(col, row);
+
+    auto iter = mExteriorCells.find(row*mClimate.getWidth() + col);
+    if(iter == mExteriorCells.end())
+        return true;
+
+    size_t regnum = *iter >> 16;
+    const ExteriorLocation &extloc = mRegions[regnum].mExteriors[*iter & 0xffff];
+    int bx, bz;
+    getExteriorTile(extloc, bx, bz);
+    bx = x - bx;
+    bz = z - bz;
+    int width = std::min<int>(extloc.mWidth, 8);
+    int height = std::min<int>(extloc.mHeight, 8);
+    if(bx >= 0 && bx < width && bz >= 0 && bz < height)
+    {
+        bool missing;
+        info.mBlockName = getBlockName(extloc, bz*width + bx, regnum, missing);
+    }
+    return true;
+}
+
+void World::startStreaming(size_t regnum, size_t extid)
+{
+    if(mExteriorCells.empty())
+        buildExteriorCells();
+
+    const MapRegion &region = getRegion(regnum);
+    const ExteriorLocation &extloc = region.mExteriors.at(extid);
+
+    cancelLoad();
+    leaveLocation();
+    mCurrentRegion = &region;
+    mCurrentExterior = &extloc;
+    mCurrentDungeon = nullptr;
+    mCurrentSelection = InvalidHandle;
+    startPrefetch();
+
+    int x, z;
+    getExteriorTile(extloc, x, z);
+    mStreamer.start(Renderer::get().getObjectRoot(), x, z);
+}
+
+void World::setStreaming(bool enable)
+{
+    if(enable == mStreamer.isActive())
+        return;
+
+    if(enable)
+    {
+        if(!mCurrentExterior || mCurrentDungeon)
+        {
+            Log::get().message("Streaming needs an exterior to start from", Log::Level_Error);
+            return;
+        }
+        // The exterior's first block stays where it is, so the camera doesn't
+        // need to move.
+        startStreaming(std::distance((const MapRegion*)mRegions.data(), mCurrentRegion),
+                       std::distance(mCurrentRegion->mExteriors.data(), mCurrentExterior));
+        Log::get().message("Streaming on");
+        return;
+    }
+
+    mBenchmark = nullptr;
+    mStreamer.stop();
+    Log::get().message("Streaming off");
+    // Go back to the last exterior visited.
+    if(mCurrentExterior)
+        loadExterior(std::distance((const MapRegion*)mRegions.data(), mCurrentRegion),
+                     std::distance(mCurrentRegion->mExteriors.data(), mCurrentExterior));
+}
+
+bool World::isStreaming() const
+{
+    return mStreamer.isActive();
+}
+
+void World::updateStreaming()
+{
+    osg::Matrixf matf(osg::Matrixf::rotate(
+                                    0.0f, osg::Vec3f(0.0f, 0.0f, 1.0f),
+         mCameraRot.y()*3.14159f/1024.0f, osg::Vec3f(0.0f, 1.0f, 0.0f),
+        -mCameraRot.x()*3.14159f/1024.0f, osg::Vec3f(1.0f, 0.0f, 0.0f)
+    ));
+    // The camera position is the negated eye position, after the scene's
+    // flip on X.
+    osg::Vec3f dir = matf*osg::Vec3f(0.0f, 0.0f, 1.0f);
+    osg::Vec3f eye(-mCameraPos.x(), mCameraPos.y(), mCameraPos.z());
+    mStreamer.update(eye, osg::Vec3f(-dir.x(), dir.y(), dir.z()));
+
+    // Keep track of the exterior the camera's in, for going into its
+    // dungeon or leaving streaming.
+    int x, z;
+    mStreamer.getTile(eye, x, z);
+    if(x >= 0 && z >= 0 && size_t(x/8) < mClimate.getWidth())
+    {
+        auto iter = mExteriorCells.find((z/8)*mClimate.getWidth() + x/8);
+        if(iter != mExteriorCells.end() && mCurrentExterior != &mRegions[*iter >> 16].mExteriors[*iter & 0xffff])
+        {
+            mCurrentRegion = &mRegions[*iter >> 16];
+            mCurrentExterior = &mCurrentRegion->mExteriors[*iter & 0xffff];
+            startPrefetch();
+        }
+    }
+}
+
+void World::startStreamBenchmark(float seconds)
+{
+    if(!mCurrentExterior || mCurrentDungeon)
+    {
+        Log::get().message("The stream benchmark needs an exterior to start from", Log::Level_Error);
+        return;
+    }
+
+    // Start over from the middle of the exterior, facing the default way.
+    const ExteriorLocation &extloc = *mCurrentExterior;
+    startStreaming(std::distance((const MapRegion*)mRegions.data(), mCurrentRegion),
+                   std::distance(mCurrentRegion->mExteriors.data(), mCurrentExterior));
+    mStreamer.resetStats();
+    mCameraPos = osg::Vec3f(std::min<int>(extloc.mWidth, 8) * -2048.0f, -256.0f,
+                            std::min<int>(extloc.mHeight, 8) * 2048.0f - 4096.0f);
+    mCameraRot = osg::Vec3f(0.0f, 1024.0f, 0.0f);
+
+    // 60 frames per second, at a block per second.
+    mBenchmark.reset(new StreamBenchmark());
+    mBenchmark->mFramesLeft = std::max<size_t>(size_t(seconds * 60.0f), 1);
+    mBenchmark->mStep = 4096.0f / 60.0f;
+    mBenchmark->mFrameTimes.reserve(mBenchmark->mFramesLeft);
+    mBenchmark->mStreamTimes.reserve(mBenchmark->mFramesLeft);
+    Log::get().stream()<< "Running stream benchmark for "<<mBenchmark->mFramesLeft<<" frames";
+}
+
+void World::updateBenchmark()
+{
+    StreamBenchmark &bench = *mBenchmark;
+
+    // A frame's time is from one update to the next, so it includes drawing.
+    Clock::time_point now = Clock::now();
+    if(bench.mStarted)
+    {
+        bench.mFrameTimes.push_back(std::chrono::duration<double,std::milli>(now - bench.mLastFrame).count());
+        bench.mStreamTimes.push_back(mStreamer.getStats().mLastUpdateTime);
+    }
+    bench.mLastFrame = now;
+    bench.mStarted = true;
+
+    if(bench.mFramesLeft > 0)
+    {
+        --bench.mFramesLeft;
+        move(0.0f, 0.0f, bench.mStep);
+        return;
+    }
+
+    std::vector<double> &frames = bench.mFrameTimes;
+    if(frames.empty())
+    {
+        mBenchmark = nullptr;
+        return;
+    }
+    double total = 0.0, streamtotal = 0.0, streammax = 0.0;
+    size_t hitches = 0, bighitches = 0;
+    for(size_t i = 0;i < frames.size();++i)
+    {
+        total += frames[i];
+        if(frames[i] > 1000.0/60.0) ++hitches;
+        if(frames[i] > 1000.0/30.0) ++bighitches;
+        streamtotal += bench.mStreamTimes[i];
+        streammax = std::max(streammax, bench.mStreamTimes[i]);
+    }
+    std::sort(frames.begin(), frames.end());
+
+    WorldStreamer::Stats stats = mStreamer.getStats();
+    LogStream stream(Log::get().stream());
+    stream<< "Stream benchmark: "<<frames.size()<<" frames, avg "<<(total/frames.size())<<" ms"
+          <<", p50 "<<frames[frames.size()/2]<<" ms, p99 "<<frames[frames.size()*99/100]<<" ms"
+          <<", max "<<frames.back()<<" ms\n";
+    stream<< "Hitches: "<<hitches<<" over 16.7 ms, "<<bighitches<<" over 33.3 ms\n";
+    stream<< "Streaming: avg "<<(streamtotal/frames.size())<<" ms, max "<<streammax<<" ms per frame; "
+          <<stats.mTilesLoaded<<" tiles loaded, "<<stats.mTilesUnloaded<<" unloaded, "
+          <<stats.mFailures<<" failed, peak "<<stats.mPeakBlocks<<" blocks";
+    mBenchmark = nullptr;
+}
+
+
 void World::move(float xrel, float yrel, float zrel)
 {
     osg::Matrixf matf(osg::Matrixf::rotate(
@@ -610,6 +2012,13 @@ void World::rotate(float xrel, float yrel)
 
 void World::update(float timediff)
 {
+    updateLoad();
+    updateCacheWrite();
+    if(mBenchmark)
+        updateBenchmark();
+    if(mStreamer.isActive())
+        updateStreaming();
+
     GuiIface::Mode guimode = GuiIface::get().getMode();
 
     UnknownAction::get().update();
@@ -645,7 +2054,19 @@ void World::update(float timediff)
     else
     {
         std::stringstream sstr;
-        if(!mExterior.empty())
+        if(mStreamer.isActive())
+        {
+            MBlockHeader *block = mStreamer.getBlock(mCurrentSelection>>24);
+            const MObjectBase *obj = block ? block->getObject(mCurrentSelection) : nullptr;
+            if(!obj)
+                sstr<< "Failed to lookup object 0x"<<std::hex<<std::setfill('0')<<std::setw(8)<<mCurrentSelection;
+            else
+            {
+                sstr<<std::setfill('0');
+                obj->print(sstr);
+            }
+        }
+        else if(!mExterior.empty())
         {
             MBlockHeader *block = mExterior.at(mCurrentSelection>>24).get();
             const MObjectBase *obj = block->getObject(mCurrentSelection);
@@ -710,6 +2131,69 @@ void World::dumpArea() const
         stream<< "Not in a region";
 }
 
+void World::dumpStats() const
+{
+    size_t numregions = 0, numloaded = 0;
+    size_t numexteriors = 0, numdungeons = 0;
+    size_t regionbytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(mRegionMutex);
+        for(const MapRegion &region : mRegions)
+        {
+            if(region.mNames.empty()) continue;
+            ++numregions;
+            if(region.mItemsLoaded) ++numloaded;
+            numexteriors += region.mExteriors.size();
+            numdungeons += region.mDungeons.size();
+            regionbytes += region.getMemoryUsage();
+        }
+    }
+    size_t pakbytes = mClimate.getMemoryUsage() + mPolitics.getMemoryUsage();
+
+    LogStream stream(Log::get().stream());
+    stream<< "Regions: "<<numregions<<", "<<numloaded<<" with locations loaded ("
+          <<(*world_lazyregions ? "lazy" : "eager")<<")\n";
+    stream<< "Locations: "<<numexteriors<<" exteriors, "<<numdungeons<<" dungeons parsed\n";
+    stream<< "Region data: "<<(regionbytes+1023)/1024<<" KiB\n";
+    stream<< "Exterior name index: "<<mExteriorNames.size()<<" names, "
+          <<(mExteriorNames.getMemoryUsage()+1023)/1024<<" KiB\n";
+    stream<< "Climate and politic maps: "<<(pakbytes+1023)/1024<<" KiB\n";
+    stream<< "World cache: "<<(mCacheFile.empty() ? std::string("none") : mCacheFile)<<" ("<<mCacheStatus<<")\n";
+    stream<< "Startup: "<<mInitTime<<" ms, on-demand region loading: "<<mLazyLoadTime<<" ms\n";
+    stream<< "Last location load: "<<mLastLoadTime<<" ms ("
+          <<(*world_asyncload ? "background" : "blocking")<<")\n";
+    MBlockCache::Stats blockstats = MBlockCache::get().getStats();
+    stream<< "RMB block cache: "<<blockstats.mEntries<<" blocks ("<<blockstats.mInUse<<" in use), "
+          <<(blockstats.mMemoryUsage+1023)/1024<<" of "<<blockstats.mBudget/1024<<" KiB; "
+          <<blockstats.mHits<<" hits, "<<blockstats.mMisses<<" misses, "<<blockstats.mEvictions<<" evicted";
+    size_t cachebytes = 0;
+    for(const std::unique_ptr<CachedLocation> &cached : mLocationCache)
+        cachebytes += cached->getMemoryUsage();
+    stream<< "\nLocation cache: "<<mLocationCache.size()<<" of "<<*world_loccache<<" locations, "
+          <<(cachebytes+1023)/1024<<" of "<<*world_loccache_mem<<" KiB";
+    for(const std::unique_ptr<CachedLocation> &cached : mLocationCache)
+        stream<< "\n  "<<cached->mName<<": "<<(cached->getMemoryUsage()+1023)/1024<<" KiB";
+    if(mPrefetch)
+    {
+        stream<< "\nDungeon prefetch: "<<mPrefetch->mName<<", ";
+        int state = mPrefetch->mState;
+        if(state == DungeonPrefetch::State_Ready)
+            stream<< "ready in "<<mPrefetch->mTime<<" ms ("<<mPrefetch->mResources.size()<<" meshes and flats)";
+        else if(state == DungeonPrefetch::State_Failed)
+            stream<< "failed: "<<mPrefetch->mError;
+        else
+            stream<< "loading";
+    }
+    if(mStreamer.isActive())
+    {
+        WorldStreamer::Stats stats = mStreamer.getStats();
+        stream<< "\nStreaming: "<<stats.mResident<<" tiles resident, "<<stats.mBuilding<<" building, "
+              <<stats.mBlocks<<" blocks (peak "<<stats.mPeakBlocks<<"), "<<(stats.mMemoryUsage+1023)/1024<<" KiB\n";
+        stream<< "Streamed "<<stats.mTilesLoaded<<" tiles in, "<<stats.mTilesUnloaded<<" out, "
+              <<stats.mFailures<<" failed; update "<<stats.mLastUpdateTime<<" ms (max "<<stats.mMaxUpdateTime<<" ms)";
+    }
+}
+
 void World::dumpBlocks() const
 {
     std::stringstream sstr;
@@ -4,23 +4,45 @@
 #include "iface.hpp"
 
 #include <memory>
+#include <list>
 #include <vector>
 #include <string>
+#include <mutex>
+#include <future>
+#include <atomic>
+#include <chrono>
 
 #include <osg/Referenced>
 #include <osg/ref_ptr>
 #include <osg/Vec3>
 
+#include "misc/threadpool.hpp"
+#include "misc/sparsearray.hpp"
+#include "misc/nameindex.hpp"
+
+#include "components/vfs/manager.hpp"
+
 #include "itembase.hpp"
 #include "pitems.hpp"
 #include "ditems.hpp"
+#include "worldmap.hpp"
+#include "streamer.hpp"
 
 
+namespace Archives
+{
+    class MappedFile;
+}
+
 namespace DF
 {
 
 struct MBlockHeader;
 struct DBlockHeader;
+struct PendingLocation;
+struct DungeonPrefetch;
+struct CachedLocation;
+struct StreamBenchmark;
 
 class ObjectRef : public osg::Referenced {
     size_t mId;
@@ -47,20 +69,38 @@ struct MapTable {
 };
 
 struct MapRegion {
+    // The region number as it appears in the file names, e.g. "000".
+    std::string mFileSuffix;
+    // The exteriors and dungeons may be loaded on demand.
+    bool mItemsLoaded;
+    // Where the exteriors and dungeons are in the world cache, or 0 if they
+    // have to be read from the game data.
+    size_t mCacheOffset;
+
     std::vector<std::string> mNames;
     std::vector<MapTable> mTable;
     std::vector<ExteriorLocation> mExteriors;
     std::vector<DungeonInterior> mDungeons;
-};
 
-typedef std::vector<std::pair<uint16_t,uint8_t>> PakArray;
+    MapRegion() : mItemsLoaded(false), mCacheOffset(0) { }
+
+    // Approximate heap and object size, in bytes.
+    size_t getMemoryUsage() const;
+};
 
 class World : public WorldIface {
     osg::ref_ptr<osgViewer::Viewer> mViewer;
 
     std::vector<MapRegion> mRegions;
-    std::vector<PakArray> mClimates;
-    std::vector<PakArray> mPolitics;
+    WorldMap mClimate;
+    WorldMap mPolitics;
+
+    // Exterior names, with the region number in the upper 16 bits of the
+    // value and the location index in the lower 16.
+    Misc::NameIndex mExteriorNames;
+    // Exteriors by world map cell (row*width + column), valued as above.
+    // Built when streaming is first used.
+    Misc::SparseArray<uint32_t> mExteriorCells;
 
     const MapRegion *mCurrentRegion;
     const ExteriorLocation *mCurrentExterior;
@@ -70,34 +110,148 @@ class World : public WorldIface {
 
     std::vector<std::unique_ptr<MBlockHeader>> mExterior;
     std::vector<std::unique_ptr<DBlockHeader>> mDungeon;
+    // The current location's scene, under the object root.
+    osg::ref_ptr<osg::Group> mLocationRoot;
+
+    // The location being built in the background, if any, and the task
+    // building it. It replaces the current one once done.
+    std::shared_ptr<PendingLocation> mPendingLoad;
+    std::future<void> mPendingTask;
+    // The current exterior's dungeon, being decoded in the background.
+    std::shared_ptr<DungeonPrefetch> mPrefetch;
+    // Locations left but still loaded, most recently left first.
+    std::list<std::unique_ptr<CachedLocation>> mLocationCache;
 
     osg::Vec3f mCameraPos;
     osg::Vec3f mCameraRot;
 
     bool mFirstStart;
 
-    World();
-    ~World();
+    Misc::ThreadPool mWorkers;
+
+    WorldStreamer mStreamer;
+    std::unique_ptr<StreamBenchmark> mBenchmark;
 
-    static void loadPakList(std::string&& fname, std::vector<PakArray> &paklist);
+    // Guards loading region items on demand.
+    mutable std::mutex mRegionMutex;
 
-    static uint8_t getPakListValue(const std::vector<PakArray> &paklist, size_t x, size_t y);
+    double mInitTime;
+    double mLazyLoadTime;
+    double mLastLoadTime;
 
-    uint8_t getClimateValue(size_t x, size_t y) const { return getPakListValue(mClimates, x, y); }
-    uint8_t getPoliticValue(size_t x, size_t y) const { return getPakListValue(mPolitics, x, y); }
+    std::string mCacheFile;
+    // The game data files the map data comes from, as of startup.
+    std::vector<std::pair<std::string,VFS::SourceInfo>> mCacheSources;
+    // The mapped cache file, while any region's items are still in it.
+    std::shared_ptr<Archives::MappedFile> mCacheData;
+    std::string mCacheStatus;
+    // The task writing the cache in the background, if any, and when it was
+    // started.
+    std::future<size_t> mCacheTask;
+    std::chrono::steady_clock::time_point mCacheWriteStart;
+    std::atomic<bool> mCacheCancel;
+
+    World();
+    ~World();
+
+    void parseMapData(bool loaditems);
+    void buildNameIndex();
+
+    static MapRegion loadRegion(const std::string &name, const std::string &regstr, bool loaditems);
+    static void loadRegionItems(MapRegion &region);
+    void loadCachedItems(MapRegion &region) const;
+    void loadItems(MapRegion &region) const;
+    // Loads the items of every region that doesn't have them yet.
+    void loadAllItems();
+
+    /* Reads the regions and maps from the cache file, returning false if it
+     * doesn't exist, is out of date, or is invalid. */
+    bool readCache();
+    /* Loads every region's items and writes everything to the cache file,
+     * returning its size, or 0 if cancelled. Throws if it can't be written.
+     * Safe to run on a worker thread. */
+    size_t writeCache();
+    /* Starts writing the cache in a low priority task, unless it's already
+     * being written. */
+    void startCacheWrite();
+    void updateCacheWrite();
+
+    // Returns the given region, loading its exteriors and dungeons if needed.
+    const MapRegion &getRegion(size_t regnum);
+
+    static WorldMap loadWorldMap(const std::string &fname);
+
+    /* Gets the name of an exterior's block, or another with the same prefix
+     * if it doesn't exist (setting missing). */
+    static std::string getBlockName(const ExteriorLocation &extloc, size_t idx, size_t regnum, bool &missing);
+
+    void buildExteriorCells();
+    /* Gets the world tile of an exterior's first block. Locations sit in the
+     * middle of their map cell. */
+    void getExteriorTile(const ExteriorLocation &extloc, int &x, int &z) const;
+    bool resolveTile(int x, int z, StreamTileInfo &info) const;
+    /* Drops the current location and starts streaming around the given
+     * exterior, with its first block at the origin. */
+    void startStreaming(size_t regnum, size_t extid);
+    void updateStreaming();
+    void stopStreaming();
+    void updateBenchmark();
+
+    /* Starts building the given location, replacing any other being built. */
+    void startLoad(std::shared_ptr<PendingLocation> location);
+    void cancelLoad();
+    /* Reads the location's blocks and builds their scene, decoding dungeon
+     * blocks in parallel on the workers. Doesn't touch the object systems or
+     * the log, so it's safe to run on a worker thread. */
+    static void buildLocation(PendingLocation &location, Misc::ThreadPool &workers);
+    /* Reads and decodes the named dungeon blocks, in parallel on the workers
+     * at the given priority. */
+    static void decodeDungeon(const std::vector<std::string> &names, std::vector<std::unique_ptr<DBlockHeader>> &dblocks,
+                              const std::atomic<bool> &cancelled, Misc::ThreadPool &workers, Misc::TaskPriority priority);
+    /* Swaps in the pending location if it's done building, or updates the
+     * load progress if not. */
+    void updateLoad();
+    /* Replaces the current location with the built one. */
+    void swapLocation(PendingLocation &location);
+    /* Replaces the current location with a cached one, if the given location
+     * is cached. */
+    bool resumeLocation(const ExteriorLocation *exterior, const DungeonInterior *dungeon);
+    /* Puts the camera at the current location's start marker. */
+    void placeCamera();
+    /* Moves the current location into the location cache, or unloads it if
+     * caching is off. */
+    void leaveLocation();
+    void unloadLocation();
+    void trimLocationCache();
+    std::list<std::unique_ptr<CachedLocation>>::iterator findCachedLocation(const ExteriorLocation *exterior, const DungeonInterior *dungeon);
+
+    /* Starts decoding the current exterior's dungeon in the background, if
+     * it isn't already, dropping any other. */
+    void startPrefetch();
+    void cancelPrefetch();
+    static void prefetchDungeon(DungeonPrefetch &prefetch, Misc::ThreadPool &workers);
 
 public:
     static World sWorld;
 
-    virtual void initialize(osgViewer::Viewer *viewer, osg::Group *sceneroot) final;
+    virtual void initialize(osgViewer::Viewer *viewer, osg::Group *sceneroot, const std::string &cachefile) final;
     virtual void deinitialize() final;
 
+    virtual void rebuildCache() final;
+
     virtual bool getExteriorByName(const std::string &name, size_t &regnum, size_t &mapnum) const final;
+    virtual size_t findExteriors(const std::string &text, bool anywhere, std::vector<LocationMatch> &matches, size_t limit) const final;
+    virtual size_t getRegionCount() const final;
+    virtual void getExteriors(size_t regnum, std::vector<LocationSummary> &exteriors) final;
     virtual void loadExterior(int regnum, int extid) final;
 
     virtual void loadDungeonByExterior(int regnum, int extid) final;
     virtual void loadCurrentExteriorDungeon() final;
 
+    virtual void setStreaming(bool enable) final;
+    virtual bool isStreaming() const final;
+    virtual void startStreamBenchmark(float seconds) final;
+
     virtual void move(/*int objid,*/ float xrel, float yrel, float zrel) final;
     virtual void rotate(/*int objid,*/ float xrel, float yrel) final;
 
@@ -107,6 +261,7 @@ public:
 
     virtual void dumpArea() const final;
     virtual void dumpBlocks() const final;
+    virtual void dumpStats() const final;
 
     size_t castCameraToViewportRay(const float vpX, const float vpY, float maxDistance, bool ignoreFlats);
 };
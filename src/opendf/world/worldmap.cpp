@@ -0,0 +1,149 @@
+#include "worldmap.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <map>
+
+#include "misc/binaryreader.hpp"
+
+
+namespace DF
+{
+
+WorldMap::WorldMap()
+  : mWidth(0), mHeight(0), mStride(0)
+{
+}
+
+
+size_t WorldMap::toColumn(size_t x)
+{
+    /* As mentioned on UESP: http://uesp.net/wiki/Daggerfall:WOODS.WLD_format
+     *
+     * "the valid domain for each axis is defined as:
+     * Dom(X) = (51200, 32389120)
+     * Dom(Y) = (-80, 1228)
+     * Dom(Z) = (40961, 16332801)"
+     *
+     * However, there appears to be a mistake in that the Dom(X) and Dom(Z)
+     * values correspond to the ExteriorLocation's X and Y values, where those
+     * are the region map's Longitude and Latitude value*256 + n (where n is
+     * 0...255). Additionally, the latitude increases while going north. Thus,
+     * the correct domain for the longitude/latitude is:
+     *
+     * Dom(X) = [200, 126520]
+     * Dom(Z) = [63800, 160]
+     *
+     * However, I'm not sure if this range correctly maps to the world/climate/
+     * etc map extents.
+     */
+    if(x <= 200) return 0;
+    return size_t(uint64_t(x-200) * 1000 / (126520-200));
+}
+
+size_t WorldMap::toRow(size_t y)
+{
+    if(y <= 160) return 499;
+    // Positions north of the domain would go negative, so clamp to the top.
+    size_t dist = size_t(uint64_t(y-160) * 499 / (63800-160));
+    return (dist < 499) ? (499 - dist) : 0;
+}
+
+
+void WorldMap::load(Misc::BinaryReader &reader)
+{
+    // The file starts with the offset of each row, in the same order as
+    // the rows.
+    size_t rownum = 0;
+    std::map<size_t,size_t> offsets_rows;
+    offsets_rows[reader.read32()] = rownum++;
+    while(reader.tell() < offsets_rows.begin()->first)
+        offsets_rows[reader.read32()] = rownum++;
+
+    typedef std::vector<std::pair<uint16_t,uint8_t>> RunList;
+    std::vector<RunList> rows;
+    size_t width = 0;
+
+    auto iter = offsets_rows.begin();
+    while(iter != offsets_rows.end())
+    {
+        auto next = std::next(iter);
+
+        RunList runs;
+        size_t rowwidth = 0;
+        reader.seek(iter->first);
+        while((next != offsets_rows.end() && reader.tell() < next->first) ||
+              (next == offsets_rows.end() && !reader.eof()))
+        {
+            uint16_t count = reader.read16();
+            uint8_t val = reader.read8();
+            runs.push_back(std::make_pair(count, val));
+            rowwidth += count;
+        }
+        width = std::max(width, rowwidth);
+
+        if(iter->second >= rows.size())
+            rows.resize(iter->second+1);
+        rows[iter->second] = std::move(runs);
+
+        iter = next;
+    }
+
+    /* Rows that end early continue with their last value, and empty rows
+     * are 0.
+     */
+    resize(std::max<size_t>(width, 1), rows.size());
+    for(size_t row = 0;row < rows.size();++row)
+    {
+        uint8_t *dst = &mCells[row*mStride];
+        uint8_t *end = dst + mWidth;
+        for(const std::pair<uint16_t,uint8_t> &run : rows[row])
+            dst = std::fill_n(dst, run.first, run.second);
+        if(!rows[row].empty())
+            std::fill(dst, end, rows[row].back().second);
+    }
+}
+
+void WorldMap::resize(size_t width, size_t height)
+{
+    mWidth = width;
+    mHeight = height;
+    mStride = (width + sRowAlign-1) & ~(sRowAlign-1);
+    mCells.assign(mStride*mHeight, 0);
+}
+
+void WorldMap::assign(size_t width, size_t height, const std::vector<uint8_t> &cells)
+{
+    if(width == 0 || height == 0 || cells.size() != width*height)
+    {
+        resize(0, 0);
+        return;
+    }
+
+    resize(width, height);
+    for(size_t row = 0;row < height;++row)
+        std::copy_n(&cells[row*width], width, &mCells[row*mStride]);
+}
+
+
+void WorldMap::getValues(size_t x, size_t y, size_t width, size_t height, uint8_t *dst) const
+{
+    if(mCells.empty())
+    {
+        std::fill_n(dst, width*height, 0);
+        return;
+    }
+
+    std::vector<size_t> cols(width);
+    for(size_t i = 0;i < width;++i)
+        cols[i] = std::min(toColumn(x+i), mWidth-1);
+
+    for(size_t j = 0;j < height;++j)
+    {
+        const uint8_t *src = &mCells[std::min(toRow(y+j), mHeight-1) * mStride];
+        for(size_t i = 0;i < width;++i)
+            *(dst++) = src[cols[i]];
+    }
+}
+
+} // namespace DF
@@ -0,0 +1,81 @@
+#ifndef WORLD_WORLDMAP_HPP
+#define WORLD_WORLDMAP_HPP
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+#include "misc/alignedallocator.hpp"
+
+namespace Misc
+{
+    class BinaryReader;
+}
+
+namespace DF
+{
+
+/* A one-byte-per-cell map over the whole game world, such as the climate
+ * (CLIMATE.PAK) or politics (POLITIC.PAK). The run-length encoded rows of
+ * the .PAK file are decoded once into a dense grid, so any lookup is a
+ * single index.
+ *
+ * Positions are given as an ExteriorLocation's X and Y divided by 256 (the
+ * region map longitude and latitude), which are mapped onto the grid.
+ */
+class WorldMap {
+    // Rows are padded to a multiple of this many bytes, and the grid starts
+    // on such a boundary, so each row starts on its own cache line.
+    static const size_t sRowAlign = 64;
+
+    size_t mWidth;
+    size_t mHeight;
+    // Bytes from the start of one row to the next.
+    size_t mStride;
+    // Row-major, with row 0 being the north edge.
+    std::vector<uint8_t,Misc::AlignedAllocator<uint8_t,sRowAlign>> mCells;
+
+    // Sets the size, with every cell (and the row padding) 0.
+    void resize(size_t width, size_t height);
+
+public:
+    WorldMap();
+
+    /* Maps a position (see above) onto a grid column or row. */
+    static size_t toColumn(size_t x);
+    static size_t toRow(size_t y);
+
+    /* Decodes a .PAK file. */
+    void load(Misc::BinaryReader &reader);
+    /* Copies in width*height cells, row by row without padding. */
+    void assign(size_t width, size_t height, const std::vector<uint8_t> &cells);
+
+    size_t getWidth() const { return mWidth; }
+    size_t getHeight() const { return mHeight; }
+    // Gets the row's mWidth cells.
+    const uint8_t *getRow(size_t row) const { return &mCells[row*mStride]; }
+
+    /* Gets the value of a grid cell, clamped to the grid edges. Returns 0 if
+     * the map is empty. */
+    uint8_t getCell(size_t col, size_t row) const
+    {
+        if(mCells.empty()) return 0;
+        if(col >= mWidth) col = mWidth-1;
+        if(row >= mHeight) row = mHeight-1;
+        return mCells[row*mStride + col];
+    }
+
+    uint8_t getValue(size_t x, size_t y) const { return getCell(toColumn(x), toRow(y)); }
+
+    /* Gets the values at each position of a width x height rectangle, from x
+     * to x+width-1 and y to y+height-1, writing them row by row to dst. Each
+     * column and row is mapped to the grid once, rather than once per
+     * position. */
+    void getValues(size_t x, size_t y, size_t width, size_t height, uint8_t *dst) const;
+
+    size_t getMemoryUsage() const { return sizeof(*this) + mCells.capacity(); }
+};
+
+} // namespace DF
+
+#endif /* WORLD_WORLDMAP_HPP */
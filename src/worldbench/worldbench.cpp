@@ -0,0 +1,390 @@
+/* Loads every exterior and dungeon in the game data, one after another, with
+ * no window or graphics context. Each location goes through the same loaders
+ * the game uses, so all its blocks, meshes and textures are decoded, and a CSV
+ * row is written for it with how long it took, the memory and allocations it
+ * cost, and any errors. Useful both for spotting performance regressions and
+ * for finding data the loaders can't handle.
+ *
+ * With -blocks, it instead decodes every RMB and RDB entry in one archive
+ * (such as one made by bsatool -s), a row per entry, without any game data.
+ */
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <iterator>
+
+#include <osg/Group>
+
+#include "misc/binaryreader.hpp"
+
+#include "components/archives/bsaarchive.hpp"
+#include "components/vfs/manager.hpp"
+#include "components/settings/configfile.hpp"
+#include "components/resource/texturemanager.hpp"
+#include "components/resource/meshmanager.hpp"
+
+#include "gui/nullgui.hpp"
+#include "world/iface.hpp"
+#include "world/mblocks.hpp"
+#include "world/dblocks.hpp"
+#include "cvars.hpp"
+#include "log.hpp"
+
+
+namespace
+{
+
+std::atomic<size_t> gAllocCount(0);
+std::atomic<size_t> gAllocBytes(0);
+
+} // namespace
+
+/* Counts every allocation in the process, including on the world's worker
+ * threads. */
+void *operator new(std::size_t size)
+{
+    void *ptr = std::malloc(size ? size : 1);
+    if(!ptr) throw std::bad_alloc();
+    ++gAllocCount;
+    gAllocBytes += size;
+    return ptr;
+}
+void *operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options {
+    std::string mRootPath;
+    std::vector<std::string> mDataPaths;
+    std::string mOutput;
+    std::string mBlocksArchive;
+    int mRegion;
+    bool mExteriors;
+    bool mDungeons;
+
+    Options() : mOutput("worldbench.csv"), mRegion(-1), mExteriors(true), mDungeons(true) { }
+};
+
+/* Current and peak resident memory, in KiB, or 0 where unknown. */
+void getMemoryUsage(size_t &rss, size_t &peak)
+{
+    rss = peak = 0;
+#ifndef _WIN32
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    if(statm >> pages >> pages)
+        rss = pages * (sysconf(_SC_PAGESIZE) / 1024);
+
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+#ifdef __APPLE__
+        peak = usage.ru_maxrss / 1024;
+#else
+        peak = usage.ru_maxrss;
+#endif
+    }
+#endif
+}
+
+std::string csvQuote(const std::string &str)
+{
+    if(str.find_first_of(",\"\n") == std::string::npos)
+        return str;
+
+    std::string ret(1, '"');
+    for(char c : str)
+    {
+        if(c == '"') ret += '"';
+        ret += (c == '\n') ? ' ' : c;
+    }
+    ret += '"';
+    return ret;
+}
+
+class Bench {
+    std::ofstream mOutput;
+    size_t mRows;
+    size_t mErrors;
+    size_t mWarnings;
+
+public:
+    Bench() : mRows(0), mErrors(0), mWarnings(0) { }
+
+    void open(const std::string &fname)
+    {
+        mOutput.open(fname.c_str());
+        if(!mOutput.is_open())
+            throw std::runtime_error("Failed to open "+fname+" for writing");
+        mOutput<< "kind,region,index,name,blocks,time_ms,allocs,alloc_kib,rss_kib,peak_rss_kib,status,message" <<std::endl;
+    }
+
+    /* Runs func, writing a row for it. Exceptions are reported in the row
+     * rather than passed on. */
+    template<typename F>
+    bool run(const char *kind, int regnum, int index, const std::string &name, size_t blocks, F&& func)
+    {
+        std::string error;
+        size_t allocs = gAllocCount;
+        size_t allocbytes = gAllocBytes;
+        auto start = Clock::now();
+        try {
+            func();
+        }
+        catch(std::exception &e) {
+            error = e.what();
+        }
+        double elapsed = std::chrono::duration<double,std::milli>(Clock::now() - start).count();
+        allocs = gAllocCount - allocs;
+        allocbytes = gAllocBytes - allocbytes;
+
+        // Logged errors don't stop the location loading, so they're only
+        // warnings.
+        bool failed = !error.empty();
+        std::string messages = DF::NullGui::sGui.takeMessages();
+        if(failed && !messages.empty())
+            error += "; ";
+        error += messages;
+
+        size_t rss, peak;
+        getMemoryUsage(rss, peak);
+
+        mOutput<< kind<<","<<regnum<<","<<index<<","<<csvQuote(name)<<","<<blocks<<","
+               <<std::fixed<<std::setprecision(3)<<elapsed<<","
+               <<allocs<<","<<(allocbytes+1023)/1024<<","<<rss<<","<<peak<<","
+               <<(failed ? "error" : error.empty() ? "ok" : "warning")<<","<<csvQuote(error) <<std::endl;
+        ++mRows;
+        if(!error.empty())
+            ++(failed ? mErrors : mWarnings);
+        return !failed;
+    }
+
+    size_t getRows() const { return mRows; }
+    size_t getErrors() const { return mErrors; }
+    size_t getWarnings() const { return mWarnings; }
+};
+
+
+bool hasExtension(const std::string &name, const char *ext)
+{
+    size_t len = strlen(ext);
+    return name.size() >= len && strcasecmp(name.c_str()+name.size()-len, ext) == 0;
+}
+
+/* Decodes each RMB and RDB entry in the archive with the world's block
+ * loaders, which only decode without building any scene. Entries are read in
+ * first, so the rows only time the decoding.
+ */
+void benchmarkBlocks(const std::string &archname, Bench &bench)
+{
+    Archives::BsaArchive archive;
+    archive.load(archname);
+
+    int index = 0;
+    std::vector<char> data;
+    for(const std::string &name : archive.list())
+    {
+        bool isrmb = hasExtension(name, ".RMB");
+        if(!isrmb && !hasExtension(name, ".RDB"))
+            continue;
+
+        Archives::IStreamPtr stream = archive.open(name.c_str());
+        data.assign(std::istreambuf_iterator<char>(*stream), std::istreambuf_iterator<char>());
+        bench.run(isrmb ? "rmb" : "rdb", -1, index++, name, 1, [&data, isrmb]()
+        {
+            Misc::BinaryReader reader(data.data(), data.size());
+            if(isrmb)
+            {
+                DF::MBlockData block;
+                block.load(reader);
+            }
+            else
+            {
+                DF::DBlockHeader block;
+                block.load(reader, 0);
+            }
+        });
+    }
+}
+
+
+bool parseOptions(int argc, char **argv, Options &opts)
+{
+    for(int i = 1;i < argc;i++)
+    {
+        if(strcasecmp(argv[i], "-root") == 0 && i < argc-1)
+            opts.mRootPath = argv[++i];
+        else if(strcasecmp(argv[i], "-data") == 0 && i < argc-1)
+            opts.mDataPaths.push_back(argv[++i]);
+        else if(strcasecmp(argv[i], "-out") == 0 && i < argc-1)
+            opts.mOutput = argv[++i];
+        else if(strcasecmp(argv[i], "-blocks") == 0 && i < argc-1)
+            opts.mBlocksArchive = argv[++i];
+        else if(strcasecmp(argv[i], "-region") == 0 && i < argc-1)
+            opts.mRegion = atoi(argv[++i]);
+        else if(strcasecmp(argv[i], "-exteriors") == 0)
+            opts.mDungeons = false;
+        else if(strcasecmp(argv[i], "-dungeons") == 0)
+            opts.mExteriors = false;
+        else if(strcasecmp(argv[i], "-log") == 0 && i < argc-1)
+            DF::Log::get().setLog(argv[++i]);
+        else if(strcasecmp(argv[i], "-set") == 0 && i < argc-2)
+        {
+            DF::CVar::setByName(argv[i+1], argv[i+2]);
+            i += 2;
+        }
+        else
+        {
+            std::cerr<< "Usage: "<<argv[0]<<" [options]\n"
+                "  -root <path>      Game data (ARENA2) folder, instead of settings.cfg's data-root\n"
+                "  -data <path>      Additional data path\n"
+                "  -out <file>       CSV output (default worldbench.csv)\n"
+                "  -region <n>       Only load locations in region n\n"
+                "  -exteriors        Only load exteriors\n"
+                "  -dungeons         Only load dungeons\n"
+                "  -blocks <bsa>     Only decode the RMB and RDB entries in the given archive\n"
+                "  -log <file>       Log file (default opendf.log)\n"
+                "  -set <cvar> <val> Set a cvar" <<std::endl;
+            return false;
+        }
+    }
+
+    if(!opts.mBlocksArchive.empty())
+        return true;
+
+    if(opts.mRootPath.empty())
+    {
+        Settings::ConfigFile cf;
+        cf.load("settings.cfg");
+        opts.mRootPath = cf.getOption("data-root", std::string());
+        Settings::ConfigMultiEntryRange paths = cf.getMultiOptionRange("data");
+        for(auto path = paths.first;path != paths.second;++path)
+            opts.mDataPaths.push_back(path->second);
+    }
+    if(opts.mRootPath.empty())
+    {
+        std::cerr<< "No game data path; use -root, or run from a folder with a settings.cfg" <<std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace
+
+
+int main(int argc, char **argv)
+{
+    // Locations are loaded and entered one at a time on this thread, with
+    // nothing kept around afterward, so each row only covers its location.
+    // The map data is always parsed, to check it too.
+    DF::CVar::setByName("world_asyncload", "0");
+    DF::CVar::setByName("world_prefetch", "0");
+    DF::CVar::setByName("world_loccache", "0");
+    DF::CVar::setByName("world_cache", "0");
+
+    Options opts;
+    if(!parseOptions(argc, argv, opts))
+        return 1;
+
+    DF::Log &log = DF::Log::get();
+    log.initialize();
+    // Only errors, so they can be attributed to the location that caused
+    // them.
+    log.setLevel(DF::Log::Level_Error);
+    log.setGuiIface(&DF::GuiIface::get());
+
+    Bench bench;
+    osg::ref_ptr<osg::Group> root(new osg::Group());
+    try {
+        bench.open(opts.mOutput);
+
+        if(!opts.mBlocksArchive.empty())
+        {
+            benchmarkBlocks(opts.mBlocksArchive, bench);
+            std::cout<< "Wrote "<<bench.getRows()<<" rows to "<<opts.mOutput<<", "
+                     <<bench.getErrors()<<" with errors" <<std::endl;
+            return (bench.getErrors() > 0) ? 2 : 0;
+        }
+
+        bool ok = bench.run("init", -1, -1, "World data", 0, [&opts, &root]()
+        {
+            VFS::Manager::get().initialize(std::string(opts.mRootPath));
+            for(const std::string &path : opts.mDataPaths)
+                VFS::Manager::get().addDataPath(std::string(path));
+            Resource::TextureManager::get().initialize();
+            Resource::MeshManager::get().initialize();
+            DF::WorldIface::get().initialize(nullptr, root, std::string());
+        });
+        if(!ok)
+        {
+            std::cerr<< "Failed to initialize; see "<<opts.mOutput <<std::endl;
+            return 1;
+        }
+
+        DF::WorldIface &world = DF::WorldIface::get();
+        size_t numregions = world.getRegionCount();
+        for(size_t regnum = 0;regnum < numregions;++regnum)
+        {
+            if(opts.mRegion >= 0 && size_t(opts.mRegion) != regnum)
+                continue;
+
+            std::vector<DF::LocationSummary> exteriors;
+            if(!bench.run("region", regnum, -1, std::string(), 0, [&world, regnum, &exteriors]()
+                          { world.getExteriors(regnum, exteriors); }))
+                continue;
+
+            std::cout<< "Region "<<regnum<<": "<<exteriors.size()<<" exteriors" <<std::endl;
+            for(size_t extid = 0;extid < exteriors.size();++extid)
+            {
+                const DF::LocationSummary &summary = exteriors[extid];
+                if(opts.mExteriors)
+                    bench.run("exterior", regnum, extid, summary.mName, summary.mBlocks,
+                              [&world, regnum, extid]() { world.loadExterior(regnum, extid); });
+                if(opts.mDungeons && summary.mDungeonBlocks > 0)
+                    bench.run("dungeon", regnum, extid, summary.mDungeonName, summary.mDungeonBlocks,
+                              [&world, regnum, extid]() { world.loadDungeonByExterior(regnum, extid); });
+            }
+        }
+
+        world.deinitialize();
+        Resource::MeshManager::get().deinitialize();
+    }
+    catch(std::exception &e) {
+        std::cerr<< "Exception: "<<e.what() <<std::endl;
+        return 1;
+    }
+
+    std::cout<< "Wrote "<<bench.getRows()<<" rows to "<<opts.mOutput<<", "
+             <<bench.getErrors()<<" with errors, "<<bench.getWarnings()<<" with warnings" <<std::endl;
+    return (bench.getErrors() > 0) ? 2 : 0;
+}